@@ -49,6 +49,7 @@
 #include <string.h>
 
 #include "gstcambasesrc.h"
+#include "gstcameratrace.h"
 
 #include <sys/time.h>
 #include <unistd.h>
@@ -62,16 +63,39 @@ GST_DEBUG_CATEGORY_STATIC (gst_cam_base_src_debug);
 #define GST_CAT_DEFAULT gst_cam_base_src_debug
 
 #define GST_LIVE_GET_LOCK(elem)               (&GST_CAM_BASE_SRC_CAST(elem)->live_lock)
-#define GST_LIVE_LOCK(elem)                   g_mutex_lock(GST_LIVE_GET_LOCK(elem))
-#define GST_LIVE_UNLOCK(elem)                 g_mutex_unlock(GST_LIVE_GET_LOCK(elem))
+#define GST_LIVE_GET_STATS(elem)              (&GST_CAM_BASE_SRC_CAST(elem)->live_lock_stats)
+#define GST_LIVE_LOCK(elem)                   GST_CAMERASRC_MUTEX_LOCK(GST_LIVE_GET_LOCK(elem), GST_LIVE_GET_STATS(elem))
+#define GST_LIVE_UNLOCK(elem)                 GST_CAMERASRC_MUTEX_UNLOCK(GST_LIVE_GET_LOCK(elem), GST_LIVE_GET_STATS(elem))
 #define GST_LIVE_GET_COND(elem)               (&GST_CAM_BASE_SRC_CAST(elem)->live_cond)
-#define GST_LIVE_WAIT(elem)                   g_cond_wait (GST_LIVE_GET_COND (elem), GST_LIVE_GET_LOCK (elem))
-#define GST_LIVE_WAIT_UNTIL(elem, end_time)   g_cond_timed_wait (GST_LIVE_GET_COND (elem), GST_LIVE_GET_LOCK (elem), end_time)
+#define GST_LIVE_WAIT(elem)                   GST_CAMERASRC_COND_WAIT (GST_LIVE_GET_COND (elem), GST_LIVE_GET_LOCK (elem), GST_LIVE_GET_STATS (elem))
+#define GST_LIVE_WAIT_UNTIL(elem, end_time)   GST_CAMERASRC_COND_WAIT_UNTIL (GST_LIVE_GET_COND (elem), GST_LIVE_GET_LOCK (elem), GST_LIVE_GET_STATS (elem), end_time)
 #define GST_LIVE_SIGNAL(elem)                 g_cond_signal (GST_LIVE_GET_COND (elem));
 
-#define GST_VID_LIVE_GET_LOCK(elem)           (&GST_CAM_BASE_SRC_CAST(elem)->vid_live_lock)
-#define GST_VID_LIVE_LOCK(elem)               g_mutex_lock(GST_VID_LIVE_GET_LOCK(elem))
-#define GST_VID_LIVE_UNLOCK(elem)             g_mutex_unlock(GST_VID_LIVE_GET_LOCK(elem))
+/* live lock of a video pad, taken with its GstCamBaseSrcPadState */
+#define GST_VID_LIVE_LOCK(state)              GST_CAMERASRC_MUTEX_LOCK(&(state)->live_lock, &(state)->live_lock_stats)
+#define GST_VID_LIVE_UNLOCK(state)            GST_CAMERASRC_MUTEX_UNLOCK(&(state)->live_lock, &(state)->live_lock_stats)
+
+/* GstCamBaseSrcPadState of the src pad, at index 0 */
+#define GST_CAM_BASE_SRC_SRC_STATE(src)       GST_CAM_BASE_SRC_PAD_STATE (GST_CAM_BASE_SRC_CAST (src)->srcpad)
+#define GST_IS_SRC_STATE(src, state)          ((state)->pad == GST_CAM_BASE_SRC_CAST (src)->srcpad)
+
+/* live lock of the streaming thread of a pad, the one of the element for the src pad */
+#define GST_PAD_LIVE_LOCK(src, state) G_STMT_START { \
+    if (GST_IS_SRC_STATE (src, state)) GST_LIVE_LOCK (src); else GST_VID_LIVE_LOCK (state); \
+  } G_STMT_END
+#define GST_PAD_LIVE_UNLOCK(src, state) G_STMT_START { \
+    if (GST_IS_SRC_STATE (src, state)) GST_LIVE_UNLOCK (src); else GST_VID_LIVE_UNLOCK (state); \
+  } G_STMT_END
+
+/* Iterate over the GstCamBaseSrcPadState of all the pads, the src pad first */
+#define GST_CAM_BASE_SRC_FOREACH_PAD(src, state) \
+  for (guint _i = 0; _i < (src)->pads->len; _i++) \
+    if (((state) = (GstCamBaseSrcPadState *) g_ptr_array_index ((src)->pads, _i)))
+
+/* Iterate over the GstCamBaseSrcPadState of the video pads */
+#define GST_CAM_BASE_SRC_FOREACH_VIDEO_PAD(src, state) \
+  for (guint _i = 1; _i < (src)->pads->len; _i++) \
+    if (((state) = (GstCamBaseSrcPadState *) g_ptr_array_index ((src)->pads, _i)))
 
 #define GST_ASYNC_GET_COND(elem)              (&GST_CAM_BASE_SRC_CAST(elem)->priv->async_cond)
 #define GST_ASYNC_WAIT(elem)                  g_cond_wait (GST_ASYNC_GET_COND (elem), GST_OBJECT_GET_LOCK (elem))
@@ -91,6 +115,7 @@ enum
   PROP_NUM_BUFFERS,
   PROP_TYPEFIND,
   PROP_DO_TIMESTAMP,
+  PROP_MULTIPLEX,
 };
 
 #define GST_CAM_BASE_SRC_GET_PRIVATE(obj)  \
@@ -116,13 +141,13 @@ static gboolean gst_cam_base_src_event (GstPad * pad, GstObject * parent, GstEve
 static gboolean gst_cam_base_src_send_event (GstElement * elem, GstEvent * event);
 static gboolean gst_cam_base_src_default_event (GstCamBaseSrc * src, GstEvent * event);
 static gboolean gst_cam_base_src_query (GstPad * pad, GstObject * parent, GstQuery * query);
-static gboolean gst_cam_base_src_video_query (GstPad *pad, GstObject *parent, GstQuery *query);
-static gboolean gst_cam_base_src_activate_pool (GstCamBaseSrc * basesrc, gboolean active);
-static gboolean gst_cam_base_src_activate_video_pool (GstCamBaseSrc * basesrc, gboolean active);
+static gboolean gst_cam_base_src_activate_pool (GstCamBaseSrc * basesrc,
+    GstCamBaseSrcPadState * state, gboolean active);
+static gboolean gst_cam_base_src_activate_pools (GstCamBaseSrc * basesrc, gboolean active);
 static gboolean gst_cam_base_src_default_negotiate (GstCamBaseSrc * basesrc, GstPad *pad);
 static gboolean gst_cam_base_src_default_do_seek (GstCamBaseSrc * src,
     GstSegment * segment);
-static gboolean gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query);
+static gboolean gst_cam_base_src_default_query (GstCamBaseSrc *src, GstPad *pad, GstQuery *query);
 static gboolean gst_cam_base_src_default_prepare_seek_segment (GstCamBaseSrc * src, GstEvent * event,
     GstSegment * seeksegment);
 static GstFlowReturn gst_cam_base_src_default_create (GstCamBaseSrc * basesrc,
@@ -131,23 +156,26 @@ static GstFlowReturn gst_cam_base_src_default_alloc (GstCamBaseSrc * basesrc,
     GstPad *pad, guint64 offset, guint size, GstBuffer ** buf);
 static gboolean gst_cam_base_src_default_decide_allocation (GstCamBaseSrc * basesrc,
     GstQuery * query, GstPad * pad);
-static GstPad *gst_cam_base_src_add_video_pad(GstCamBaseSrc *basesrc, GstCamBaseSrcClass *klass);
+static GstPad *gst_cam_base_src_add_video_pad(GstCamBaseSrc *basesrc, GstPadTemplate *templ,
+    const gchar *name);
+static void gst_cam_base_src_remove_video_pad(GstCamBaseSrc *basesrc, GstPad *pad);
 static gboolean gst_cam_base_src_set_flushing (GstCamBaseSrc * basesrc,
     gboolean flushing, gboolean live_play, gboolean * playing);
 static gboolean gst_cam_base_src_start (GstCamBaseSrc * basesrc);
 static gboolean gst_cam_base_src_stop (GstCamBaseSrc * basesrc);
 static GstStateChangeReturn gst_cam_base_src_change_state (GstElement * element, GstStateChange transition);
 static void gst_cam_base_src_loop (GstPad * pad);
-static void gst_cam_base_src_video_loop (GstPad * pad);
+static void gst_cam_base_src_mux_loop (GstPad * pad);
+static gboolean gst_cam_base_src_start_task (GstCamBaseSrc * src);
+static void gst_cam_base_src_pause_task (GstCamBaseSrc * src, GstPad * pad);
 static GstFlowReturn gst_cam_base_src_getrange (GstPad * pad, GstObject * parent,
     guint64 offset, guint length, GstBuffer ** buf);
-static GstFlowReturn gst_cam_base_src_get_range (GstCamBaseSrc * src, GstPad *pad, guint64 offset,
-    guint length, GstBuffer ** buf);
-static GstFlowReturn gst_cam_base_src_video_get_range (GstCamBaseSrc * src, GstPad *pad, guint64 offset,
-    guint length, GstBuffer ** buf);
+static GstFlowReturn gst_cam_base_src_get_range (GstCamBaseSrc * src, GstCamBaseSrcPadState *state,
+    guint64 offset, guint length, GstBuffer ** buf);
 static gboolean gst_cam_base_src_seekable (GstCamBaseSrc * src);
 static gboolean gst_cam_base_src_negotiate (GstCamBaseSrc * basesrc, GstPad *pad);
-static gboolean gst_cam_base_src_update_length (GstCamBaseSrc * src, guint64 offset, guint * length, gboolean force);
+static gboolean gst_cam_base_src_update_length (GstCamBaseSrc * src, GstCamBaseSrcPadState *state,
+    guint64 offset, guint * length, gboolean force);
 
 /* debug symbols */
 static gboolean gst_cam_base_src_activate_push (GstPad * pad, GstObject * parent, gboolean active);
@@ -157,11 +185,10 @@ static gboolean gst_cam_base_src_set_allocation (GstCamBaseSrc * basesrc, GstPad
 static gboolean gst_cam_base_src_perform_seek (GstCamBaseSrc * src, GstEvent * event, gboolean unlock);
 
 static gboolean gst_cam_base_src_do_seek (GstCamBaseSrc * src, GstSegment * segment);
-static gboolean gst_cam_base_src_send_stream_start (GstCamBaseSrc * src);
-static gboolean gst_cam_base_src_send_video_stream_start (GstCamBaseSrc *src);
+static gboolean gst_cam_base_src_send_stream_start (GstCamBaseSrc *src, GstCamBaseSrcPadState *state);
 static gboolean gst_cam_base_src_prepare_allocation (GstCamBaseSrc * basesrc, GstCaps * caps, GstPad * pad);
-static GstClockReturn gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer);
-static GstClockReturn gst_cam_base_src_do_video_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer);
+static GstClockReturn gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstCamBaseSrcPadState *state,
+    GstBuffer * buffer);
 static GstClockReturn gst_cam_base_src_wait (GstCamBaseSrc * basesrc, GstClock * clock, GstClockTime time);
 static void gst_cam_base_src_update_qos (GstCamBaseSrc * src,
     gdouble proportion, GstClockTimeDiff diff, GstClockTime timestamp);
@@ -237,6 +264,11 @@ gst_cam_base_src_class_init(GstCamBaseSrcClass * klass)
           "Apply current stream time to buffers", DEFAULT_DO_TIMESTAMP,
           (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+  g_object_class_install_property (gobject_class, PROP_MULTIPLEX,
+      g_param_spec_boolean ("multiplex", "Multiplex",
+          "Push all the pads from a single streaming thread", DEFAULT_MULTIPLEX,
+          (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
   gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_cam_base_src_change_state);
   gstelement_class->send_event = GST_DEBUG_FUNCPTR (gst_cam_base_src_send_event);
 
@@ -254,12 +286,12 @@ gst_cam_base_src_class_init(GstCamBaseSrcClass * klass)
 
   /* extra interface for multi-stream feature to add more source pads */
   klass->add_video_pad = GST_DEBUG_FUNCPTR(gst_cam_base_src_add_video_pad);
+  klass->remove_video_pad = GST_DEBUG_FUNCPTR(gst_cam_base_src_remove_video_pad);
 
   /* Registering debug symbols for function pointers */
   GST_DEBUG_REGISTER_FUNCPTR (gst_cam_base_src_activate_mode);
   GST_DEBUG_REGISTER_FUNCPTR (gst_cam_base_src_event);
   GST_DEBUG_REGISTER_FUNCPTR (gst_cam_base_src_query);
-  GST_DEBUG_REGISTER_FUNCPTR (gst_cam_base_src_video_query);
   GST_DEBUG_REGISTER_FUNCPTR (gst_cam_base_src_getrange);
   GST_DEBUG_REGISTER_FUNCPTR (gst_cam_base_src_fixate);
 }
@@ -286,40 +318,127 @@ gst_cam_base_src_add_src_pad(GstCamBaseSrc *basesrc, GstCamBaseSrcClass *klass)
 
   // hold pointer to pad
   basesrc->srcpad = pad;
+  GstCamBaseSrcPadState *state = g_new0 (GstCamBaseSrcPadState, 1);
+  state->pad = pad;
+  state->index = 0;
+  state->num_buffers_left = -1;
+  state->mux_paused = TRUE;
+  gst_allocation_params_init (&state->params);
+  GST_PAD_ELEMENT_PRIVATE (pad) = state;
+  g_ptr_array_add (basesrc->pads, state);
+
   GST_DEBUG_OBJECT (basesrc, "adding src pad");
   gst_element_add_pad (GST_ELEMENT (basesrc), pad);
 }
 
-/* video source pad is a request pad from subclass */
+/* with the object lock, the lowest video_%u name no pad has */
+static gchar *
+gst_cam_base_src_video_pad_name (GstCamBaseSrc *basesrc)
+{
+  for (guint n = 0;; n++) {
+    gchar *name = g_strdup_printf ("video_%u", n);
+    GList *l;
+
+    for (l = GST_ELEMENT (basesrc)->srcpads; l; l = l->next) {
+      if (!g_strcmp0 (GST_PAD_NAME (l->data), name))
+        break;
+    }
+    if (!l)
+      return name;
+    g_free (name);
+  }
+}
+
+/* with the object lock, the states after the removed one move down so that
+ * the indexes of the pads stay contiguous */
+static void
+gst_cam_base_src_remove_state (GstCamBaseSrc *basesrc, GstCamBaseSrcPadState *state)
+{
+  g_ptr_array_remove_index (basesrc->pads, state->index);
+  for (guint i = state->index; i < basesrc->pads->len; i++)
+    ((GstCamBaseSrcPadState *) g_ptr_array_index (basesrc->pads, i))->index = i;
+}
+
+/* Video source pads are request pads from subclass, each has its own
+ * live lock, segment, buffer pool and streaming task */
 static GstPad *
-gst_cam_base_src_add_video_pad(GstCamBaseSrc *basesrc, GstCamBaseSrcClass *klass)
+gst_cam_base_src_add_video_pad(GstCamBaseSrc *basesrc, GstPadTemplate *templ,
+    const gchar *name)
 {
-  GstPad *pad = NULL;
-  GstPadTemplate *pad_template;
+  GstCamBaseSrcPadState *state = g_new0 (GstCamBaseSrcPadState, 1);
+  GstPad *pad;
+  gchar *padname = NULL;
+  guint index;
 
-  basesrc->priv->vid_stream_start_pending = FALSE;
-  g_mutex_init(&basesrc->vid_live_lock);
+  GST_OBJECT_LOCK (basesrc);
+  index = basesrc->pads->len;
+  state->index = index;
+  g_ptr_array_add (basesrc->pads, state);
+  gst_segment_init (&state->segment, basesrc->video_format);
+  if (!name)
+    name = padname = gst_cam_base_src_video_pad_name (basesrc);
+  GST_OBJECT_UNLOCK (basesrc);
 
-  pad_template =
-          gst_element_class_get_pad_template (GST_ELEMENT_CLASS (klass), GST_CAM_BASE_VIDEO_PAD_NAME);
+  GST_DEBUG_OBJECT (basesrc, "creating video pad %s", name);
+  pad = gst_pad_new_from_template (templ, name);
+  g_free (padname);
 
-  GST_DEBUG_OBJECT (basesrc, "creating video pad");
-  pad = gst_pad_new_from_template (pad_template, GST_CAM_BASE_VIDEO_PAD_NAME);
+  state->pad = pad;
+  g_mutex_init (&state->live_lock);
+  state->num_buffers_left = -1;
+  state->mux_paused = TRUE;
+  gst_allocation_params_init (&state->params);
+  GST_PAD_ELEMENT_PRIVATE (pad) = state;
 
   GST_DEBUG_OBJECT (basesrc, "setting functions on video pad");
   gst_pad_set_activatemode_function (pad, gst_cam_base_src_activate_mode);
   gst_pad_set_event_function (pad, gst_cam_base_src_event);
-  gst_pad_set_query_function (pad, gst_cam_base_src_video_query);
+  gst_pad_set_query_function (pad, gst_cam_base_src_query);
   gst_pad_set_getrange_function (pad, gst_cam_base_src_getrange);
 
-  // hold pointer to pad
-  basesrc->videopad = pad;
   GST_DEBUG_OBJECT (basesrc, "adding video pad");
-  gst_element_add_pad (GST_ELEMENT (basesrc), pad);
+  if (!gst_element_add_pad (GST_ELEMENT (basesrc), pad)) {
+    GST_OBJECT_LOCK (basesrc);
+    gst_cam_base_src_remove_state (basesrc, state);
+    GST_OBJECT_UNLOCK (basesrc);
+    g_mutex_clear (&state->live_lock);
+    g_free (state);
+    return NULL;
+  }
 
   return pad;
 }
 
+static void
+gst_cam_base_src_remove_video_pad(GstCamBaseSrc *basesrc, GstPad *pad)
+{
+  GstCamBaseSrcPadState *state = GST_CAM_BASE_SRC_PAD_STATE (pad);
+  gboolean multiplex;
+
+  g_return_if_fail (state != NULL && state->index > 0);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_cam_base_src_set_allocation (basesrc, pad, NULL, NULL, NULL);
+
+  /* the multiplexed task uses the states with the STREAM_LOCK of the src pad */
+  GST_OBJECT_LOCK (basesrc);
+  multiplex = basesrc->priv->multiplex;
+  GST_OBJECT_UNLOCK (basesrc);
+  if (multiplex)
+    GST_PAD_STREAM_LOCK (basesrc->srcpad);
+  GST_OBJECT_LOCK (basesrc);
+  gst_cam_base_src_remove_state (basesrc, state);
+  GST_OBJECT_UNLOCK (basesrc);
+  if (multiplex)
+    GST_PAD_STREAM_UNLOCK (basesrc->srcpad);
+
+  GST_PAD_ELEMENT_PRIVATE (pad) = NULL;
+  gst_element_remove_pad (GST_ELEMENT (basesrc), pad);
+
+  g_mutex_clear (&state->live_lock);
+  g_free (state);
+}
+
 static void
 gst_cam_base_src_init(GstCamBaseSrc *basesrc, GstCamBaseSrcClass *klass)
 {
@@ -331,12 +450,12 @@ gst_cam_base_src_init(GstCamBaseSrc *basesrc, GstCamBaseSrcClass *klass)
     g_mutex_init (&basesrc->live_lock);
     g_cond_init (&basesrc->live_cond);
     basesrc->num_buffers = DEFAULT_NUM_BUFFERS;
-    basesrc->num_buffers_left = -1;
     basesrc->priv->automatic_eos = TRUE;
-    basesrc->priv->stream_start_pending = FALSE;
     basesrc->priv->receive_eos = FALSE;
     basesrc->can_activate_push = TRUE;
 
+    basesrc->pads = g_ptr_array_new ();
+    basesrc->video_format = GST_FORMAT_BYTES;
     gst_cam_base_src_add_src_pad(basesrc, klass);
 
     basesrc->blocksize = DEFAULT_BLOCKSIZE;
@@ -345,6 +464,7 @@ gst_cam_base_src_init(GstCamBaseSrc *basesrc, GstCamBaseSrcClass *klass)
     gst_cam_base_src_set_format (basesrc, GST_FORMAT_BYTES, GST_CAM_BASE_SRC_PAD_NAME);
     basesrc->typefind = DEFAULT_TYPEFIND;
     basesrc->priv->do_timestamp = DEFAULT_DO_TIMESTAMP;
+    basesrc->priv->multiplex = DEFAULT_MULTIPLEX;
     g_atomic_int_set (&basesrc->priv->have_events, FALSE);
 
     g_cond_init (&basesrc->priv->async_cond);
@@ -368,7 +488,16 @@ gst_cam_base_src_finalize (GObject * object)
   g_cond_clear (&basesrc->live_cond);
   g_cond_clear (&basesrc->priv->async_cond);
 
-  g_mutex_clear (&basesrc->vid_live_lock);
+  /* request pads still there were removed without being released */
+  for (guint i = 0; i < basesrc->pads->len; i++) {
+    GstCamBaseSrcPadState *state = (GstCamBaseSrcPadState *) g_ptr_array_index (basesrc->pads, i);
+    if (!state)
+      continue;
+    if (i > 0)
+      g_mutex_clear (&state->live_lock);
+    g_free (state);
+  }
+  g_ptr_array_free (basesrc->pads, TRUE);
 
   event_p = &basesrc->pending_seek;
   gst_event_replace (event_p, NULL);
@@ -490,10 +619,15 @@ gst_cam_base_src_set_format (GstCamBaseSrc * src,
   g_return_if_fail (GST_STATE (src) <= GST_STATE_READY);
 
   GST_OBJECT_LOCK (src);
-  if (strcmp(padname, GST_CAM_BASE_SRC_PAD_NAME) == 0)
-    gst_segment_init (&src->segment, format);
-  else if (strcmp(padname, GST_CAM_BASE_VIDEO_PAD_NAME) == 0)
-    gst_segment_init (&src->vid_segment, format);
+  if (strcmp(padname, GST_CAM_BASE_SRC_PAD_NAME) == 0) {
+    gst_segment_init (&GST_CAM_BASE_SRC_SRC_STATE (src)->segment, format);
+  } else {
+    /* the video pads, including the ones requested later */
+    GstCamBaseSrcPadState *state;
+    src->video_format = format;
+    GST_CAM_BASE_SRC_FOREACH_VIDEO_PAD (src, state)
+      gst_segment_init (&state->segment, format);
+  }
   GST_OBJECT_UNLOCK (src);
 }
 
@@ -599,8 +733,8 @@ gst_cam_base_src_query_latency (GstCamBaseSrc * src, gboolean * live,
   /* if we have a startup latency, report this one, else report 0. Subclasses
    * are supposed to override the query function if they want something
    * else. */
-  if ((gint64)src->priv->latency != -1)
-    min = src->priv->latency;
+  if ((gint64)GST_CAM_BASE_SRC_SRC_STATE (src)->latency != -1)
+    min = GST_CAM_BASE_SRC_SRC_STATE (src)->latency;
   else
     min = 0;
 
@@ -673,8 +807,8 @@ gst_cam_base_src_set_do_timestamp (GstCamBaseSrc * src, gboolean timestamp)
 
   GST_OBJECT_LOCK (src);
   src->priv->do_timestamp = timestamp;
-  if (timestamp && src->segment.format != GST_FORMAT_TIME)
-    gst_segment_init (&src->segment, GST_FORMAT_TIME);
+  if (timestamp && GST_CAM_BASE_SRC_SRC_STATE (src)->segment.format != GST_FORMAT_TIME)
+    gst_segment_init (&GST_CAM_BASE_SRC_SRC_STATE (src)->segment, GST_FORMAT_TIME);
   GST_OBJECT_UNLOCK (src);
 }
 
@@ -700,49 +834,68 @@ gst_cam_base_src_get_do_timestamp (GstCamBaseSrc * src)
   return res;
 }
 
-static gboolean
-gst_cam_base_src_send_stream_start (GstCamBaseSrc * src)
+/**
+ * gst_cam_base_src_set_multiplex:
+ * @src: the source
+ * @multiplex: serve all the pads from one task
+ *
+ * Configure @src to push the buffers of all its pads from the task of the src
+ * pad instead of one task per pad, the pad expected to be ready first being
+ * served next. Each pad keeps its own flushing and EOS handling. Only takes
+ * effect when the pads are activated.
+ */
+void
+gst_cam_base_src_set_multiplex (GstCamBaseSrc * src, gboolean multiplex)
 {
-  gboolean ret = TRUE;
+  g_return_if_fail (GST_IS_CAM_BASE_SRC (src));
 
-  if (src->priv->stream_start_pending) {
-    gchar *stream_id;
-    gchar *name = gst_pad_get_name (src->srcpad);
-    GstEvent *event;
+  GST_OBJECT_LOCK (src);
+  src->priv->multiplex = multiplex;
+  GST_OBJECT_UNLOCK (src);
+}
 
-    stream_id =
-        gst_pad_create_stream_id (src->srcpad, GST_ELEMENT_CAST (src), name);
+/**
+ * gst_cam_base_src_get_multiplex:
+ * @src: the source
+ *
+ * Query if @src pushes the buffers of all its pads from a single task.
+ *
+ * Returns: %TRUE if the pads are served by the task of the src pad.
+ */
+gboolean
+gst_cam_base_src_get_multiplex (GstCamBaseSrc * src)
+{
+  gboolean res;
 
-    GST_DEBUG_OBJECT (src, "%s pad: Pushing STREAM_START", name);
-    event = gst_event_new_stream_start (stream_id);
-    gst_event_set_group_id (event, gst_util_group_id_next ());
+  g_return_val_if_fail (GST_IS_CAM_BASE_SRC (src), FALSE);
 
-    ret = gst_pad_push_event (src->srcpad, event);
-    src->priv->stream_start_pending = FALSE;
-    g_free (stream_id);
-    g_free (name);
-  }
+  GST_OBJECT_LOCK (src);
+  res = src->priv->multiplex;
+  GST_OBJECT_UNLOCK (src);
 
-  return ret;
+  return res;
 }
 
 static gboolean
-gst_cam_base_src_send_video_stream_start (GstCamBaseSrc *src)
+gst_cam_base_src_send_stream_start (GstCamBaseSrc *src, GstCamBaseSrcPadState *state)
 {
   gboolean ret = TRUE;
 
-  /* start video stream */
-  if (src->priv->vid_stream_start_pending) {
-    gchar *vid_stream_id;
-    gchar *name = gst_pad_get_name (src->videopad);
+  if (state->stream_start_pending) {
+    gchar *stream_id;
+    gchar *name = gst_pad_get_name (state->pad);
     GstEvent *event;
 
-    vid_stream_id = gst_pad_create_stream_id (src->videopad, GST_ELEMENT_CAST(src), name);
-    event = gst_event_new_stream_start(vid_stream_id);
-    gst_event_set_group_id(event, gst_util_group_id_next());
-    ret = gst_pad_push_event(src->videopad, event);
-    src->priv->vid_stream_start_pending = FALSE;
-    g_free(vid_stream_id);
+    stream_id =
+        gst_pad_create_stream_id (state->pad, GST_ELEMENT_CAST (src), name);
+
+    GST_DEBUG_OBJECT (src, "%s pad: Pushing STREAM_START", name);
+    event = gst_event_new_stream_start (stream_id);
+    gst_event_set_group_id (event, gst_util_group_id_next ());
+
+    ret = gst_pad_push_event (state->pad, event);
+    state->stream_start_pending = FALSE;
+    g_free (stream_id);
     g_free (name);
   }
 
@@ -775,14 +928,7 @@ gst_cam_base_src_set_caps (GstCamBaseSrc * src, GstPad * pad, GstCaps * caps)
 
   bclass = GST_CAM_BASE_SRC_GET_CLASS (src);
 
-  /* src pad is the main data pad, we won't call set_caps until all
-  * requested pads are done configuring
-  */
-  if (pad == src->srcpad) {
-    gst_cam_base_src_send_stream_start (src);
-  } else if (pad == src->videopad) {
-    gst_cam_base_src_send_video_stream_start (src);
-  }
+  gst_cam_base_src_send_stream_start (src, GST_CAM_BASE_SRC_PAD_STATE (pad));
 
   current_caps = gst_pad_get_current_caps (pad);
   if (current_caps && gst_caps_is_equal (current_caps, caps)) {
@@ -853,8 +999,9 @@ gst_cam_base_src_fixate (GstCamBaseSrc * bsrc, GstCaps * caps)
 }
 
 static gboolean
-gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
+gst_cam_base_src_default_query (GstCamBaseSrc *src, GstPad *pad, GstQuery *query)
 {
+  GstCamBaseSrcPadState *state = GST_CAM_BASE_SRC_PAD_STATE (pad);
   gboolean res;
 
   switch (GST_QUERY_TYPE (query)) {
@@ -874,8 +1021,8 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
           gint64 duration;
 
           GST_OBJECT_LOCK (src);
-          position = src->segment.position;
-          duration = src->segment.duration;
+          position = state->segment.position;
+          duration = state->segment.duration;
           GST_OBJECT_UNLOCK (src);
 
           if (position != -1 && duration != -1) {
@@ -898,15 +1045,15 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
 
           GST_OBJECT_LOCK (src);
           position =
-              gst_segment_to_stream_time (&src->segment, src->segment.format,
-              src->segment.position);
-          seg_format = src->segment.format;
+              gst_segment_to_stream_time (&state->segment, state->segment.format,
+              state->segment.position);
+          seg_format = state->segment.format;
           GST_OBJECT_UNLOCK (src);
 
           if (position != -1) {
             /* convert to requested format */
             res =
-                gst_pad_query_convert (src->srcpad, seg_format,
+                gst_pad_query_convert (pad, seg_format,
                 position, format, &position);
           } else
             res = TRUE;
@@ -941,13 +1088,13 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
           guint length = 0;
 
           /* may have to refresh duration */
-          gst_cam_base_src_update_length (src, 0, &length,
+          gst_cam_base_src_update_length (src, state, 0, &length,
               g_atomic_int_get (&src->priv->dynamic_size));
 
           /* this is the duration as configured by the subclass. */
           GST_OBJECT_LOCK (src);
-          duration = src->segment.duration;
-          seg_format = src->segment.format;
+          duration = state->segment.duration;
+          seg_format = state->segment.format;
           GST_OBJECT_UNLOCK (src);
 
           GST_LOG_OBJECT (src, "duration %" G_GINT64_FORMAT ", format %s",
@@ -957,7 +1104,7 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
             /* convert to requested format, if this fails, we have a duration
              * but we cannot answer the query, we must return FALSE. */
             res =
-                gst_pad_query_convert (src->srcpad, seg_format,
+                gst_pad_query_convert (pad, seg_format,
                 duration, format, &duration);
           } else {
             /* The subclass did not configure a duration, we assume that the
@@ -981,8 +1128,8 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
       gint64 duration;
 
       GST_OBJECT_LOCK (src);
-      duration = src->segment.duration;
-      seg_format = src->segment.format;
+      duration = state->segment.duration;
+      seg_format = state->segment.format;
       GST_OBJECT_UNLOCK (src);
 
       gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
@@ -1006,17 +1153,17 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
 
       GST_OBJECT_LOCK (src);
 
-      format = src->segment.format;
+      format = state->segment.format;
 
       start =
-          gst_segment_to_stream_time (&src->segment, format,
-          src->segment.start);
-      if ((stop = src->segment.stop) == -1)
-        stop = src->segment.duration;
+          gst_segment_to_stream_time (&state->segment, format,
+          state->segment.start);
+      if ((stop = state->segment.stop) == -1)
+        stop = state->segment.duration;
       else
-        stop = gst_segment_to_stream_time (&src->segment, format, stop);
+        stop = gst_segment_to_stream_time (&state->segment, format, stop);
 
-      gst_query_set_segment (query, src->segment.rate, format, start, stop);
+      gst_query_set_segment (query, state->segment.rate, format, start, stop);
 
       GST_OBJECT_UNLOCK (src);
       res = TRUE;
@@ -1082,26 +1229,26 @@ gst_cam_base_src_default_query (GstCamBaseSrc *src, GstQuery *query)
         if (format == GST_FORMAT_PERCENT)
           stop = GST_FORMAT_PERCENT_MAX;
         else
-          stop = src->segment.duration;
+          stop = state->segment.duration;
       } else {
         estimated = -1;
         start = -1;
         stop = -1;
       }
-      seg_format = src->segment.format;
+      seg_format = state->segment.format;
       GST_OBJECT_UNLOCK (src);
 
       /* convert to required format. When the conversion fails, we can't answer
        * the query. When the value is unknown, we can don't perform conversion
        * but report TRUE. */
       if (format != GST_FORMAT_PERCENT && stop != -1) {
-        res = gst_pad_query_convert (src->srcpad, seg_format,
+        res = gst_pad_query_convert (pad, seg_format,
             stop, format, &stop);
       } else {
         res = TRUE;
       }
       if (res && format != GST_FORMAT_PERCENT && start != -1)
-        res = gst_pad_query_convert (src->srcpad, seg_format,
+        res = gst_pad_query_convert (pad, seg_format,
             start, format, &start);
 
       gst_query_set_buffering_range (query, format, start, stop, estimated);
@@ -1182,25 +1329,11 @@ gst_cam_base_src_query (GstPad * pad, GstObject * parent,
   bclass = GST_CAM_BASE_SRC_GET_CLASS (src);
 
   if (bclass->query)
-    result = bclass->query (src, query);
+    result = bclass->query (src, pad, query);
 
   return result;
 }
 
-static gboolean
-gst_cam_base_src_video_query (GstPad *pad, GstObject *parent,
-    GstQuery *query)
-{
-  gboolean result = FALSE;
-
-  switch (GST_QUERY_TYPE(query)) {
-    default:
-      result = gst_pad_query_default (pad, parent, query);
-      break;
-  }
-  return result;
-}
-
 static gboolean
 gst_cam_base_src_default_do_seek (GstCamBaseSrc * src, GstSegment * segment)
 {
@@ -1317,22 +1450,10 @@ gst_cam_base_src_default_alloc (GstCamBaseSrc * src, GstPad *pad,
     guint64 offset, guint size, GstBuffer ** buffer)
 {
   GstFlowReturn ret;
-  GstCamBaseSrcPrivate *priv = src->priv;
-  GstBufferPool *pool = NULL;
-  GstAllocator *allocator = NULL;
-  GstAllocationParams params;
-
-  /* distinguish which pad is using, then assign pointers to
-   * bufferpool, allocator and params */
-  if (pad == src->srcpad) {
-    pool = priv->pool;
-    allocator = priv->allocator;
-    params = priv->params;
-  } else if (pad == src->videopad) {
-    pool = priv->vid_pool;
-    allocator = priv->vid_allocator;
-    params = priv->vid_params;
-  }
+  GstCamBaseSrcPadState *state = GST_CAM_BASE_SRC_PAD_STATE (pad);
+  GstBufferPool *pool = state->pool;
+  GstAllocator *allocator = state->allocator;
+  GstAllocationParams params = state->params;
 
   if (pool) {
     ret = gst_buffer_pool_acquire_buffer (pool, buffer, NULL);
@@ -1481,7 +1602,7 @@ gst_cam_base_src_perform_seek (GstCamBaseSrc * src, GstEvent * event, gboolean u
   GST_DEBUG_OBJECT (src, "doing seek: %" GST_PTR_FORMAT, event);
 
   GST_OBJECT_LOCK (src);
-  dest_format = src->segment.format;
+  dest_format = GST_CAM_BASE_SRC_SRC_STATE (src)->segment.format;
   GST_OBJECT_UNLOCK (src);
 
   if (event) {
@@ -1544,7 +1665,8 @@ gst_cam_base_src_perform_seek (GstCamBaseSrc * src, GstEvent * event, gboolean u
    * copy the current segment info into the temp segment that we can actually
    * attempt the seek with. We only update the real segment if the seek succeeds. */
   if (!seekseg_configured) {
-    MEMCPY_S (&seeksegment, sizeof (GstSegment), &src->segment, sizeof (GstSegment));
+    MEMCPY_S (&seeksegment, sizeof (GstSegment), &GST_CAM_BASE_SRC_SRC_STATE (src)->segment,
+        sizeof (GstSegment));
 
     /* now configure the final seek segment */
     if (event) {
@@ -1598,7 +1720,8 @@ gst_cam_base_src_perform_seek (GstCamBaseSrc * src, GstEvent * event, gboolean u
    * out the new segment. */
   if (res) {
     GST_OBJECT_LOCK (src);
-    MEMCPY_S (&src->segment, sizeof (GstSegment), &seeksegment, sizeof (GstSegment));
+    MEMCPY_S (&GST_CAM_BASE_SRC_SRC_STATE (src)->segment, sizeof (GstSegment), &seeksegment,
+        sizeof (GstSegment));
     GST_OBJECT_UNLOCK (src);
 
     if (seeksegment.flags & GST_SEGMENT_FLAG_SEGMENT) {
@@ -1619,8 +1742,7 @@ gst_cam_base_src_perform_seek (GstCamBaseSrc * src, GstEvent * event, gboolean u
   src->running = TRUE;
   /* and restart the task in case it got paused explicitly or by
    * the FLUSH_START event we pushed out. */
-  tres = gst_pad_start_task (src->srcpad, (GstTaskFunction) gst_cam_base_src_loop,
-      src->srcpad, NULL);
+  tres = gst_cam_base_src_start_task (src);
   if (res && !tres)
     res = FALSE;
 
@@ -1657,7 +1779,7 @@ gst_cam_base_src_send_event (GstElement * element, GstEvent * event)
       GST_DEBUG_OBJECT (src, "pushing flush-start event downstream");
       result = gst_pad_push_event (src->srcpad, event);
       /* also unblock the create function */
-      gst_cam_base_src_activate_pool (src, FALSE);
+      gst_cam_base_src_activate_pool (src, GST_CAM_BASE_SRC_SRC_STATE (src), FALSE);
       /* unlock any subclasses, we need to do this before grabbing the
        * LIVE_LOCK since we hold this lock before going into ::create. We pass an
        * unlock to the params because of backwards compat (see seek handler)*/
@@ -1694,7 +1816,7 @@ gst_cam_base_src_send_event (GstElement * element, GstEvent * event)
       GST_DEBUG_OBJECT (src, "pushing flush-stop event downstream");
       result = gst_pad_push_event (src->srcpad, event);
 
-      gst_cam_base_src_activate_pool (src, TRUE);
+      gst_cam_base_src_activate_pool (src, GST_CAM_BASE_SRC_SRC_STATE (src), TRUE);
 
       GST_OBJECT_LOCK (src->srcpad);
       start = (GST_PAD_MODE (src->srcpad) == GST_PAD_MODE_PUSH);
@@ -1706,8 +1828,7 @@ gst_cam_base_src_send_event (GstElement * element, GstEvent * event)
       }
 
       if (start)
-        gst_pad_start_task (src->srcpad, (GstTaskFunction) gst_cam_base_src_loop,
-            src->srcpad, NULL);
+        gst_cam_base_src_start_task (src);
       GST_LIVE_UNLOCK (src);
       event = NULL;
       break;
@@ -1742,7 +1863,7 @@ gst_cam_base_src_send_event (GstElement * element, GstEvent * event)
        * and we can do EOS. This will eventually release the LIVE_LOCK again so
        * that we can grab it and stop the unlock again. We don't take the stream
        * lock so that this operation is guaranteed to never block. */
-      gst_cam_base_src_activate_pool (src, FALSE);
+      gst_cam_base_src_activate_pool (src, GST_CAM_BASE_SRC_SRC_STATE (src), FALSE);
       if (bclass->unlock)
         bclass->unlock (src);
 
@@ -1754,7 +1875,7 @@ gst_cam_base_src_send_event (GstElement * element, GstEvent * event)
        * lock is enough because that protects the create function. */
       if (bclass->unlock_stop)
         bclass->unlock_stop (src);
-      gst_cam_base_src_activate_pool (src, TRUE);
+      gst_cam_base_src_activate_pool (src, GST_CAM_BASE_SRC_SRC_STATE (src), TRUE);
       GST_LIVE_UNLOCK (src);
 
       result = TRUE;
@@ -1979,6 +2100,9 @@ gst_cam_base_src_set_property (GObject * object, guint prop_id,
     case PROP_DO_TIMESTAMP:
       gst_cam_base_src_set_do_timestamp (src, g_value_get_boolean (value));
       break;
+    case PROP_MULTIPLEX:
+      gst_cam_base_src_set_multiplex (src, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -2006,6 +2130,9 @@ gst_cam_base_src_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_DO_TIMESTAMP:
       g_value_set_boolean (value, gst_cam_base_src_get_do_timestamp (src));
       break;
+    case PROP_MULTIPLEX:
+      g_value_set_boolean (value, gst_cam_base_src_get_multiplex (src));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -2035,10 +2162,13 @@ gst_cam_base_src_wait (GstCamBaseSrc * basesrc, GstClock * clock, GstClockTime t
 }
 
 /* perform synchronisation on a buffer.
- * with STREAM_LOCK.
+ * with STREAM_LOCK and the live lock of the pad. Only the src pad waits on
+ * the clock, #GstCamBaseSrcClass.get_times has no pad and the clock entry
+ * is released with the live lock of the element.
  */
 static GstClockReturn
-gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
+gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstCamBaseSrcPadState * state,
+    GstBuffer * buffer)
 {
   GstClockReturn result;
   GstClockTime start, end;
@@ -2047,11 +2177,12 @@ gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
   GstClock *clock;
   GstClockTime now = GST_CLOCK_TIME_NONE, pts, dts;
   gboolean do_timestamp, first, is_live;
+  const gchar *padname = GST_PAD_NAME (state->pad);
 
   bclass = GST_CAM_BASE_SRC_GET_CLASS (basesrc);
 
   start = end = -1;
-  if (bclass->get_times)
+  if (bclass->get_times && GST_IS_SRC_STATE (basesrc, state))
     bclass->get_times (basesrc, buffer, &start, &end);
 
   /* get buffer timestamp */
@@ -2064,12 +2195,12 @@ gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
 
   is_live = basesrc->is_live;
   /* check for the first buffer */
-  first = ((gint64)basesrc->priv->latency == -1);
+  first = ((gint64)state->latency == -1);
 
   if (first) {
-    GST_DEBUG_OBJECT (basesrc, "src pad: no latency needed, live %d, sync %d",
-        is_live, (gint64)start != -1);
-    basesrc->priv->latency = 0;
+    GST_DEBUG_OBJECT (basesrc, "%s pad: no latency needed, live %d, sync %d",
+        padname, is_live, (gint64)start != -1);
+    state->latency = 0;
   }
 
   /* get clock, if no clock, we can't sync or do timestamps */
@@ -2091,27 +2222,27 @@ gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
     running_time = now - base_time;
 
     GST_LOG_OBJECT (basesrc,
-        "src pad: startup PTS: %" GST_TIME_FORMAT ", DTS %" GST_TIME_FORMAT
-        ", running_time %" GST_TIME_FORMAT, GST_TIME_ARGS (pts),
+        "%s pad: startup PTS: %" GST_TIME_FORMAT ", DTS %" GST_TIME_FORMAT
+        ", running_time %" GST_TIME_FORMAT, padname, GST_TIME_ARGS (pts),
         GST_TIME_ARGS (dts), GST_TIME_ARGS (running_time));
 
-    basesrc->priv->ts_offset = 0;
-    GST_LOG_OBJECT (basesrc, "src pad: no timestamp offset needed");
+    state->ts_offset = 0;
+    GST_LOG_OBJECT (basesrc, "%s pad: no timestamp offset needed", padname);
 
     if (!GST_CLOCK_TIME_IS_VALID (dts)) {
       if (do_timestamp) {
         dts = running_time;
       } else if (!GST_CLOCK_TIME_IS_VALID (pts)) {
-        if (GST_CLOCK_TIME_IS_VALID (basesrc->segment.start)) {
-          dts = basesrc->segment.start;
+        if (GST_CLOCK_TIME_IS_VALID (state->segment.start)) {
+          dts = state->segment.start;
         } else {
           dts = 0;
         }
       }
       GST_BUFFER_DTS (buffer) = dts;
 
-      GST_LOG_OBJECT (basesrc, "src pad: created DTS %" GST_TIME_FORMAT,
-          GST_TIME_ARGS (dts));
+      GST_LOG_OBJECT (basesrc, "%s pad: created DTS %" GST_TIME_FORMAT,
+          padname, GST_TIME_ARGS (dts));
     }
   } else {
     /* not the first buffer, the timestamp is the diff between the clock and
@@ -2122,8 +2253,8 @@ gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
       dts = now - base_time;
       GST_BUFFER_DTS (buffer) = dts;
 
-      GST_LOG_OBJECT (basesrc, "src pad: created DTS %" GST_TIME_FORMAT,
-          GST_TIME_ARGS (dts));
+      GST_LOG_OBJECT (basesrc, "%s pad: created DTS %" GST_TIME_FORMAT,
+          padname, GST_TIME_ARGS (dts));
     }
   }
   if (!GST_CLOCK_TIME_IS_VALID (pts)) {
@@ -2132,8 +2263,8 @@ gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
 
     GST_BUFFER_PTS (buffer) = dts;
 
-    GST_LOG_OBJECT (basesrc, "src pad: created PTS %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (pts));
+    GST_LOG_OBJECT (basesrc, "%s pad: created PTS %" GST_TIME_FORMAT,
+        padname, GST_TIME_ARGS (pts));
   }
 
   /* if we don't have a buffer timestamp, we don't sync */
@@ -2143,167 +2274,58 @@ gst_cam_base_src_do_sync (GstCamBaseSrc * basesrc, GstBuffer * buffer)
   if (is_live) {
     /* for pseudo live sources, add our ts_offset to the timestamp */
     if (GST_CLOCK_TIME_IS_VALID (pts))
-      GST_BUFFER_PTS (buffer) += basesrc->priv->ts_offset;
+      GST_BUFFER_PTS (buffer) += state->ts_offset;
     if (GST_CLOCK_TIME_IS_VALID (dts))
-      GST_BUFFER_DTS (buffer) += basesrc->priv->ts_offset;
-    start += basesrc->priv->ts_offset;
+      GST_BUFFER_DTS (buffer) += state->ts_offset;
+    start += state->ts_offset;
   }
 
   GST_LOG_OBJECT (basesrc,
-      "src pad: waiting for clock, base time %" GST_TIME_FORMAT
+      "%s pad: waiting for clock, base time %" GST_TIME_FORMAT
       ", stream_start %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (base_time), GST_TIME_ARGS (start));
+      padname, GST_TIME_ARGS (base_time), GST_TIME_ARGS (start));
 
   result = gst_cam_base_src_wait (basesrc, clock, start + base_time);
 
   gst_object_unref (clock);
 
-  GST_LOG_OBJECT (basesrc, "src pad: clock entry done: %d", result);
+  GST_LOG_OBJECT (basesrc, "%s pad: clock entry done: %d", padname, result);
 
   return result;
 
   /* special cases */
 no_clock:
   {
-    GST_DEBUG_OBJECT (basesrc, "src pad: we have no clock");
+    GST_DEBUG_OBJECT (basesrc, "%s pad: we have no clock", padname);
     GST_OBJECT_UNLOCK (basesrc);
     return GST_CLOCK_OK;
   }
 no_sync:
   {
-    GST_DEBUG_OBJECT (basesrc, "src pad: no sync needed");
+    GST_DEBUG_OBJECT (basesrc, "%s pad: no sync needed", padname);
     gst_object_unref (clock);
     return GST_CLOCK_OK;
   }
 }
 
-static GstClockReturn
-gst_cam_base_src_do_video_sync(GstCamBaseSrc * basesrc, GstBuffer * buffer)
-{
-  GstClockTime start, end;
-  GstClockTime base_time;
-  GstClock *clock;
-  GstClockTime now = GST_CLOCK_TIME_NONE, pts, dts;
-  gboolean do_timestamp, first, is_live;
-
-  start = end = -1;
-
-  /* get buffer timestamp */
-  dts = GST_BUFFER_DTS (buffer);
-  pts = GST_BUFFER_PTS (buffer);
-
-  /* grab the lock to prepare for clocking and calculate the startup
-   * latency. */
-  GST_OBJECT_LOCK (basesrc);
-
-  is_live = basesrc->is_live;
-  /* check for the first buffer */
-  first = ((gint64)basesrc->priv->vid_latency == -1);
-
-  if (first) {
-    GST_DEBUG_OBJECT (basesrc, "video pad: no latency needed, live %d, sync %d",
-      is_live, (gint64)start != -1);
-    basesrc->priv->vid_latency = 0;
-  }
-
-  /* get clock, if no clock, we can't sync or do timestamps */
-  if ((clock = GST_ELEMENT_CLOCK (basesrc)) == NULL)
-    goto no_clock;
-  else
-    gst_object_ref (clock);
-
-  base_time = GST_ELEMENT_CAST (basesrc)->base_time;
-
-  do_timestamp = basesrc->priv->do_timestamp;
-  GST_OBJECT_UNLOCK (basesrc);
-
-  /* first buffer, calculate the timestamp offset */
-  if (first) {
-    GstClockTime running_time;
-
-    now = gst_clock_get_time (clock);
-    running_time = now - base_time;
-
-    GST_LOG_OBJECT (basesrc,
-             "video pad: startup PTS: %" GST_TIME_FORMAT ", DTS %" GST_TIME_FORMAT
-             ", running_time %" GST_TIME_FORMAT, GST_TIME_ARGS (pts),
-             GST_TIME_ARGS (dts), GST_TIME_ARGS (running_time));
-
-    basesrc->priv->vid_ts_offset = 0;
-    GST_LOG_OBJECT (basesrc, "video pad: no timestamp offset needed");
-
-    if (!GST_CLOCK_TIME_IS_VALID (dts)) {
-      if (do_timestamp) {
-        dts = running_time;
-      } else if (!GST_CLOCK_TIME_IS_VALID (pts)) {
-        dts = 0;
-      }
-      GST_BUFFER_DTS (buffer) = dts;
-
-      GST_LOG_OBJECT (basesrc, "video pad: created DTS %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (dts));
-    }
-  } else {
-    /* not the first buffer, the timestamp is the diff between the clock and
-     * base_time */
-    if (do_timestamp && !GST_CLOCK_TIME_IS_VALID (dts)) {
-      now = gst_clock_get_time (clock);
-
-      dts = now - base_time;
-      GST_BUFFER_DTS (buffer) = dts;
-
-      GST_LOG_OBJECT (basesrc, "video pad: created DTS %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (dts));
-    }
-  }
-  if (!GST_CLOCK_TIME_IS_VALID (pts)) {
-    if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
-      pts = dts;
-
-    GST_BUFFER_PTS (buffer) = dts;
-    GST_LOG_OBJECT (basesrc, "video pad: created PTS %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (pts));
-  }
-
-  /* if we don't have a buffer timestamp, we don't sync */
-  if (!GST_CLOCK_TIME_IS_VALID (start))
-    goto no_sync;
-
-  return GST_CLOCK_OK;
-
-  /* special cases */
-  no_clock:
-  {
-    GST_DEBUG_OBJECT (basesrc, "video pad: we have no clock");
-    GST_OBJECT_UNLOCK (basesrc);
-    return GST_CLOCK_OK;
-  }
-  no_sync:
-  {
-    GST_DEBUG_OBJECT (basesrc, "video pad: no sync needed");
-    gst_object_unref (clock);
-    return GST_CLOCK_OK;
-  }
-}
-
-/* Called with STREAM_LOCK and LIVE_LOCK */
+/* Called with STREAM_LOCK and the live lock of the pad */
 static gboolean
-gst_cam_base_src_update_length (GstCamBaseSrc * src, guint64 offset, guint * length,
-    gboolean force)
+gst_cam_base_src_update_length (GstCamBaseSrc * src, GstCamBaseSrcPadState * state,
+    guint64 offset, guint * length, gboolean force)
 {
   guint64 size, maxsize;
   GstCamBaseSrcClass *bclass;
   gint64 stop;
 
   /* only operate if we are working with bytes */
-  if (src->segment.format != GST_FORMAT_BYTES)
+  if (state->segment.format != GST_FORMAT_BYTES)
     return TRUE;
 
   bclass = GST_CAM_BASE_SRC_GET_CLASS (src);
 
-  stop = src->segment.stop;
+  stop = state->segment.stop;
   /* get total file size */
-  size = src->segment.duration;
+  size = state->segment.duration;
 
   /* when not doing automatic EOS, just use the stop position. We don't use
    * the size to check for EOS */
@@ -2353,7 +2375,7 @@ gst_cam_base_src_update_length (GstCamBaseSrc * src, guint64 offset, guint * len
   /* keep track of current duration. segment is in bytes, we checked
    * that above. */
   GST_OBJECT_LOCK (src);
-  src->segment.duration = size;
+  state->segment.duration = size;
   GST_OBJECT_UNLOCK (src);
 
   return TRUE;
@@ -2366,22 +2388,24 @@ unexpected_length:
   }
 }
 
-/* must be called with LIVE_LOCK */
+/* must be called with the live lock of the pad */
 static GstFlowReturn
-gst_cam_base_src_get_range (GstCamBaseSrc * src, GstPad *pad, guint64 offset,
-    guint length, GstBuffer ** buf)
+gst_cam_base_src_get_range (GstCamBaseSrc * src, GstCamBaseSrcPadState * state,
+    guint64 offset, guint length, GstBuffer ** buf)
 {
   GstFlowReturn ret;
   GstCamBaseSrcClass *bclass;
   GstClockReturn status;
   GstBuffer *res_buf;
   GstBuffer *in_buf;
-  gchar *padname = gst_pad_get_name(pad);
+  GstPad *pad = state->pad;
+  const gchar *padname = GST_PAD_NAME(pad);
 
   bclass = GST_CAM_BASE_SRC_GET_CLASS (src);
 
 again:
-  if (src->is_live) {
+  /* the video pads don't hold the live lock of the element to wait with */
+  if (src->is_live && GST_IS_SRC_STATE (src, state)) {
     if (G_UNLIKELY (!src->live_running)) {
       ret = gst_cam_base_src_wait_playing (src);
       if (ret != GST_FLOW_OK)
@@ -2396,21 +2420,21 @@ again:
   if (G_UNLIKELY (!bclass->create))
     goto no_function;
 
-  if (G_UNLIKELY (!gst_cam_base_src_update_length (src, offset, &length, FALSE)))
+  if (G_UNLIKELY (!gst_cam_base_src_update_length (src, state, offset, &length, FALSE)))
     goto unexpected_length;
 
   /* track position */
   GST_OBJECT_LOCK (src);
-  if (src->segment.format == GST_FORMAT_BYTES)
-    src->segment.position = offset;
+  if (state->segment.format == GST_FORMAT_BYTES)
+    state->segment.position = offset;
   GST_OBJECT_UNLOCK (src);
 
   /* normally we don't count buffers */
-  if (G_UNLIKELY (src->num_buffers_left >= 0)) {
-    if (src->num_buffers_left == 0)
+  if (G_UNLIKELY (state->num_buffers_left >= 0)) {
+    if (state->num_buffers_left == 0)
       goto reached_num_buffers;
     else
-      src->num_buffers_left--;
+      state->num_buffers_left--;
   }
 
   /* don't enter the create function if a pending EOS event was set. For the
@@ -2422,7 +2446,7 @@ again:
 
   GST_DEBUG_OBJECT (src,
       "%s pad: calling create offset %" G_GUINT64_FORMAT " length %u, time %"
-      G_GINT64_FORMAT, padname, offset, length, src->segment.time);
+      G_GINT64_FORMAT, padname, offset, length, state->segment.time);
 
   res_buf = in_buf = *buf;
 
@@ -2461,7 +2485,7 @@ again:
   }
 
   /* no timestamp set and we are at offset 0, we can timestamp with 0 */
-  if (offset == 0 && src->segment.time == 0
+  if (offset == 0 && state->segment.time == 0
       && (gint64)GST_BUFFER_DTS (res_buf) == -1 && !src->is_live) {
     GST_DEBUG_OBJECT (src, "%s pad: setting first timestamp to 0", padname);
     res_buf = gst_buffer_make_writable (res_buf);
@@ -2469,7 +2493,7 @@ again:
   }
 
   /* now sync before pushing the buffer */
-  status = gst_cam_base_src_do_sync (src, res_buf);
+  status = gst_cam_base_src_do_sync (src, state, res_buf);
 
   /* waiting for the clock could have made us flushing */
   if (G_UNLIKELY (src->priv->flushing))
@@ -2478,24 +2502,24 @@ again:
   switch (status) {
     case GST_CLOCK_EARLY:
       /* the buffer is too late. We currently don't drop the buffer. */
-      GST_DEBUG_OBJECT (src, "buffer too late!, returning anyway");
+      GST_DEBUG_OBJECT (src, "%s pad: buffer too late!, returning anyway", padname);
       break;
     case GST_CLOCK_OK:
       /* buffer synchronised properly */
-      GST_DEBUG_OBJECT (src, "buffer ok");
+      GST_DEBUG_OBJECT (src, "%s pad: buffer ok", padname);
       break;
     case GST_CLOCK_UNSCHEDULED:
       if (!src->live_running) {
         /* We return FLUSHING when we are not running to stop the dataflow also
          * get rid of the produced buffer. */
         GST_DEBUG_OBJECT (src,
-            "clock was unscheduled (%d), returning FLUSHING", status);
+            "%s pad: clock was unscheduled (%d), returning FLUSHING", padname, status);
         ret = GST_FLOW_FLUSHING;
       } else {
         /* If we are running when this happens, we quickly switched between
          * pause and playing. We try to produce a new buffer */
         GST_DEBUG_OBJECT (src,
-            "clock was unscheduled (%d), but we are running", status);
+            "%s pad: clock was unscheduled (%d), but we are running", padname, status);
         goto again;
       }
       break;
@@ -2510,8 +2534,6 @@ again:
   if (G_LIKELY (ret == GST_FLOW_OK))
     *buf = res_buf;
 
-  g_free (padname);
-
   return ret;
 
   /* ERROR */
@@ -2519,14 +2541,12 @@ stopped:
   {
     GST_DEBUG_OBJECT (src, "%s pad: wait_playing returned %d (%s)", padname,
         ret, gst_flow_get_name (ret));
-    g_free (padname);
     return ret;
   }
 not_ok:
   {
     GST_DEBUG_OBJECT (src, "%s pad: create returned %d (%s)", padname, ret,
         gst_flow_get_name (ret));
-    g_free (padname);
     return ret;
   }
 map_failed:
@@ -2534,152 +2554,37 @@ map_failed:
     GST_ELEMENT_ERROR (src, RESOURCE, BUSY,
         ("%s pad: failed to map buffer.", padname),
         ("failed to map result buffer in WRITE mode"));
-    g_free (padname);
     return GST_FLOW_ERROR;
   }
 not_started:
   {
     GST_DEBUG_OBJECT (src, "%s pad: getrange but not started", padname);
-    g_free (padname);
     return GST_FLOW_FLUSHING;
   }
 no_function:
   {
     GST_DEBUG_OBJECT (src, "%s pad: no create function", padname);
-    g_free (padname);
     return GST_FLOW_NOT_SUPPORTED;
   }
 unexpected_length:
   {
     GST_DEBUG_OBJECT (src, "%s pad: unexpected length %u (offset=%" G_GUINT64_FORMAT
-        ", size=%" G_GINT64_FORMAT ")", padname, length, offset, src->segment.duration);
-    g_free (padname);
+        ", size=%" G_GINT64_FORMAT ")", padname, length, offset, state->segment.duration);
     return GST_FLOW_EOS;
   }
 reached_num_buffers:
   {
     GST_DEBUG_OBJECT (src, "%s pad: sent all buffers", padname);
-    g_free (padname);
     return GST_FLOW_EOS;
   }
 flushing:
   {
     GST_DEBUG_OBJECT (src, "%s pad: we are flushing", padname);
-    g_free (padname);
     return GST_FLOW_FLUSHING;
   }
 eos:
   {
     GST_DEBUG_OBJECT (src, "%s pad: we are EOS", padname);
-    g_free (padname);
-    return GST_FLOW_EOS;
-  }
-}
-
-static GstFlowReturn
-gst_cam_base_src_video_get_range (GstCamBaseSrc * src, GstPad *pad, guint64 offset,
-    guint length, GstBuffer ** buf)
-{
-  GstFlowReturn ret;
-  GstCamBaseSrcClass *bclass;
-  GstClockReturn status;
-  GstBuffer *res_buf, *in_buf;
-  gchar *padname = gst_pad_get_name(pad);
-
-  bclass = GST_CAM_BASE_SRC_GET_CLASS(src);
-
-  if (G_UNLIKELY (!GST_CAM_BASE_SRC_IS_STARTED (src)
-          && !GST_CAM_BASE_SRC_IS_STARTING (src)))
-    goto not_started;
-
-  if (G_UNLIKELY (src->num_video_buffers_left >= 0)) {
-    if (src->num_video_buffers_left == 0)
-      goto reached_num_buffers;
-    else
-      src->num_video_buffers_left--;
-  }
-
-  if (G_UNLIKELY (g_atomic_int_get (&src->priv->has_pending_eos))) {
-    src->priv->forced_eos = TRUE;
-    goto eos;
-  }
-
-  GST_DEBUG_OBJECT (src,
-      "%s pad: calling create offset %" G_GUINT64_FORMAT " length %u, time %"
-      G_GINT64_FORMAT, padname, offset, length, src->vid_segment.time);
-
-  res_buf = in_buf = *buf;
-
-  ret = bclass->create (src, pad, offset, length, &res_buf);
-  if (G_UNLIKELY (ret != GST_FLOW_OK))
-    goto not_ok;
-
-  if (G_UNLIKELY (g_atomic_int_get (&src->priv->has_pending_eos))) {
-    src->priv->forced_eos = TRUE;
-    goto eos;
-  }
-
-  if (offset == 0 && src->vid_segment.time == 0
-      && (gint64)GST_BUFFER_DTS (res_buf) == -1 && !src->is_live) {
-    GST_DEBUG_OBJECT (src, "%s pad: setting first timestamp to 0", padname);
-    res_buf = gst_buffer_make_writable (res_buf);
-    GST_BUFFER_DTS (res_buf) = 0;
-  }
-
-  status = gst_cam_base_src_do_video_sync(src, res_buf);
-
-  if (G_UNLIKELY (src->priv->flushing))
-    goto flushing;
-
-  switch (status) {
-    case GST_CLOCK_UNSCHEDULED:
-      if (!src->live_running) {
-        ret = GST_FLOW_FLUSHING;
-      }
-      break;
-    case GST_CLOCK_EARLY:
-    case GST_CLOCK_OK:
-      break;
-    default:
-      ret = GST_FLOW_ERROR;
-      break;
-  }
-  if (G_LIKELY(ret == GST_FLOW_OK))
-    *buf = res_buf;
-
-  g_free (padname);
-
-  return ret;
-
-not_ok:
-  {
-    GST_DEBUG_OBJECT (src, "%s pad: create returned %d (%s)", padname,
-        ret, gst_flow_get_name (ret));
-    g_free (padname);
-    return ret;
-  }
-not_started:
-  {
-    GST_DEBUG_OBJECT (src, "%s pad: getrange but not started", padname);
-    g_free (padname);
-    return GST_FLOW_FLUSHING;
-  }
-reached_num_buffers:
-  {
-    GST_DEBUG_OBJECT (src, "%s pad: sent all buffers", padname);
-    g_free (padname);
-    return GST_FLOW_EOS;
-  }
-flushing:
-  {
-    GST_DEBUG_OBJECT (src, "%s pad: we are flushing", padname);
-    g_free (padname);
-    return GST_FLOW_FLUSHING;
-  }
-eos:
-  {
-    GST_DEBUG_OBJECT (src, "%s pad: we are EOS", padname);
-    g_free (padname);
     return GST_FLOW_EOS;
   }
 }
@@ -2689,28 +2594,27 @@ gst_cam_base_src_getrange (GstPad * pad, GstObject * parent, guint64 offset,
     guint length, GstBuffer ** buf)
 {
   GstCamBaseSrc *src;
+  GstCamBaseSrcPadState *state;
   GstFlowReturn res = GST_FLOW_OK;
 
   src = GST_CAM_BASE_SRC_CAST (parent);
+  state = GST_CAM_BASE_SRC_PAD_STATE (pad);
 
-  GST_LIVE_LOCK (src);
+  GST_PAD_LIVE_LOCK (src, state);
   if (G_UNLIKELY (src->priv->flushing))
     goto flushing;
 
-  if (pad == src->srcpad)
-    res = gst_cam_base_src_get_range (src, pad, offset, length, buf);
-  else if (pad == src->videopad)
-    res = gst_cam_base_src_video_get_range (src, pad, offset, length, buf);
+  res = gst_cam_base_src_get_range (src, state, offset, length, buf);
 
 done:
-  GST_LIVE_UNLOCK (src);
+  GST_PAD_LIVE_UNLOCK (src, state);
 
   return res;
 
   /* ERRORS */
 flushing:
   {
-    GST_DEBUG_OBJECT (src, "we are flushing");
+    GST_DEBUG_OBJECT (src, "%s pad: we are flushing", GST_PAD_NAME (pad));
     res = GST_FLOW_FLUSHING;
     goto done;
   }
@@ -2739,42 +2643,49 @@ start_failed:
   }
 }
 
+/* streaming task of a pad, each pad has its own task or the src pad runs
+ * the iterations of all the pads in multiplexed mode */
 static void
 gst_cam_base_src_loop (GstPad * pad)
 {
   GstCamBaseSrc *src;
+  GstCamBaseSrcClass *bclass;
+  GstCamBaseSrcPadState *state;
   GstBuffer *buf = NULL;
   GstFlowReturn ret;
   gint64 position;
-  gboolean eos;
+  gboolean eos, is_src;
   guint blocksize;
   GList *pending_events = NULL, *tmp;
-  gchar *padname = gst_pad_get_name(pad);
+  const gchar *padname = GST_PAD_NAME(pad);
 
   eos = FALSE;
 
   src = GST_CAM_BASE_SRC (GST_OBJECT_PARENT (pad));
+  bclass = GST_CAM_BASE_SRC_GET_CLASS (src);
+  state = GST_CAM_BASE_SRC_PAD_STATE (pad);
+  is_src = GST_IS_SRC_STATE (src, state);
 
   /* Just leave immediately if we're flushing */
-  GST_LIVE_LOCK (src);
+  GST_PAD_LIVE_LOCK (src, state);
   if (G_UNLIKELY (src->priv->flushing || GST_PAD_IS_FLUSHING (pad)))
     goto flushing;
-  GST_LIVE_UNLOCK (src);
+  GST_PAD_LIVE_UNLOCK (src, state);
 
-  gst_cam_base_src_send_stream_start (src);
+  gst_cam_base_src_send_stream_start (src, state);
 
   /* The stream-start event could've caused something to flush us */
-  GST_LIVE_LOCK (src);
+  GST_PAD_LIVE_LOCK (src, state);
   if (G_UNLIKELY (src->priv->flushing || GST_PAD_IS_FLUSHING (pad)))
     goto flushing;
-  GST_LIVE_UNLOCK (src);
+  GST_PAD_LIVE_UNLOCK (src, state);
 
   /* check if we need to renegotiate */
   if (gst_pad_check_reconfigure (pad)) {
     if (!gst_cam_base_src_negotiate (src, pad)) {
       gst_pad_mark_reconfigure (pad);
       if (GST_PAD_IS_FLUSHING (pad)) {
-        GST_LIVE_LOCK (src);
+        GST_PAD_LIVE_LOCK (src, state);
         goto flushing;
       } else {
         goto negotiate_failed;
@@ -2782,7 +2693,7 @@ gst_cam_base_src_loop (GstPad * pad)
     }
   }
 
-  GST_LIVE_LOCK (src);
+  GST_PAD_LIVE_LOCK (src, state);
 
   if (G_UNLIKELY (src->priv->flushing || GST_PAD_IS_FLUSHING (pad)))
     goto flushing;
@@ -2790,17 +2701,17 @@ gst_cam_base_src_loop (GstPad * pad)
   blocksize = src->blocksize;
 
   /* if we operate in bytes, we can calculate an offset */
-  if (src->segment.format == GST_FORMAT_BYTES) {
-    position = src->segment.position;
+  if (state->segment.format == GST_FORMAT_BYTES) {
+    position = state->segment.position;
     /* for negative rates, start with subtracting the blocksize */
-    if (src->segment.rate < 0.0) {
+    if (state->segment.rate < 0.0) {
       /* we cannot go below segment.start */
-      if (position > (gint64)(src->segment.start + blocksize))
+      if (position > (gint64)(state->segment.start + blocksize))
         position -= blocksize;
       else {
         /* last block, remainder up to segment.start */
-        blocksize = position - src->segment.start;
-        position = src->segment.start;
+        blocksize = position - state->segment.start;
+        position = state->segment.start;
       }
     }
   } else
@@ -2809,34 +2720,37 @@ gst_cam_base_src_loop (GstPad * pad)
   GST_LOG_OBJECT (src, "%s pad: next_ts %" GST_TIME_FORMAT " size %u",
       padname, GST_TIME_ARGS (position), blocksize);
 
-  ret = gst_cam_base_src_get_range (src, pad, position, blocksize, &buf);
+  ret = gst_cam_base_src_get_range (src, state, position, blocksize, &buf);
   if (G_UNLIKELY (ret != GST_FLOW_OK)) {
     GST_INFO_OBJECT (src, "%s pad: pausing after gst_cam_base_src_get_range() = %s",
         padname, gst_flow_get_name (ret));
-    GST_LIVE_UNLOCK (src);
+    GST_PAD_LIVE_UNLOCK (src, state);
     goto pause;
   }
   /* this should not happen */
   if (G_UNLIKELY (buf == NULL))
     goto null_buffer;
 
-  /* push events to close/start our segment before we push the buffer. */
-  if (G_UNLIKELY (src->priv->segment_pending)) {
-    GstEvent *seg_event = gst_event_new_segment (&src->segment);
+  /* seeks and events sent to the element are for the src pad */
+  if (is_src) {
+    /* push events to close/start our segment before we push the buffer. */
+    if (G_UNLIKELY (src->priv->segment_pending)) {
+      GstEvent *seg_event = gst_event_new_segment (&state->segment);
 
-    gst_event_set_seqnum (seg_event, src->priv->segment_seqnum);
-    src->priv->segment_seqnum = gst_util_seqnum_next ();
-    gst_pad_push_event (pad, seg_event);
-    src->priv->segment_pending = FALSE;
-  }
+      gst_event_set_seqnum (seg_event, src->priv->segment_seqnum);
+      src->priv->segment_seqnum = gst_util_seqnum_next ();
+      gst_pad_push_event (pad, seg_event);
+      src->priv->segment_pending = FALSE;
+    }
 
-  if (g_atomic_int_get (&src->priv->have_events)) {
-    GST_OBJECT_LOCK (src);
-    /* take the events */
-    pending_events = src->priv->pending_events;
-    src->priv->pending_events = NULL;
-    g_atomic_int_set (&src->priv->have_events, FALSE);
-    GST_OBJECT_UNLOCK (src);
+    if (g_atomic_int_get (&src->priv->have_events)) {
+      GST_OBJECT_LOCK (src);
+      /* take the events */
+      pending_events = src->priv->pending_events;
+      src->priv->pending_events = NULL;
+      g_atomic_int_set (&src->priv->have_events, FALSE);
+      GST_OBJECT_UNLOCK (src);
+    }
   }
 
   /* Push out pending events if any */
@@ -2849,13 +2763,13 @@ gst_cam_base_src_loop (GstPad * pad)
   }
 
   /* figure out the new position */
-  switch (src->segment.format) {
+  switch (state->segment.format) {
     case GST_FORMAT_BYTES:
     {
       guint bufsize = gst_buffer_get_size (buf);
 
       /* we subtracted above for negative rates */
-      if (src->segment.rate >= 0.0)
+      if (state->segment.rate >= 0.0)
         position += bufsize;
       break;
     }
@@ -2869,10 +2783,10 @@ gst_cam_base_src_loop (GstPad * pad)
       if (GST_CLOCK_TIME_IS_VALID (start))
         position = start;
       else
-        position = src->segment.position;
+        position = state->segment.position;
 
       if (GST_CLOCK_TIME_IS_VALID (duration)) {
-        if (src->segment.rate >= 0.0)
+        if (state->segment.rate >= 0.0)
           position += duration;
         else if (position > (gint64)duration)
           position -= duration;
@@ -2882,7 +2796,7 @@ gst_cam_base_src_loop (GstPad * pad)
       break;
     }
     case GST_FORMAT_DEFAULT:
-      if (src->segment.rate >= 0.0)
+      if (state->segment.rate >= 0.0)
         position = GST_BUFFER_OFFSET_END (buf);
       else
         position = GST_BUFFER_OFFSET (buf);
@@ -2892,38 +2806,44 @@ gst_cam_base_src_loop (GstPad * pad)
       break;
   }
   if (position != -1) {
-    if (src->segment.rate >= 0.0) {
+    if (state->segment.rate >= 0.0) {
       /* positive rate, check if we reached the stop */
-      if ((gint64)src->segment.stop != -1) {
-        if (position >= (gint64)src->segment.stop) {
+      if ((gint64)state->segment.stop != -1) {
+        if (position >= (gint64)state->segment.stop) {
           eos = TRUE;
-          position = src->segment.stop;
+          position = state->segment.stop;
         }
       }
     } else {
       /* negative rate, check if we reached the start. start is always set to
        * something different from -1 */
-      if (position <= (gint64)src->segment.start) {
+      if (position <= (gint64)state->segment.start) {
         eos = TRUE;
-        position = src->segment.start;
+        position = state->segment.start;
       }
       /* when going reverse, all buffers are DISCONT */
       src->priv->discont = TRUE;
     }
     GST_OBJECT_LOCK (src);
-    src->segment.position = position;
+    state->segment.position = position;
     GST_OBJECT_UNLOCK (src);
   }
 
-  if (G_UNLIKELY (src->priv->discont)) {
+  if (G_UNLIKELY (is_src && src->priv->discont)) {
     GST_INFO_OBJECT (src, "marking pending DISCONT");
     buf = gst_buffer_make_writable (buf);
     GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
     src->priv->discont = FALSE;
   }
-  GST_LIVE_UNLOCK (src);
+  GST_PAD_LIVE_UNLOCK (src, state);
 
-  ret = gst_pad_push (pad, buf);
+  if (bclass->pre_push)
+    bclass->pre_push (src, pad, buf);
+
+  {
+    GST_CAMERASRC_TRACE_SCOPE("push");
+    ret = gst_pad_push (pad, buf);
+  }
   if (G_UNLIKELY (ret != GST_FLOW_OK)) {
     if (ret == GST_FLOW_NOT_NEGOTIATED) {
       goto not_negotiated;
@@ -2941,8 +2861,14 @@ gst_cam_base_src_loop (GstPad * pad)
     goto pause;
   }
 
+  /* the video pads stop with the EOS of another pad */
+  if (G_UNLIKELY (!is_src && src->priv->receive_eos)) {
+    GST_INFO_OBJECT (src, "%s pad: pausing after EOS of another pad", padname);
+    ret = GST_FLOW_EOS;
+    goto pause;
+  }
+
 done:
-  g_free (padname);
   return;
 
   /* special cases */
@@ -2950,7 +2876,6 @@ not_negotiated:
   {
     if (gst_pad_needs_reconfigure (pad)) {
       GST_DEBUG_OBJECT (src, "%s pad: Retrying to renegotiate", padname);
-      g_free (padname);
       return;
     }
     /* fallthrough when push returns NOT_NEGOTIATED and we don't have
@@ -2965,7 +2890,7 @@ negotiate_failed:
 flushing:
   {
     GST_DEBUG_OBJECT (src, "%s pad: we are flushing", padname);
-    GST_LIVE_UNLOCK (src);
+    GST_PAD_LIVE_UNLOCK (src, state);
     ret = GST_FLOW_FLUSHING;
     goto pause;
   }
@@ -2976,15 +2901,15 @@ pause:
 
     GST_DEBUG_OBJECT (src, "%s pad: pausing task, reason %s", padname, reason);
     src->running = FALSE;
-    gst_pad_pause_task (pad);
+    gst_cam_base_src_pause_task (src, pad);
     if (ret == GST_FLOW_EOS) {
       gboolean flag_segment;
       GstFormat format;
       gint64 position;
 
-      flag_segment = (src->segment.flags & GST_SEGMENT_FLAG_SEGMENT) != 0;
-      format = src->segment.format;
-      position = src->segment.position;
+      flag_segment = (state->segment.flags & GST_SEGMENT_FLAG_SEGMENT) != 0;
+      format = state->segment.format;
+      position = state->segment.position;
 
       /* perform EOS logic */
       if (src->priv->forced_eos) {
@@ -3030,196 +2955,111 @@ null_buffer:
   {
     GST_ELEMENT_ERROR (src, STREAM, FAILED,
         ("%s pad: Internal data flow error in.", padname), ("element returned NULL buffer"));
-    GST_LIVE_UNLOCK (src);
+    GST_PAD_LIVE_UNLOCK (src, state);
     goto done;
   }
 }
 
-static void gst_cam_base_src_video_loop (GstPad * pad)
+/* start the task of the src pad, which serves all the pads in multiplexed mode */
+static gboolean
+gst_cam_base_src_start_task (GstCamBaseSrc * src)
 {
-  GstBuffer *buf = NULL;
-  gint64 position = 0;
-  GstFlowReturn ret = GST_FLOW_OK;
-  guint blocksize;
-  gchar *padname = gst_pad_get_name(pad);
-  GstCamBaseSrc *src = GST_CAM_BASE_SRC(GST_OBJECT_PARENT(pad));
-
-  /* Just leave immediately if we're flushing */
-  GST_VID_LIVE_LOCK (src);
-  if (G_UNLIKELY (src->priv->flushing || GST_PAD_IS_FLUSHING (pad)))
-    goto flushing;
-  GST_VID_LIVE_UNLOCK (src);
+  GstTaskFunction func = (GstTaskFunction) gst_cam_base_src_loop;
+  gboolean multiplex;
 
-  gst_cam_base_src_send_video_stream_start(src);
-
-  /* The stream-start event could've caused something to flush us */
-  GST_VID_LIVE_LOCK (src);
-  if (G_UNLIKELY (src->priv->flushing || GST_PAD_IS_FLUSHING (pad)))
-    goto flushing;
-  GST_VID_LIVE_UNLOCK (src);
+  GST_OBJECT_LOCK (src);
+  multiplex = src->priv->multiplex;
+  GST_OBJECT_UNLOCK (src);
 
-  /* check if we need to renegotiate */
-  if (gst_pad_check_reconfigure (pad)) {
-    if (!gst_cam_base_src_negotiate (src, pad)) {
-      gst_pad_mark_reconfigure (pad);
-      if (GST_PAD_IS_FLUSHING(pad)) {
-        GST_VID_LIVE_LOCK(src);
-        goto flushing;
-      } else {
-        goto negotiate_failed;
-      }
-    }
+  if (multiplex) {
+    g_atomic_int_set (&GST_CAM_BASE_SRC_PAD_STATE (src->srcpad)->mux_paused, FALSE);
+    func = (GstTaskFunction) gst_cam_base_src_mux_loop;
   }
 
-  GST_VID_LIVE_LOCK(src);
-
-  blocksize = src->blocksize;
+  return gst_pad_start_task (src->srcpad, func, src->srcpad, NULL);
+}
 
-  /* we only consider the scenario of GST_FORMAT_TIME */
-  if (src->vid_segment.format == GST_FORMAT_TIME)
-    position = -1;
+/* in multiplexed mode only the pad stops being served, the task keeps
+ * running for the other pads */
+static void
+gst_cam_base_src_pause_task (GstCamBaseSrc * src, GstPad * pad)
+{
+  gboolean multiplex;
 
-  GST_LOG_OBJECT (src, "%s pad: next_ts %" GST_TIME_FORMAT " size %u",
-      padname, GST_TIME_ARGS (position), blocksize);
+  GST_OBJECT_LOCK (src);
+  multiplex = src->priv->multiplex;
+  GST_OBJECT_UNLOCK (src);
 
-  ret = gst_cam_base_src_video_get_range (src, pad, position, blocksize, &buf);
-  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
-    GST_INFO_OBJECT (src, "%s pad: pausing after gst_cam_base_src_video_get_range() = %s",
-        padname, gst_flow_get_name (ret));
-    GST_VID_LIVE_UNLOCK (src);
-    goto pause;
-  }
+  if (multiplex)
+    g_atomic_int_set (&GST_CAM_BASE_SRC_PAD_STATE (pad)->mux_paused, TRUE);
+  else
+    gst_pad_pause_task (pad);
+}
 
-  if (G_UNLIKELY (buf == NULL))
-    goto null_buffer;
+/* with STREAM_LOCK of the src pad, taken by its task. Each iteration runs
+ * one iteration of the loop of the pad expected to be ready first, in
+ * turn when the subclass cannot tell. Pads are only removed with the
+ * STREAM_LOCK of the src pad so the states stay valid during the iteration */
+static void
+gst_cam_base_src_mux_loop (GstPad * pad)
+{
+  GstCamBaseSrc *src = GST_CAM_BASE_SRC (GST_OBJECT_PARENT (pad));
+  GstCamBaseSrcClass *bclass = GST_CAM_BASE_SRC_GET_CLASS (src);
+  GstCamBaseSrcPadState **states, *next = NULL;
+  GstClockTime next_time = GST_CLOCK_TIME_NONE;
+  guint n;
 
-  if (src->vid_segment.format == GST_FORMAT_TIME) {
-    GstClockTime start, duration;
-    start = GST_BUFFER_TIMESTAMP(buf);
-    duration = GST_BUFFER_DURATION(buf);
-    if (GST_CLOCK_TIME_IS_VALID (start))
-      position = start;
-
-    if (GST_CLOCK_TIME_IS_VALID (duration)) {
-      if (src->vid_segment.rate >= 0.0)
-        position += duration;
-      else if (position > (gint64)duration)
-        position -= duration;
-      else
-        position = 0;
-    }
-  }
+  GST_OBJECT_LOCK (src);
+  n = src->pads->len;
+  states = g_newa (GstCamBaseSrcPadState *, n);
+  for (guint i = 0; i < n; i++)
+    states[i] = (GstCamBaseSrcPadState *) g_ptr_array_index (src->pads,
+        (src->priv->mux_last + 1 + i) % n);
+  GST_OBJECT_UNLOCK (src);
 
-  GST_VID_LIVE_UNLOCK(src);
+  for (guint i = 0; i < n; i++) {
+    GstCamBaseSrcPadState *state = states[i];
+    GstClockTime time = 0;
 
-  ret = gst_pad_push(pad, buf);
-  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
-    if (ret == GST_FLOW_NOT_NEGOTIATED) {
-      goto not_negotiated;
+    if (!state || g_atomic_int_get (&state->mux_paused))
+      continue;
+    if (bclass->get_ready_time) {
+      time = bclass->get_ready_time (src, state->pad);
+      if (!GST_CLOCK_TIME_IS_VALID (time))
+        time = 0;
     }
-    GST_INFO_OBJECT (src, "%s pad: is pausing after gst_pad_push() = %s",
-        padname, gst_flow_get_name (ret));
-    goto pause;
-  }
-
-  if (src->priv->receive_eos) {
-    ret = GST_FLOW_EOS;
-    goto pause;
-  }
-
-done:
-  g_free (padname);
-  return;
-
-flushing:
-  {
-    GST_DEBUG_OBJECT(src, "%s pad: is flushing", padname);
-    GST_VID_LIVE_UNLOCK(src);
-    ret = GST_FLOW_FLUSHING;
-    goto pause;
-  }
-not_negotiated:
-  {
-    if (gst_pad_needs_reconfigure(pad)) {
-      GST_DEBUG_OBJECT(src, "%s pad: Retry to renegotiate", padname);
-      goto done;
+    if (!next || time < next_time) {
+      next = state;
+      next_time = time;
     }
   }
-negotiate_failed:
-  {
-    GST_DEBUG_OBJECT(src, "%s pad: not negotiated", padname);
-    goto pause;
-  }
-pause:
-  {
-    const gchar *reason = gst_flow_get_name(ret);
-    GstEvent *event;
 
-    GST_DEBUG_OBJECT (src, "%s pad: pausing task, reason %s", padname, reason);
-    src->running = FALSE;
+  if (!next) {
+    GST_DEBUG_OBJECT (src, "all pads paused, pausing task");
     gst_pad_pause_task (pad);
-    if (ret == GST_FLOW_EOS) {
-      gboolean flag_segment;
-      GstFormat format;
-      gint64 position;
-
-      flag_segment = (src->vid_segment.flags & GST_SEGMENT_FLAG_SEGMENT) != 0;
-      format = src->vid_segment.format;
-      position = src->vid_segment.position;
-
-      /* perform EOS logic */
-      if (src->priv->forced_eos) {
-        g_assert (g_atomic_int_get (&src->priv->has_pending_eos));
-        GST_OBJECT_LOCK (src);
-        event = src->priv->pending_eos;
-        src->priv->pending_eos = NULL;
-        GST_OBJECT_UNLOCK (src);
-      } else if (flag_segment) {
-        GstMessage *message;
-
-        message = gst_message_new_segment_done (GST_OBJECT_CAST (src),
-            format, position);
-        gst_message_set_seqnum (message, src->priv->seqnum);
-        gst_element_post_message (GST_ELEMENT_CAST (src), message);
-        event = gst_event_new_segment_done (format, position);
-        gst_event_set_seqnum (event, src->priv->seqnum);
-      } else {
-        event = gst_event_new_eos();
-        gst_event_set_seqnum (event, src->priv->seqnum);
-        src->priv->receive_eos = TRUE;
-      }
-      gst_pad_push_event (pad, event);
-      src->priv->forced_eos = FALSE;
-    } else if (ret == GST_FLOW_NOT_LINKED || ret <= GST_FLOW_EOS) {
-      event = gst_event_new_eos();
-      gst_event_set_seqnum(event, src->priv->seqnum);
-      GST_ELEMENT_ERROR (src, STREAM, FAILED,
-        ("%s pad: Internal data flow error.", padname),
-        ("streaming task paused, reason %s (%d)",
-        reason, ret));
-        gst_pad_push_event (pad, event);
-    }
-
-    goto done;
+    return;
   }
-null_buffer:
-  {
-    GST_ELEMENT_ERROR(src, STREAM, FAILED,
-      ("%s pad: Internal data flow error.", padname),
-      ("element return NULL buffer"));
-    GST_VID_LIVE_UNLOCK(src);
 
-    goto done;
+  src->priv->mux_last = next->index;
+  if (next->pad == pad) {
+    gst_cam_base_src_loop (pad);
+    return;
   }
+
+  GST_PAD_STREAM_LOCK (next->pad);
+  /* the pad may have been deactivated while taking its lock */
+  if (!g_atomic_int_get (&next->mux_paused))
+    gst_cam_base_src_loop (next->pad);
+  GST_PAD_STREAM_UNLOCK (next->pad);
 }
 
 static gboolean
 gst_cam_base_src_set_allocation (GstCamBaseSrc * basesrc, GstPad *pad,
     GstBufferPool * pool, GstAllocator * allocator, GstAllocationParams * params)
 {
+  GstCamBaseSrcPadState *state = GST_CAM_BASE_SRC_PAD_STATE (pad);
   GstAllocator *oldalloc = NULL;
   GstBufferPool *oldpool = NULL;
-  GstCamBaseSrcPrivate *priv = basesrc->priv;
 
   if (pool) {
     GST_DEBUG_OBJECT (basesrc, "activate pool %p", pool);
@@ -3229,35 +3069,19 @@ gst_cam_base_src_set_allocation (GstCamBaseSrc * basesrc, GstPad *pad,
 
   GST_OBJECT_LOCK (basesrc);
 
-  if (pad == basesrc->srcpad) {
-    oldalloc = priv->allocator;
-    oldpool = priv->pool;
-    priv->allocator = allocator;
-    priv->pool = pool;
-
-    if (priv->pool)
-      gst_object_ref (priv->pool);
-    if (priv->allocator)
-      gst_object_ref(priv->allocator);
-    if (params)
-       priv->params = *params;
-    else
-       gst_allocation_params_init(&priv->params);
-  } else if (pad == basesrc->videopad) {
-    oldalloc = priv->vid_allocator;
-    oldpool = priv->vid_pool;
-    priv->vid_allocator = allocator;
-    priv->vid_pool = pool;
-
-    if (priv->vid_pool)
-      gst_object_ref(priv->vid_pool);
-    if (priv->vid_allocator)
-      gst_object_ref(priv->vid_allocator);
-    if (params)
-      priv->vid_params = *params;
-    else
-      gst_allocation_params_init(&priv->vid_params);
-  }
+  oldalloc = state->allocator;
+  oldpool = state->pool;
+  state->allocator = allocator;
+  state->pool = pool;
+
+  if (state->pool)
+    gst_object_ref (state->pool);
+  if (state->allocator)
+    gst_object_ref (state->allocator);
+  if (params)
+    state->params = *params;
+  else
+    gst_allocation_params_init (&state->params);
 
   GST_OBJECT_UNLOCK (basesrc);
 
@@ -3284,14 +3108,14 @@ activate_failed:
 }
 
 static gboolean
-gst_cam_base_src_activate_pool (GstCamBaseSrc * basesrc, gboolean active)
+gst_cam_base_src_activate_pool (GstCamBaseSrc * basesrc,
+    GstCamBaseSrcPadState * state, gboolean active)
 {
-  GstCamBaseSrcPrivate *priv = basesrc->priv;
   GstBufferPool *pool;
   gboolean res = TRUE;
 
   GST_OBJECT_LOCK (basesrc);
-  if ((pool = priv->pool))
+  if ((pool = state->pool))
     pool = (GstBufferPool*)gst_object_ref (pool);
   GST_OBJECT_UNLOCK (basesrc);
 
@@ -3303,21 +3127,25 @@ gst_cam_base_src_activate_pool (GstCamBaseSrc * basesrc, gboolean active)
 }
 
 static gboolean
-gst_cam_base_src_activate_video_pool (GstCamBaseSrc * basesrc, gboolean active)
+gst_cam_base_src_activate_pools (GstCamBaseSrc * basesrc, gboolean active)
 {
-  GstCamBaseSrcPrivate *priv = basesrc->priv;
-  GstBufferPool *pool;
+  GstCamBaseSrcPadState *state;
+  GPtrArray *pools;
   gboolean res = TRUE;
 
+  /* collect the pools first, activation must not happen with the object lock */
+  pools = g_ptr_array_new_with_free_func (gst_object_unref);
   GST_OBJECT_LOCK (basesrc);
-  if ((pool = priv->vid_pool))
-    pool = (GstBufferPool*)gst_object_ref (pool);
+  GST_CAM_BASE_SRC_FOREACH_PAD (basesrc, state) {
+    if (state->pool)
+      g_ptr_array_add (pools, gst_object_ref (state->pool));
+  }
   GST_OBJECT_UNLOCK (basesrc);
 
-  if (pool) {
-    res = gst_buffer_pool_set_active (pool, active);
-    gst_object_unref (pool);
-  }
+  for (guint i = 0; i < pools->len; i++)
+    res &= gst_buffer_pool_set_active ((GstBufferPool *) g_ptr_array_index (pools, i), active);
+
+  g_ptr_array_unref (pools);
   return res;
 }
 
@@ -3588,6 +3416,7 @@ static gboolean
 gst_cam_base_src_start (GstCamBaseSrc * basesrc)
 {
   GstCamBaseSrcClass *bclass;
+  GstCamBaseSrcPadState *state;
   gboolean result;
 
   GST_LIVE_LOCK (basesrc);
@@ -3600,12 +3429,12 @@ gst_cam_base_src_start (GstCamBaseSrc * basesrc)
 
   basesrc->priv->start_result = GST_FLOW_FLUSHING;
   GST_OBJECT_FLAG_SET (basesrc, GST_CAM_BASE_SRC_FLAG_STARTING);
-  gst_segment_init (&basesrc->segment, basesrc->segment.format);
+  GST_CAM_BASE_SRC_FOREACH_PAD (basesrc, state)
+    gst_segment_init (&state->segment, state->segment.format);
   GST_OBJECT_UNLOCK (basesrc);
 
-  basesrc->num_buffers_left = basesrc->num_buffers;
-  if (basesrc->videopad)
-    basesrc->num_video_buffers_left = basesrc->num_buffers;
+  GST_CAM_BASE_SRC_FOREACH_PAD (basesrc, state)
+    state->num_buffers_left = basesrc->num_buffers;
   basesrc->running = FALSE;
   basesrc->priv->segment_pending = FALSE;
   basesrc->priv->segment_seqnum = gst_util_seqnum_next ();
@@ -3670,6 +3499,7 @@ gst_cam_base_src_start_complete (GstCamBaseSrc * basesrc, GstFlowReturn ret)
   gboolean have_size;
   guint64 size;
   gboolean seekable;
+  GstSegment *segment;
   GstFormat format;
   GstPadMode mode;
   GstEvent *event;
@@ -3678,7 +3508,8 @@ gst_cam_base_src_start_complete (GstCamBaseSrc * basesrc, GstFlowReturn ret)
     goto error;
 
   GST_DEBUG_OBJECT (basesrc, "starting source");
-  format = basesrc->segment.format;
+  segment = &GST_CAM_BASE_SRC_SRC_STATE (basesrc)->segment;
+  format = segment->format;
 
   /* figure out the size */
   have_size = FALSE;
@@ -3694,14 +3525,14 @@ gst_cam_base_src_start_complete (GstCamBaseSrc * basesrc, GstFlowReturn ret)
     /* only update the size when operating in bytes, subclass is supposed
      * to set duration in the start method for other formats */
     GST_OBJECT_LOCK (basesrc);
-    basesrc->segment.duration = size;
+    segment->duration = size;
     GST_OBJECT_UNLOCK (basesrc);
   }
 
   GST_DEBUG_OBJECT (basesrc,
       "format: %s, have size: %d, size: %" G_GUINT64_FORMAT ", duration: %"
       G_GINT64_FORMAT, gst_format_get_name (format), have_size, size,
-      basesrc->segment.duration);
+      segment->duration);
 
   seekable = gst_cam_base_src_seekable (basesrc);
   GST_DEBUG_OBJECT (basesrc, "is seekable: %d", seekable);
@@ -3828,6 +3659,7 @@ static gboolean
 gst_cam_base_src_stop (GstCamBaseSrc * basesrc)
 {
   GstCamBaseSrcClass *bclass;
+  GstCamBaseSrcPadState *state;
   gboolean result = TRUE;
 
   GST_DEBUG_OBJECT (basesrc, "stopping source");
@@ -3836,8 +3668,8 @@ gst_cam_base_src_stop (GstCamBaseSrc * basesrc)
   gst_cam_base_src_set_flushing (basesrc, TRUE, FALSE, NULL);
   /* stop the task */
   gst_pad_stop_task (basesrc->srcpad);
-  if (basesrc->videopad)
-    gst_pad_stop_task(basesrc->videopad);
+  GST_CAM_BASE_SRC_FOREACH_VIDEO_PAD (basesrc, state)
+    gst_pad_stop_task(state->pad);
 
   GST_OBJECT_LOCK (basesrc);
   if (!GST_CAM_BASE_SRC_IS_STARTED (basesrc) && !GST_CAM_BASE_SRC_IS_STARTING (basesrc))
@@ -3856,9 +3688,8 @@ gst_cam_base_src_stop (GstCamBaseSrc * basesrc)
 
   basesrc->live_running = FALSE;
 
-  gst_cam_base_src_set_allocation (basesrc, basesrc->srcpad, NULL, NULL, NULL);
-  if (basesrc->videopad)
-    gst_cam_base_src_set_allocation (basesrc, basesrc->videopad, NULL, NULL, NULL);
+  GST_CAM_BASE_SRC_FOREACH_PAD (basesrc, state)
+    gst_cam_base_src_set_allocation (basesrc, state->pad, NULL, NULL, NULL);
 
   return result;
 
@@ -3883,9 +3714,7 @@ gst_cam_base_src_set_flushing (GstCamBaseSrc * basesrc,
   GST_DEBUG_OBJECT (basesrc, "flushing %d, live_play %d", flushing, live_play);
 
   if (flushing) {
-    gst_cam_base_src_activate_pool (basesrc, FALSE);
-    if (basesrc->videopad)
-      gst_cam_base_src_activate_video_pool(basesrc, FALSE);
+    gst_cam_base_src_activate_pools (basesrc, FALSE);
     /* unlock any subclasses, we need to do this before grabbing the
      * LIVE_LOCK since we hold this lock before going into ::create. We pass an
      * unlock to the params because of backwards compat (see seek handler)*/
@@ -3922,9 +3751,7 @@ gst_cam_base_src_set_flushing (GstCamBaseSrc * basesrc,
     /* signal the live source that it can start playing */
     basesrc->live_running = live_play;
 
-    gst_cam_base_src_activate_pool (basesrc, TRUE);
-    if (basesrc->videopad)
-      gst_cam_base_src_activate_video_pool(basesrc, TRUE);
+    gst_cam_base_src_activate_pools (basesrc, TRUE);
 
     /* Drop all delayed events */
     GST_OBJECT_LOCK (basesrc);
@@ -3949,6 +3776,7 @@ static gboolean
 gst_cam_base_src_set_playing (GstCamBaseSrc * basesrc, gboolean live_play)
 {
   GstCamBaseSrcClass *bclass;
+  GstCamBaseSrcPadState *state;
 
   bclass = GST_CAM_BASE_SRC_GET_CLASS (basesrc);
 
@@ -3982,15 +3810,17 @@ gst_cam_base_src_set_playing (GstCamBaseSrc * basesrc, gboolean live_play)
       bclass->unlock_stop (basesrc);
 
     /* for live sources we restart the timestamp correction */
-    basesrc->priv->latency = -1;
+    GST_OBJECT_LOCK (basesrc);
+    GST_CAM_BASE_SRC_FOREACH_PAD (basesrc, state)
+      state->latency = -1;
+    GST_OBJECT_UNLOCK (basesrc);
     /* have to restart the task in case it stopped because of the unlock when
      * we went to PAUSED. Only do this if we operating in push mode. */
     GST_OBJECT_LOCK (basesrc->srcpad);
     start = (GST_PAD_MODE (basesrc->srcpad) == GST_PAD_MODE_PUSH);
     GST_OBJECT_UNLOCK (basesrc->srcpad);
     if (start)
-      gst_pad_start_task (basesrc->srcpad, (GstTaskFunction) gst_cam_base_src_loop,
-          basesrc->srcpad, NULL);
+      gst_cam_base_src_start_task (basesrc);
     GST_DEBUG_OBJECT (basesrc, "signal");
     GST_LIVE_SIGNAL (basesrc);
   }
@@ -4043,35 +3873,44 @@ error_stop:
 static gboolean gst_cam_base_src_video_activate_push (GstPad * pad, GstObject * parent, gboolean active)
 {
   GstCamBaseSrc *basesrc = GST_CAM_BASE_SRC(parent);
+  GstCamBaseSrcPadState *state = GST_CAM_BASE_SRC_PAD_STATE(pad);
   GstFlowReturn ret = GST_FLOW_OK;
   gboolean res = TRUE;
 
   if (active) {
-    GST_DEBUG_OBJECT(basesrc, "Activating video pad in push mode.");
+    GST_DEBUG_OBJECT(basesrc, "Activating %s pad in push mode.", GST_PAD_NAME(pad));
     GST_OBJECT_LOCK(basesrc);
-    GstPadMode mode = GST_PAD_MODE(basesrc->videopad);
+    GstPadMode mode = GST_PAD_MODE(pad);
+    gboolean multiplex = basesrc->priv->multiplex;
     GST_OBJECT_UNLOCK(basesrc);
 
-    GST_PAD_STREAM_LOCK(basesrc->videopad);
+    GST_PAD_STREAM_LOCK(pad);
     switch (mode) {
       case GST_PAD_MODE_PUSH:
-        res = gst_pad_start_task(basesrc->videopad, (GstTaskFunction)gst_cam_base_src_video_loop,
-            basesrc->videopad, NULL);
+        /* in multiplexed mode the task of the src pad pushes for us */
+        if (multiplex)
+          g_atomic_int_set(&state->mux_paused, FALSE);
+        else
+          res = gst_pad_start_task(pad, (GstTaskFunction)gst_cam_base_src_loop,
+              pad, NULL);
         break;
       default:
         goto not_activated_yet;
         break;
     }
-    GST_PAD_STREAM_UNLOCK(basesrc->videopad);
+    GST_PAD_STREAM_UNLOCK(pad);
   } else {
-    res = gst_pad_stop_task(basesrc->videopad);
+    /* stops the multiplexed task from serving the pad, stopping a pad
+     * without task waits for the iteration holding its STREAM_LOCK */
+    g_atomic_int_set(&state->mux_paused, TRUE);
+    res = gst_pad_stop_task(pad);
   }
 
   return res;
 
 not_activated_yet:
   {
-    GST_PAD_STREAM_UNLOCK (basesrc->videopad);
+    GST_PAD_STREAM_UNLOCK (pad);
     gst_cam_base_src_stop (basesrc);
     GST_WARNING_OBJECT (basesrc, "video pad not activated yet");
     ret = GST_FLOW_ERROR;
@@ -4154,13 +3993,11 @@ gst_cam_base_src_activate_mode (GstPad * pad, GstObject * parent,
         break;
         break;
       case GST_PAD_MODE_PUSH:
-        if (pad == src->srcpad) {
-          src->priv->stream_start_pending = active;
+        GST_CAM_BASE_SRC_PAD_STATE (pad)->stream_start_pending = active;
+        if (pad == src->srcpad)
           res = gst_cam_base_src_activate_push (pad, parent, active);
-        } else if (pad == src->videopad) {
-          src->priv->vid_stream_start_pending = active;
+        else
           res = gst_cam_base_src_video_activate_push (pad, parent, active);
-        }
         break;
       default:
         GST_WARNING ("unknown activation mode %s", gst_pad_mode_get_name(mode));
@@ -4258,8 +4095,8 @@ gst_cam_base_src_get_buffer_pool (GstCamBaseSrc * src)
 {
   g_return_val_if_fail (GST_IS_CAM_BASE_SRC (src), NULL);
 
-  if (src->priv->pool)
-    return (GstBufferPool *)gst_object_ref (src->priv->pool);
+  if (GST_CAM_BASE_SRC_SRC_STATE (src)->pool)
+    return (GstBufferPool *)gst_object_ref (GST_CAM_BASE_SRC_SRC_STATE (src)->pool);
 
   return NULL;
 }
@@ -4284,9 +4121,9 @@ gst_cam_base_src_get_allocator (GstCamBaseSrc * src,
   g_return_if_fail (GST_IS_CAM_BASE_SRC (src));
 
   if (allocator)
-    *allocator = src->priv->allocator ?
-        (GstAllocator *)gst_object_ref (src->priv->allocator) : NULL;
+    *allocator = GST_CAM_BASE_SRC_SRC_STATE (src)->allocator ?
+        (GstAllocator *)gst_object_ref (GST_CAM_BASE_SRC_SRC_STATE (src)->allocator) : NULL;
 
   if (params)
-    *params = src->priv->params;
+    *params = GST_CAM_BASE_SRC_SRC_STATE (src)->params;
 }
@@ -45,6 +45,7 @@
 #define __GST_CAM_BASE_SRC_H__
 
 #include <gst/gst.h>
+#include "gstcameralock.h"
 
 G_BEGIN_DECLS
 
@@ -78,6 +79,7 @@ typedef enum {
 #define DEFAULT_NUM_BUFFERS    -1
 #define DEFAULT_TYPEFIND FALSE
 #define DEFAULT_DO_TIMESTAMP FALSE
+#define DEFAULT_MULTIPLEX FALSE
 
 /**
  * GST_CAM_BASE_SRC_PAD:
@@ -87,38 +89,93 @@ typedef enum {
  */
 #define GST_CAM_BASE_SRC_PAD(obj)                 (GST_CAM_BASE_SRC_CAST (obj)->srcpad)
 /**
- * GST_CAM_BASE_VIDEO_PAD:
- * @obj: video source instance
+ * GST_CAM_BASE_SRC_PAD_STATE:
+ * @pad: a pad of a base source
  *
- * Gives the pointer to the #GstPad object of the element.
+ * Gives the #GstCamBaseSrcPadState of a pad of the element.
+ */
+#define GST_CAM_BASE_SRC_PAD_STATE(pad)  ((GstCamBaseSrcPadState *) GST_PAD_ELEMENT_PRIVATE (pad))
+/**
+ * GST_CAM_BASE_SRC_PAD_INDEX:
+ * @pad: a pad of a base source
+ *
+ * Gives the index of a pad of the element, 0 for the src pad.
  */
-#define GST_CAM_BASE_VIDEO_PAD(obj)                 (GST_CAM_BASE_SRC_CAST (obj)->videopad)
+#define GST_CAM_BASE_SRC_PAD_INDEX(pad)  (GST_CAM_BASE_SRC_PAD_STATE (pad)->index)
 
-/* Srcpads for Multi-stream feature, enable 'src' by default */
+/* Srcpads for Multi-stream feature, enable 'src' by default, any number of
+ * video pads can be requested, "video" is kept for existing pipelines */
 #define GST_CAM_BASE_SRC_PAD_NAME  "src"
-#define GST_CAM_BASE_VIDEO_PAD_NAME  "video" //for multi-stream
+#define GST_CAM_BASE_VIDEO_PAD_NAME  "video"
+#define GST_CAM_BASE_VIDEO_PAD_TEMPLATE  "video_%u"
 
 typedef struct _GstCamBaseSrc GstCamBaseSrc;
 typedef struct _GstCamBaseSrcClass GstCamBaseSrcClass;
 typedef struct _GstCamBaseSrcPrivate GstCamBaseSrcPrivate;
+typedef struct _GstCamBaseSrcPadState GstCamBaseSrcPadState;
+
+/**
+ * GstCamBaseSrcPadState:
+ * @pad: the pad
+ * @index: 0 for the src pad, request pads take the next index from 1, the
+ *   indexes stay contiguous when pads are released
+ *
+ * State of each pad, kept in the element private data of the pad. The src
+ * pad has its state at index 0 like the request video pads, only its live
+ * lock is the one of #GstCamBaseSrc, which the request video pads leave to
+ * the src pad.
+ */
+struct _GstCamBaseSrcPadState {
+  GstPad        *pad;
+  guint          index;
+
+  /* live lock of the request video pads */
+  GMutex         live_lock;
+  GstLockStats   live_lock_stats;
+
+  /* MT-protected (with STREAM_LOCK *and* OBJECT_LOCK) */
+  GstSegment     segment;
+  /* MT-protected (with STREAM_LOCK) */
+  gint           num_buffers_left;
+  gboolean       stream_start_pending;
+
+  /* startup latency is the time it takes between going to PLAYING and producing
+   * the first BUFFER with running_time 0. This value is included in the latency
+   * reporting. */
+  GstClockTime   latency;
+  /* timestamp offset, this is the offset add to the values of gst_times for
+   * pseudo live sources */
+  GstClockTimeDiff ts_offset;
+
+  /* multiplexed mode: the pad is not served by the task of the src pad (atomic) */
+  gint           mux_paused;
+
+  /* buffer pool params, MT-protected (with OBJECT_LOCK) */
+  GstBufferPool *pool;
+  GstAllocator  *allocator;
+  GstAllocationParams params;
+};
 
 struct _GstCamBaseSrc {
   GstElement element;
 
     /*< protected >*/
   GstPad        *srcpad;
-  GstPad        *videopad; //video src pad, for multi-stream
+
+  /* GstCamBaseSrcPadState of the pads by index, the pads after a released
+   * request pad move down one index */
+  GPtrArray     *pads;
+  /* format of the segment of the video pads */
+  GstFormat      video_format;
 
   /* available to subclass implementations */
   /* MT-protected (with LIVE_LOCK) */
   GMutex         live_lock;
   GCond          live_cond;
+  GstLockStats   live_lock_stats;
   gboolean       is_live;
   gboolean       live_running;
 
-  /* only valid when video pad is enabled */
-  GMutex         vid_live_lock;
-
   /* MT-protected (with LOCK) */
   guint          blocksize;     /* size of buffers when operating push based */
   gboolean       can_activate_push;     /* some scheduling properties */
@@ -126,15 +183,10 @@ struct _GstCamBaseSrc {
 
   GstClockID     clock_id;      /* for syncing */
 
-  /* MT-protected (with STREAM_LOCK *and* OBJECT_LOCK) */
-  GstSegment     segment;
-  GstSegment     vid_segment;
   /* MT-protected (with STREAM_LOCK) */
   gboolean       need_newsegment;
 
   gint           num_buffers;
-  gint           num_buffers_left;
-  gint           num_video_buffers_left;
 
   gboolean       typefind;
   gboolean       running;
@@ -182,7 +234,7 @@ struct _GstCamBaseSrc {
  * @unlock_stop: Clear the previous unlock request. Subclasses should clear any
  *    state they set during #GstCamBaseSrcClass.unlock(), such as clearing command
  *    queues.
- * @query: Handle a requested query.
+ * @query: Handle a query on @pad.
  * @event: Override this to implement custom event handling.
  * @create: Ask the subclass to create a buffer with offset and size.  When the
  *   subclass returns GST_FLOW_OK, it MUST return a buffer of the requested size
@@ -195,8 +247,17 @@ struct _GstCamBaseSrc {
  *   default implementation will create a new buffer from the negotiated allocator.
  * @fill: Ask the subclass to fill the buffer with data for offset and size. The
  *   passed buffer is guaranteed to hold the requested amount of bytes.
- * @add_video_pad: Add video pad by request, this interface should be called
- *   from subclass
+ * @add_video_pad: Add a video pad by request from @templ at the next index,
+ *   named @name or video_%u with the lowest number free, this interface should
+ *   be called from subclass
+ * @remove_video_pad: Deactivate and remove a video pad added by @add_video_pad,
+ *   the pads after it move down one index so that the indexes stay contiguous
+ * @get_ready_time: In multiplexed mode, give the CLOCK_MONOTONIC time at which
+ *   the next buffer of @pad is expected, or GST_CLOCK_TIME_NONE if unknown.
+ *   The pad expected first is served next.
+ * @pre_push: Called from the streaming thread of @pad with the buffer about
+ *   to be pushed on it, once the base class is done with it. The buffer must
+ *   not be modified, a reference can be kept.
  *
  * Subclasses can override any of the available virtual methods or not, as
  * needed. At the minimum, the @create method should be overridden to produce
@@ -255,7 +316,7 @@ struct _GstCamBaseSrcClass {
   gboolean      (*unlock_stop)  (GstCamBaseSrc *src);
 
   /* notify subclasses of a query */
-  gboolean      (*query)        (GstCamBaseSrc *src, GstQuery *query);
+  gboolean      (*query)        (GstCamBaseSrc *src, GstPad *pad, GstQuery *query);
 
   /* notify subclasses of an event */
   gboolean      (*event)        (GstCamBaseSrc *src, GstEvent *event);
@@ -275,7 +336,13 @@ struct _GstCamBaseSrcClass {
                                  GstBuffer *buf);
 
   /* need to add video pad in the element */
-  GstPad *     (*add_video_pad)         (GstCamBaseSrc *src, GstCamBaseSrcClass *klass);
+  GstPad *     (*add_video_pad)         (GstCamBaseSrc *src, GstPadTemplate *templ,
+                                         const gchar *name);
+  void         (*remove_video_pad)      (GstCamBaseSrc *src, GstPad *pad);
+
+  GstClockTime (*get_ready_time)        (GstCamBaseSrc *src, GstPad *pad);
+
+  void         (*pre_push)              (GstCamBaseSrc *src, GstPad *pad, GstBuffer *buf);
 
   /*< private >*/
   gpointer       _gst_reserved[GST_PADDING_LARGE];
@@ -288,12 +355,6 @@ struct _GstCamBaseSrcPrivate {
   GstFlowReturn start_result;
   gboolean async;
 
-  /* if a stream-start event should be sent */
-  gboolean stream_start_pending;
-
-  /* if video stream should be started */
-  gboolean vid_stream_start_pending;
-
   /* if segment should be sent and a
    * seqnum if it was originated by a seek */
   gboolean segment_pending;
@@ -309,17 +370,11 @@ struct _GstCamBaseSrcPrivate {
   /* if the src pad got EOS, request pads should also stop immediately */
   gboolean receive_eos;
 
-  /* startup latency is the time it takes between going to PLAYING and producing
-   * the first BUFFER with running_time 0. This value is included in the latency
-   * reporting. */
-  GstClockTime latency;
-  GstClockTime vid_latency;
-  /* timestamp offset, this is the offset add to the values of gst_times for
-   * pseudo live sources */
-  GstClockTimeDiff ts_offset;
-  GstClockTimeDiff vid_ts_offset;
-
   gboolean do_timestamp;
+  /* one task on the src pad pushes on all the pads, MT-protected (with LOCK) */
+  gboolean multiplex;
+  /* index of the pad served last by the multiplexed task (with STREAM_LOCK) */
+  guint mux_last;
   volatile gint dynamic_size;
   volatile gint automatic_eos;
 
@@ -336,16 +391,6 @@ struct _GstCamBaseSrcPrivate {
   gdouble proportion;
   GstClockTime earliest_time;
 
-  /* buffer pool params of src pad */
-  GstBufferPool *pool;
-  GstAllocator *allocator;
-  GstAllocationParams params;
-
-  /* buffer pool params of video pad */
-  GstBufferPool *vid_pool;
-  GstAllocator *vid_allocator;
-  GstAllocationParams vid_params;
-
   GCond async_cond;
 };
 
@@ -382,6 +427,10 @@ void gst_cam_base_src_set_do_timestamp (GstCamBaseSrc *src, gboolean timestamp);
 
 gboolean gst_cam_base_src_get_do_timestamp (GstCamBaseSrc *src);
 
+void gst_cam_base_src_set_multiplex (GstCamBaseSrc *src, gboolean multiplex);
+
+gboolean gst_cam_base_src_get_multiplex (GstCamBaseSrc *src);
+
 //new_seamless_segment
 
 gboolean gst_cam_base_src_set_caps (GstCamBaseSrc * src, GstCaps * caps);
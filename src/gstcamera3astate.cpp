@@ -0,0 +1,299 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCamera3AState"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#include "ICamera.h"
+#include "ScopedAtrace.h"
+#include "gstcameratrace.h"
+
+#include "gstcamerasrc.h"
+#include "gstcamera3astate.h"
+
+using namespace icamera;
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+#define GST_CAMERASRC_3A_STATE_GROUP "3a"
+
+static gchar *
+gst_camerasrc_3a_state_get_path(Gstcamerasrc *camerasrc)
+{
+  gchar *file_name = g_strdup_printf("icamerasrc-3a-%d.state", camerasrc->device_id);
+  gchar *path = g_build_filename(camerasrc->state_dir, file_name, NULL);
+
+  g_free(file_name);
+  return path;
+}
+
+static gboolean
+gst_camerasrc_3a_state_load(Gstcamerasrc *camerasrc, Gst3AState *state)
+{
+  GKeyFile *key_file = g_key_file_new();
+  gchar *path = gst_camerasrc_3a_state_get_path(camerasrc);
+  GError *error = NULL;
+  gboolean ret = FALSE;
+
+  if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error)) {
+    GST_INFO("CameraId=%d no 3A state restored from %s: %s.",
+      camerasrc->device_id, path, error->message);
+    goto out;
+  }
+
+  state->exposure_time = g_key_file_get_int64(key_file,
+      GST_CAMERASRC_3A_STATE_GROUP, "exposure-time", &error);
+  if (!error)
+    state->gain = (float)g_key_file_get_double(key_file,
+        GST_CAMERASRC_3A_STATE_GROUP, "gain", &error);
+  if (!error)
+    state->awb_gains.r_gain = g_key_file_get_integer(key_file,
+        GST_CAMERASRC_3A_STATE_GROUP, "awb-gain-r", &error);
+  if (!error)
+    state->awb_gains.g_gain = g_key_file_get_integer(key_file,
+        GST_CAMERASRC_3A_STATE_GROUP, "awb-gain-g", &error);
+  if (!error)
+    state->awb_gains.b_gain = g_key_file_get_integer(key_file,
+        GST_CAMERASRC_3A_STATE_GROUP, "awb-gain-b", &error);
+
+  if (error) {
+    GST_WARNING("CameraId=%d invalid 3A state in %s: %s.",
+      camerasrc->device_id, path, error->message);
+    goto out;
+  }
+
+  if (state->exposure_time <= 0) {
+    GST_WARNING("CameraId=%d invalid exposure time %ld in %s.",
+      camerasrc->device_id, (long)state->exposure_time, path);
+    goto out;
+  }
+
+  state->valid = TRUE;
+  ret = TRUE;
+
+out:
+  if (error)
+    g_error_free(error);
+  g_free(path);
+  g_key_file_free(key_file);
+
+  return ret;
+}
+
+/* Hand exposure and white balance back to the auto algorithms,
+ * they carry on converging from the seeded values. The object lock keeps
+ * set_property from changing the same settings meanwhile */
+static void
+gst_camerasrc_3a_state_release_seed(Gstcamerasrc *camerasrc)
+{
+  camera_awb_gains_t awb_gains;
+
+  GST_OBJECT_LOCK(camerasrc);
+  awb_gains.r_gain = camerasrc->man_ctl.awb_gain_r;
+  awb_gains.g_gain = camerasrc->man_ctl.awb_gain_g;
+  awb_gains.b_gain = camerasrc->man_ctl.awb_gain_b;
+
+  camerasrc->param->setExposureTime(camerasrc->man_ctl.exposure_time);
+  camerasrc->param->setSensitivityGain(camerasrc->man_ctl.gain);
+  camerasrc->param->setAwbMode((camera_awb_mode_t)camerasrc->man_ctl.awb_mode);
+  camerasrc->param->setAwbGains(awb_gains);
+  camera_set_parameters(camerasrc->device_id, *(camerasrc->param));
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  camerasrc->state_3a.seed_pending = FALSE;
+  GST_INFO("CameraId=%d release seeded 3A state.", camerasrc->device_id);
+}
+
+/**
+  * Called before the first camera_set_parameters() of a session, restore
+  * the last converged exposure/gain/AWB gains of the device so the first
+  * frames are captured with them instead of the HAL defaults
+  */
+void
+gst_camerasrc_3a_state_seed(Gstcamerasrc *camerasrc)
+{
+  PERF_CAMERA_ATRACE();
+  Gst3AState *state = &camerasrc->state_3a;
+
+  state->seed_pending = FALSE;
+  state->frame_count = 0;
+  state->converge_frames = -1;
+
+  if (!camerasrc->state_dir)
+    return;
+
+  /* never override 3A settings chosen by the user */
+  if (camerasrc->man_ctl.ae_mode != GST_CAMERASRC_AE_MODE_AUTO ||
+      camerasrc->man_ctl.awb_mode != GST_CAMERASRC_AWB_MODE_AUTO ||
+      camerasrc->man_ctl.manual_set_exposure_time ||
+      camerasrc->man_ctl.manual_set_gain) {
+    GST_INFO("CameraId=%d manual 3A settings, skip seeding.", camerasrc->device_id);
+    return;
+  }
+
+  if (!gst_camerasrc_3a_state_load(camerasrc, state))
+    return;
+
+  camerasrc->param->setExposureTime(state->exposure_time);
+  camerasrc->param->setSensitivityGain(state->gain);
+  camerasrc->param->setAwbMode(AWB_MODE_MANUAL_GAIN);
+  camerasrc->param->setAwbGains(state->awb_gains);
+  state->seed_pending = TRUE;
+
+  GST_INFO("CameraId=%d seed 3A state: exposure time=%ld, gain=%f, awb gains=%d/%d/%d.",
+    camerasrc->device_id, (long)state->exposure_time, state->gain,
+    state->awb_gains.r_gain, state->awb_gains.g_gain, state->awb_gains.b_gain);
+}
+
+/**
+  * Called from the main stream for each dequeued frame: release the seed
+  * after the first frame, count frames until the HAL reports AE and AWB
+  * converged, then keep the snapshot of the converged state up to date.
+  * The HAL results are only polled when the state is persisted or the
+  * startup frames wait for convergence
+  */
+void
+gst_camerasrc_3a_state_update(Gstcamerasrc *camerasrc)
+{
+  Gst3AState *state = &camerasrc->state_3a;
+  camera_ae_state_t ae_state = AE_STATE_NOT_CONVERGED;
+  camera_awb_state_t awb_state = AWB_STATE_NOT_CONVERGED;
+
+  state->frame_count++;
+
+  if (state->seed_pending) {
+    /* results of the seeded frame say nothing about convergence */
+    gst_camerasrc_3a_state_release_seed(camerasrc);
+    return;
+  }
+
+  if (!camerasrc->state_dir &&
+      camerasrc->startup_frames_mode == GST_CAMERASRC_STARTUP_FRAMES_PUSH)
+    return;
+
+  if (state->converge_frames >= 0) {
+    if (!camerasrc->state_dir ||
+        state->frame_count % GST_CAMERASRC_3A_STATE_SAMPLE_INTERVAL != 0)
+      return;
+  } else if ((guint)state->frame_count > MAX((guint)GST_CAMERASRC_3A_CONVERGE_MAX_FRAMES,
+        camerasrc->startup_frame_budget)) {
+    /* the startup frames wait for convergence up to their budget */
+    return;
+  }
+
+  PERF_CAMERA_ATRACE();
+  if (camera_get_parameters(camerasrc->device_id, *(camerasrc->result_param)) != 0)
+    return;
+
+  camerasrc->result_param->getAeState(ae_state);
+  camerasrc->result_param->getAwbState(awb_state);
+  if (ae_state != AE_STATE_CONVERGED || awb_state != AWB_STATE_CONVERGED)
+    return;
+
+  if (state->converge_frames < 0) {
+    /* read by the other streams to release their startup frames */
+    g_atomic_int_set(&state->converge_frames, state->frame_count);
+    GST_INFO("CameraId=%d AE/AWB converged after %d frames.",
+      camerasrc->device_id, state->converge_frames);
+  }
+
+  camerasrc->result_param->getExposureTime(state->exposure_time);
+  camerasrc->result_param->getSensitivityGain(state->gain);
+  camerasrc->result_param->getAwbGains(state->awb_gains);
+  state->valid = TRUE;
+}
+
+/**
+  * Write the last converged 3A state of the device to 3a-state-dir
+  */
+void
+gst_camerasrc_3a_state_persist(Gstcamerasrc *camerasrc)
+{
+  PERF_CAMERA_ATRACE();
+  Gst3AState *state = &camerasrc->state_3a;
+  GKeyFile *key_file = NULL;
+  gchar *path = NULL;
+  GError *error = NULL;
+
+  if (!camerasrc->state_dir || !state->valid)
+    return;
+
+  if (g_mkdir_with_parents(camerasrc->state_dir, 0755) != 0) {
+    GST_WARNING("CameraId=%d failed to create 3A state directory %s.",
+      camerasrc->device_id, camerasrc->state_dir);
+    return;
+  }
+
+  key_file = g_key_file_new();
+  g_key_file_set_int64(key_file, GST_CAMERASRC_3A_STATE_GROUP,
+      "exposure-time", state->exposure_time);
+  g_key_file_set_double(key_file, GST_CAMERASRC_3A_STATE_GROUP,
+      "gain", state->gain);
+  g_key_file_set_integer(key_file, GST_CAMERASRC_3A_STATE_GROUP,
+      "awb-gain-r", state->awb_gains.r_gain);
+  g_key_file_set_integer(key_file, GST_CAMERASRC_3A_STATE_GROUP,
+      "awb-gain-g", state->awb_gains.g_gain);
+  g_key_file_set_integer(key_file, GST_CAMERASRC_3A_STATE_GROUP,
+      "awb-gain-b", state->awb_gains.b_gain);
+
+  path = gst_camerasrc_3a_state_get_path(camerasrc);
+  if (!g_key_file_save_to_file(key_file, path, &error)) {
+    GST_WARNING("CameraId=%d failed to save 3A state to %s: %s.",
+      camerasrc->device_id, path, error->message);
+    g_error_free(error);
+  } else {
+    GST_INFO("CameraId=%d 3A state saved to %s, converged after %d frames.",
+      camerasrc->device_id, path, state->converge_frames);
+  }
+
+  g_free(path);
+  g_key_file_free(key_file);
+}
@@ -0,0 +1,154 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraClock"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "gstcamerasrc.h"
+#include "gstcameraclock.h"
+
+guint64
+gst_camerasrc_clock_monotonic_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+void
+gst_camerasrc_clock_map_reset(GstClockMapping *map)
+{
+  memset(map, 0, sizeof(*map));
+  map->skew = 1.0;
+}
+
+/**
+  * Take one pair of (monotonic, clock) time and refine the mapping with it,
+  * the monotonic time is read around the clock so that it's centered on it.
+  * Return the clock time, monotonic is set to the monotonic time.
+  */
+GstClockTime
+gst_camerasrc_clock_map_sample(GstClockMapping *map, GstClock *clock, guint64 *monotonic)
+{
+  guint64 before = gst_camerasrc_clock_monotonic_ns();
+  GstClockTime now = gst_clock_get_time(clock);
+  guint64 after = gst_camerasrc_clock_monotonic_ns();
+  gdouble x = (gdouble)before + (gdouble)(after - before) / 2;
+  gdouble y = (gdouble)now;
+  gdouble alpha, dx, dy;
+
+  *monotonic = after;
+
+  if (map->clock != clock) {
+    gst_camerasrc_clock_map_reset(map);
+    map->clock = clock;
+  }
+
+  if (map->samples >= GST_CAMERASRC_CLOCK_MAP_MIN_SAMPLES) {
+    gdouble residual = y - (map->mean_y + map->skew * (x - map->mean_x));
+    map->residual_var += (residual * residual - map->residual_var) /
+      GST_CAMERASRC_CLOCK_MAP_WINDOW;
+    if ((guint64)fabs(residual) > map->residual_max)
+      map->residual_max = (guint64)fabs(residual);
+  }
+
+  /* plain average until the window is filled, exponential decay after */
+  map->samples++;
+  alpha = 1.0 / MIN(map->samples, (guint64)GST_CAMERASRC_CLOCK_MAP_WINDOW);
+
+  dx = x - map->mean_x;
+  dy = y - map->mean_y;
+  map->mean_x += alpha * dx;
+  map->mean_y += alpha * dy;
+  map->cov_xx = (1.0 - alpha) * (map->cov_xx + alpha * dx * dx);
+  map->cov_xy = (1.0 - alpha) * (map->cov_xy + alpha * dx * dy);
+
+  if (map->samples >= GST_CAMERASRC_CLOCK_MAP_MIN_SAMPLES && map->cov_xx > 0) {
+    map->skew = CLAMP(map->cov_xy / map->cov_xx,
+      1.0 - GST_CAMERASRC_CLOCK_MAP_MAX_SKEW, 1.0 + GST_CAMERASRC_CLOCK_MAP_MAX_SKEW);
+  }
+
+  return now;
+}
+
+/**
+  * Map a HAL capture timestamp to the clock, monotonic is the time
+  * the frame is handled at. FALSE if there is no mapping yet or the
+  * capture time is not a sane monotonic time.
+  */
+gboolean
+gst_camerasrc_clock_map_convert(const GstClockMapping *map, guint64 capture,
+    guint64 monotonic, GstClockTime *clock_time)
+{
+  gdouble y;
+
+  if (map->samples == 0 || capture == 0 || capture > monotonic ||
+      monotonic - capture > GST_CAMERASRC_CLOCK_MAP_MAX_AGE)
+    return FALSE;
+
+  y = map->mean_y + map->skew * ((gdouble)capture - map->mean_x);
+  if (y < 0)
+    return FALSE;
+
+  *clock_time = (GstClockTime)y;
+  return TRUE;
+}
+
+/* Make the mapping of a stream readable from any thread by the stats */
+void
+gst_camerasrc_clock_map_publish(const GstClockMapping *map, GstStreamStats *stats)
+{
+  stats->clock_samples.store(map->samples, std::memory_order_relaxed);
+  stats->clock_skew.store(map->skew, std::memory_order_relaxed);
+  stats->clock_offset.store((gint64)(map->mean_y - map->mean_x), std::memory_order_relaxed);
+  stats->clock_residual_var.store(map->residual_var, std::memory_order_relaxed);
+  stats->clock_residual_max.store(map->residual_max, std::memory_order_relaxed);
+}
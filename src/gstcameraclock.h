@@ -0,0 +1,67 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERASRC_CLOCK_H__
+#define __GST_CAMERASRC_CLOCK_H__
+
+#include <gst/gst.h>
+#include "gstcamerasrc.h"
+
+/* Weight of a sample decays by 1/e over about this many frames */
+#define GST_CAMERASRC_CLOCK_MAP_WINDOW 128
+/* Samples needed before skew is estimated, it's 1.0 until then */
+#define GST_CAMERASRC_CLOCK_MAP_MIN_SAMPLES 16
+/* Clocks are not expected to drift more than this from each other */
+#define GST_CAMERASRC_CLOCK_MAP_MAX_SKEW 0.001
+/* Capture timestamps older than this at fill time are not trusted */
+#define GST_CAMERASRC_CLOCK_MAP_MAX_AGE GST_SECOND
+
+guint64 gst_camerasrc_clock_monotonic_ns(void);
+void gst_camerasrc_clock_map_reset(GstClockMapping *map);
+GstClockTime gst_camerasrc_clock_map_sample(GstClockMapping *map, GstClock *clock,
+    guint64 *monotonic);
+gboolean gst_camerasrc_clock_map_convert(const GstClockMapping *map, guint64 capture,
+    guint64 monotonic, GstClockTime *clock_time);
+void gst_camerasrc_clock_map_publish(const GstClockMapping *map, GstStreamStats *stats);
+
+#endif /* __GST_CAMERASRC_CLOCK_H__ */
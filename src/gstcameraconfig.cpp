@@ -0,0 +1,266 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraConfig"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "ICamera.h"
+#include "gstcamerasrc.h"
+#include "gstcameraclock.h"
+#include "gstcamerasync.h"
+#include "gstcameraconfig.h"
+
+using namespace icamera;
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+/* with GST_CAMSRC_LOCK, the stream ids of the pads of the element. The
+ * pads are only added and removed while stopped */
+static guint32
+gst_camerasrc_config_active(Gstcamerasrc *camerasrc)
+{
+  GPtrArray *pads = GST_CAM_BASE_SRC(camerasrc)->pads;
+  guint32 active = 0;
+
+  for (guint i = 0; i < pads->len; i++) {
+    GstCamBaseSrcPadState *state = (GstCamBaseSrcPadState *) g_ptr_array_index(pads, i);
+    if (state)
+      active |= 1u << state->index;
+  }
+  return active;
+}
+
+/* with GST_CAMSRC_LOCK, the startup progressed and has its time again */
+static void
+gst_camerasrc_config_progress(Gstcamerasrc *camerasrc)
+{
+  camerasrc->config_deadline = g_get_monotonic_time() +
+    GST_CAMERASRC_CONFIG_TIMEOUT / GST_USECOND;
+}
+
+/* with GST_CAMSRC_LOCK, wakes the streams waiting for a state */
+static void
+gst_camerasrc_config_set_state(Gstcamerasrc *camerasrc, GstCamerasrcConfigState state)
+{
+  gst_camerasrc_config_progress(camerasrc);
+  g_atomic_int_set(&camerasrc->config_state, state);
+  GST_CAMSRC_BROADCAST(camerasrc);
+}
+
+/* with GST_CAMSRC_LOCK, the first stream to get there starts collecting */
+static void
+gst_camerasrc_config_arm(Gstcamerasrc *camerasrc)
+{
+  if (camerasrc->config_state != GST_CAMERASRC_CONFIG_IDLE)
+    return;
+
+  gst_camerasrc_config_set_state(camerasrc, GST_CAMERASRC_CONFIG_COLLECTING);
+}
+
+/* Called when the element starts, before any stream sets its caps */
+void
+gst_camerasrc_config_reset(Gstcamerasrc *camerasrc)
+{
+  GST_CAMSRC_LOCK(camerasrc);
+  camerasrc->config_streams = 0;
+  camerasrc->config_started = 0;
+  camerasrc->config_flushing = FALSE;
+  gst_camerasrc_config_set_state(camerasrc, GST_CAMERASRC_CONFIG_IDLE);
+  GST_CAMSRC_UNLOCK(camerasrc);
+}
+
+/**
+ * Record that a stream has its caps and pool, the stream completing the
+ * set of the active pads configures the HAL streams from its thread. The
+ * others return at once. A stream setting its caps again once the set is
+ * complete configures the HAL streams again.
+ */
+gboolean
+gst_camerasrc_config_stream(Gstcamerasrc *camerasrc, int stream_id)
+{
+  guint32 active;
+  gboolean ret;
+
+  GST_CAMSRC_LOCK(camerasrc);
+  if (camerasrc->config_state == GST_CAMERASRC_CONFIG_FAILED) {
+    GST_CAMSRC_UNLOCK(camerasrc);
+    return FALSE;
+  }
+
+  gst_camerasrc_config_arm(camerasrc);
+  gst_camerasrc_config_progress(camerasrc);
+  camerasrc->config_streams |= 1u << stream_id;
+  active = gst_camerasrc_config_active(camerasrc);
+  if ((camerasrc->config_streams & active) != active) {
+    GST_INFO("CameraId=%d, StreamId=%d configured, streams 0x%x of 0x%x.",
+      camerasrc->device_id, stream_id, camerasrc->config_streams, active);
+    GST_CAMSRC_UNLOCK(camerasrc);
+    return TRUE;
+  }
+
+  ret = gst_camerasrc_configure_device(camerasrc, stream_id, active);
+  if (!ret)
+    gst_camerasrc_config_set_state(camerasrc, GST_CAMERASRC_CONFIG_FAILED);
+  else if (camerasrc->config_state < GST_CAMERASRC_CONFIG_CONFIGURED)
+    gst_camerasrc_config_set_state(camerasrc, GST_CAMERASRC_CONFIG_CONFIGURED);
+  GST_CAMSRC_UNLOCK(camerasrc);
+
+  return ret;
+}
+
+/**
+ * Record that the pool of a stream allocated its buffers, the stream
+ * completing the set once the HAL streams are configured starts the
+ * device, together with the other members of its sync group.
+ */
+gboolean
+gst_camerasrc_config_start_stream(Gstcamerasrc *camerasrc, int stream_id)
+{
+  guint32 active;
+
+  GST_CAMSRC_LOCK(camerasrc);
+  if (camerasrc->config_state == GST_CAMERASRC_CONFIG_FAILED) {
+    GST_CAMSRC_UNLOCK(camerasrc);
+    return FALSE;
+  }
+
+  gst_camerasrc_config_arm(camerasrc);
+  gst_camerasrc_config_progress(camerasrc);
+  camerasrc->config_started |= 1u << stream_id;
+  active = gst_camerasrc_config_active(camerasrc);
+  if (camerasrc->config_state != GST_CAMERASRC_CONFIG_CONFIGURED ||
+      (camerasrc->config_started & active) != active) {
+    GST_INFO("CameraId=%d, StreamId=%d pool started, streams 0x%x of 0x%x.",
+      camerasrc->device_id, stream_id, camerasrc->config_started, active);
+    GST_CAMSRC_UNLOCK(camerasrc);
+    return TRUE;
+  }
+
+  /* the lock is not held while the other members of the sync group get
+   * there, the state tells if the device was started or stopped meanwhile */
+  if (camerasrc->sync) {
+    GST_CAMSRC_UNLOCK(camerasrc);
+    gst_camerasrc_sync_barrier(camerasrc);
+    GST_CAMSRC_LOCK(camerasrc);
+    if (camerasrc->config_state != GST_CAMERASRC_CONFIG_CONFIGURED) {
+      GST_CAMSRC_UNLOCK(camerasrc);
+      return TRUE;
+    }
+  }
+
+  guint64 start = gst_camerasrc_clock_monotonic_ns();
+  camera_device_start(camerasrc->device_id);
+  gst_camerasrc_sync_started(camerasrc, start);
+  camerasrc->device_start_time = g_get_monotonic_time();
+  GST_INFO("CameraId=%d, StreamId=%d all pools started, device started.",
+    camerasrc->device_id, stream_id);
+  gst_camerasrc_config_set_state(camerasrc, GST_CAMERASRC_CONFIG_STARTED);
+  GST_CAMSRC_UNLOCK(camerasrc);
+
+  return TRUE;
+}
+
+/**
+ * Wait until the startup reached state, for the streams that can't go on
+ * before. The deadline moves with every stream progressing, so pads
+ * negotiating late are waited for, but a startup stuck for
+ * GST_CAMERASRC_CONFIG_TIMEOUT fails instead of leaving the streams
+ * waiting. The waits also end when the element flushes its streams.
+ */
+GstFlowReturn
+gst_camerasrc_config_wait(Gstcamerasrc *camerasrc, int stream_id,
+    GstCamerasrcConfigState state)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  gint current = g_atomic_int_get(&camerasrc->config_state);
+
+  if (G_LIKELY(current >= (gint)state && current != GST_CAMERASRC_CONFIG_FAILED))
+    return GST_FLOW_OK;
+
+  GST_CAMSRC_LOCK(camerasrc);
+  while (TRUE) {
+    current = camerasrc->config_state;
+    if (current == GST_CAMERASRC_CONFIG_FAILED) {
+      ret = GST_FLOW_ERROR;
+      break;
+    }
+    if (current >= (gint)state)
+      break;
+    if (camerasrc->config_flushing) {
+      ret = GST_FLOW_FLUSHING;
+      break;
+    }
+    GST_DEBUG("CameraId=%d, StreamId=%d waits for state %d in state %d, "
+      "streams configured 0x%x, started 0x%x of 0x%x.",
+      camerasrc->device_id, stream_id, state, current, camerasrc->config_streams,
+      camerasrc->config_started, gst_camerasrc_config_active(camerasrc));
+    if (!GST_CAMSRC_WAIT_UNTIL(camerasrc, camerasrc->config_deadline) &&
+        g_get_monotonic_time() >= camerasrc->config_deadline) {
+      GST_ERROR("CameraId=%d, StreamId=%d startup stuck in state %d for %" GST_TIME_FORMAT
+        ", streams configured 0x%x, started 0x%x of 0x%x.",
+        camerasrc->device_id, stream_id, camerasrc->config_state,
+        GST_TIME_ARGS(GST_CAMERASRC_CONFIG_TIMEOUT), camerasrc->config_streams,
+        camerasrc->config_started, gst_camerasrc_config_active(camerasrc));
+      gst_camerasrc_config_set_state(camerasrc, GST_CAMERASRC_CONFIG_FAILED);
+      ret = GST_FLOW_ERROR;
+      break;
+    }
+  }
+  GST_CAMSRC_UNLOCK(camerasrc);
+
+  return ret;
+}
+
+/* Unblock the streams waiting for the startup while flushing */
+void
+gst_camerasrc_config_set_flushing(Gstcamerasrc *camerasrc, gboolean flushing)
+{
+  GST_CAMSRC_LOCK(camerasrc);
+  camerasrc->config_flushing = flushing;
+  GST_CAMSRC_BROADCAST(camerasrc);
+  GST_CAMSRC_UNLOCK(camerasrc);
+}
@@ -0,0 +1,68 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+
+#ifndef __GST_CAMERASRC_CONFIG_H__
+#define __GST_CAMERASRC_CONFIG_H__
+
+#include <gst/gst.h>
+#include "gstcamerasrc.h"
+
+/* Time the startup has to progress, a stream setting its caps or starting
+ * its pool and any state change give it that time again */
+#define GST_CAMERASRC_CONFIG_TIMEOUT (5 * GST_SECOND)
+
+/* No stream waits for the others while configuring or starting, the one
+ * completing a step runs camera_device_config_streams or
+ * camera_device_start. The streams only wait for the device to be started
+ * before dqbuf, or to be configured before allocating HAL memory, unless
+ * flushing or the startup stopped progressing */
+void gst_camerasrc_config_reset(Gstcamerasrc *camerasrc);
+gboolean gst_camerasrc_config_stream(Gstcamerasrc *camerasrc, int stream_id);
+gboolean gst_camerasrc_config_start_stream(Gstcamerasrc *camerasrc, int stream_id);
+GstFlowReturn gst_camerasrc_config_wait(Gstcamerasrc *camerasrc, int stream_id,
+    GstCamerasrcConfigState state);
+void gst_camerasrc_config_set_flushing(Gstcamerasrc *camerasrc, gboolean flushing);
+
+#endif /* __GST_CAMERASRC_CONFIG_H__ */
@@ -58,6 +58,7 @@
 
 #include "ICamera.h"
 #include "ScopedAtrace.h"
+#include "gstcameratrace.h"
 
 #include "gstcamerasrcbufferpool.h"
 #include "gstcamerasrc.h"
@@ -67,16 +68,11 @@
 
 using namespace icamera;
 
-void gst_camerasrc_copy_field(Gstcamerasrc *camerasrc,
+/* Keep a field for weaving, only used with 'sw_weave' */
+void gst_camerasrc_copy_field(Gstcamerasrc *camerasrc, int stream_id,
        camera_buffer_t *src,
        camera_buffer_t *dst)
 {
-  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL_CAST(camerasrc);
-  int stream_id = pool->stream_id;
-
-  if (camerasrc->deinterlace_method != GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE)
-    return;
-
   const int bytes_of_line = camerasrc->streams[stream_id].bpl;
   const int height = CameraSrcUtils::get_number_of_valid_lines(camerasrc->s[stream_id].format,
                          camerasrc->s[stream_id].height);
@@ -84,13 +80,11 @@ void gst_camerasrc_copy_field(Gstcamerasrc *camerasrc,
   MEMCPY_S((char *)dst->addr, total_len, (char *)src->addr, total_len);
 }
 
-static int
-gst_camerasrc_deinterlace_sw_bob(Gstcamerasrc *camerasrc,
+int
+gst_camerasrc_deinterlace_sw_bob(Gstcamerasrc *camerasrc, int stream_id,
                camera_buffer_t *buffer)
 {
   PERF_CAMERA_ATRACE();
-  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL_CAST(camerasrc);
-  int stream_id = pool->stream_id;
   char *addr = (char *)buffer->addr;
   const int bytes_of_line = camerasrc->streams[stream_id].bpl;
   const int height = CameraSrcUtils::get_number_of_valid_lines(camerasrc->s[stream_id].format,
@@ -107,15 +101,14 @@ gst_camerasrc_deinterlace_sw_bob(Gstcamerasrc *camerasrc,
   return 0;
 }
 
-static int
-gst_camerasrc_deinterlace_sw_weave(Gstcamerasrc *camerasrc,
-               camera_buffer_t * top,
-               camera_buffer_t * bottom,
+/* Weave the top and bottom fields kept by copy_field into dest */
+int
+gst_camerasrc_deinterlace_sw_weave(Gstcamerasrc *camerasrc, int stream_id,
                camera_buffer_t * dest)
 {
   PERF_CAMERA_ATRACE();
-  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL_CAST(camerasrc);
-  int stream_id = pool->stream_id;
+  camera_buffer_t *top = camerasrc->streams[stream_id].top;
+  camera_buffer_t *bottom = camerasrc->streams[stream_id].bottom;
   char *addr = (char *)dest->addr;
   const int bytes_of_line = camerasrc->streams[stream_id].bpl;
   const int height = CameraSrcUtils::get_number_of_valid_lines(camerasrc->s[stream_id].format,
@@ -132,27 +125,3 @@ gst_camerasrc_deinterlace_sw_weave(Gstcamerasrc *camerasrc,
   dest->s.field = V4L2_FIELD_NONE;
   return 0;
 }
-
-int gst_camerasrc_deinterlace_frame(Gstcamerasrc *camerasrc, camera_buffer_t *buffer)
-{
-  PERF_CAMERA_ATRACE();
-  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL_CAST(camerasrc);
-  int stream_id = pool->stream_id;
-
-  switch (camerasrc->deinterlace_method) {
-    case GST_CAMERASRC_DEINTERLACE_METHOD_NONE:
-    case GST_CAMERASRC_DEINTERLACE_METHOD_HARDWARE_WEAVE:
-      break;
-    case GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_BOB:
-      return gst_camerasrc_deinterlace_sw_bob(camerasrc, buffer);
-    case GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE:
-      return gst_camerasrc_deinterlace_sw_weave(camerasrc,
-                 camerasrc->streams[stream_id].top,
-                 camerasrc->streams[stream_id].bottom,
-                 buffer);
-    default:
-      break;
-  }
-
-  return 0;
-}
@@ -49,9 +49,12 @@
 #include "gstcamerasrc.h"
 
 bool gst_camerasrc_isPlanarFormat(int format);
-void gst_camerasrc_copy_field(Gstcamerasrc *camerasrc,
+void gst_camerasrc_copy_field(Gstcamerasrc *camerasrc, int stream_id,
         camera_buffer_t *src,
         camera_buffer_t *dst);
-int gst_camerasrc_deinterlace_frame(Gstcamerasrc *camerasrc, camera_buffer_t *buffer);
+int gst_camerasrc_deinterlace_sw_bob(Gstcamerasrc *camerasrc, int stream_id,
+        camera_buffer_t *buffer);
+int gst_camerasrc_deinterlace_sw_weave(Gstcamerasrc *camerasrc, int stream_id,
+        camera_buffer_t *dest);
 
 #endif /* __GST_CAMERASRC_DEINTERLACE_H__ */
@@ -56,6 +56,7 @@
 
 #include "ICamera.h"
 #include "ScopedAtrace.h"
+#include "gstcameratrace.h"
 #include "gstcamerasrc.h"
 #include "gstcameraformat.h"
 #include "Parameters.h"
@@ -0,0 +1,149 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraLock"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "gstcamerasrc.h"
+#include "gstcameraclock.h"
+#include "gstcamerastats.h"
+#include "gstcameralock.h"
+
+static void
+gst_camerasrc_lock_max(std::atomic<gint> *counter, gint value)
+{
+  gint max = counter->load(std::memory_order_relaxed);
+
+  while (value > max && !counter->compare_exchange_weak(max, value, std::memory_order_relaxed))
+    ;
+}
+
+/**
+  * Lock without waiting when the mutex is free, otherwise count this
+  * thread as a contender for the time it is blocked.
+  */
+void
+gst_camerasrc_lock_acquire(GMutex *mutex, GstLockStats *stats)
+{
+  if (!g_mutex_trylock(mutex)) {
+    gint waiters = GST_CAMERASRC_STATS_ADD(stats->waiters, 1) + 1;
+    guint64 start = gst_camerasrc_clock_monotonic_ns();
+    guint64 wait;
+
+    gst_camerasrc_lock_max(&stats->waiters_max, waiters);
+    g_mutex_lock(mutex);
+    wait = gst_camerasrc_clock_monotonic_ns() - start;
+    stats->waiters.fetch_sub(1, std::memory_order_relaxed);
+
+    GST_CAMERASRC_STATS_ADD(stats->contended, 1);
+    GST_CAMERASRC_STATS_ADD(stats->wait, wait);
+    gst_camerasrc_stats_max(&stats->wait_max, wait);
+  }
+
+  GST_CAMERASRC_STATS_ADD(stats->acquisitions, 1);
+  stats->acquired_at = gst_camerasrc_clock_monotonic_ns();
+}
+
+void
+gst_camerasrc_lock_release(GMutex *mutex, GstLockStats *stats)
+{
+  guint64 hold = gst_camerasrc_clock_monotonic_ns() - stats->acquired_at;
+
+  g_mutex_unlock(mutex);
+
+  GST_CAMERASRC_STATS_ADD(stats->hold, hold);
+  gst_camerasrc_stats_max(&stats->hold_max, hold);
+}
+
+/* The mutex is not held while waiting on the condition, so the hold
+ * time ends before the wait and starts again after it */
+void
+gst_camerasrc_lock_wait(GCond *cond, GMutex *mutex, GstLockStats *stats)
+{
+  guint64 hold = gst_camerasrc_clock_monotonic_ns() - stats->acquired_at;
+
+  GST_CAMERASRC_STATS_ADD(stats->hold, hold);
+  gst_camerasrc_stats_max(&stats->hold_max, hold);
+
+  g_cond_wait(cond, mutex);
+
+  GST_CAMERASRC_STATS_ADD(stats->acquisitions, 1);
+  stats->acquired_at = gst_camerasrc_clock_monotonic_ns();
+}
+
+/* end_time is in us of g_get_monotonic_time, FALSE once it passed */
+gboolean
+gst_camerasrc_lock_wait_until(GCond *cond, GMutex *mutex, GstLockStats *stats,
+    gint64 end_time)
+{
+  guint64 hold = gst_camerasrc_clock_monotonic_ns() - stats->acquired_at;
+  gboolean signaled;
+
+  GST_CAMERASRC_STATS_ADD(stats->hold, hold);
+  gst_camerasrc_stats_max(&stats->hold_max, hold);
+
+  signaled = g_cond_wait_until(cond, mutex, end_time);
+
+  GST_CAMERASRC_STATS_ADD(stats->acquisitions, 1);
+  stats->acquired_at = gst_camerasrc_clock_monotonic_ns();
+
+  return signaled;
+}
+
+GstStructure *
+gst_camerasrc_lock_to_structure(GstLockStats *stats, const gchar *name)
+{
+  return gst_structure_new(name,
+      "acquisitions", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->acquisitions),
+      "contended", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->contended),
+      "wait-time", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->wait),
+      "wait-max", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->wait_max),
+      "hold-time", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->hold),
+      "hold-max", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->hold_max),
+      "waiters", G_TYPE_INT, GST_CAMERASRC_STATS_GET(stats->waiters),
+      "waiters-max", G_TYPE_INT, GST_CAMERASRC_STATS_GET(stats->waiters_max),
+      NULL);
+}
@@ -0,0 +1,93 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERASRC_LOCK_H__
+#define __GST_CAMERASRC_LOCK_H__
+
+#include <atomic>
+#include <gst/gst.h>
+
+typedef struct _GstLockStats GstLockStats;
+
+/* Contention of a mutex, times are in ns. Counters are relaxed atomics,
+ * acquired_at is only accessed by the thread holding the mutex */
+struct _GstLockStats
+{
+  std::atomic<guint64> acquisitions;
+  std::atomic<guint64> contended;
+  std::atomic<guint64> wait;
+  std::atomic<guint64> wait_max;
+  std::atomic<guint64> hold;
+  std::atomic<guint64> hold_max;
+  std::atomic<gint> waiters;
+  std::atomic<gint> waiters_max;
+  guint64 acquired_at;
+};
+
+/* With --enable-lock-profiling the element and base class locks record
+ * wait and hold times, otherwise they map to the plain GLib calls */
+#ifdef ENABLE_LOCK_PROFILING
+#define GST_CAMERASRC_MUTEX_LOCK(mutex, stats) \
+  gst_camerasrc_lock_acquire((mutex), (stats))
+#define GST_CAMERASRC_MUTEX_UNLOCK(mutex, stats) \
+  gst_camerasrc_lock_release((mutex), (stats))
+#define GST_CAMERASRC_COND_WAIT(cond, mutex, stats) \
+  gst_camerasrc_lock_wait((cond), (mutex), (stats))
+#define GST_CAMERASRC_COND_WAIT_UNTIL(cond, mutex, stats, end_time) \
+  gst_camerasrc_lock_wait_until((cond), (mutex), (stats), (end_time))
+#else
+#define GST_CAMERASRC_MUTEX_LOCK(mutex, stats) g_mutex_lock(mutex)
+#define GST_CAMERASRC_MUTEX_UNLOCK(mutex, stats) g_mutex_unlock(mutex)
+#define GST_CAMERASRC_COND_WAIT(cond, mutex, stats) g_cond_wait((cond), (mutex))
+#define GST_CAMERASRC_COND_WAIT_UNTIL(cond, mutex, stats, end_time) \
+  g_cond_wait_until((cond), (mutex), (end_time))
+#endif
+
+void gst_camerasrc_lock_acquire(GMutex *mutex, GstLockStats *stats);
+void gst_camerasrc_lock_release(GMutex *mutex, GstLockStats *stats);
+void gst_camerasrc_lock_wait(GCond *cond, GMutex *mutex, GstLockStats *stats);
+gboolean gst_camerasrc_lock_wait_until(GCond *cond, GMutex *mutex, GstLockStats *stats,
+    gint64 end_time);
+GstStructure *gst_camerasrc_lock_to_structure(GstLockStats *stats, const gchar *name);
+
+#endif /* __GST_CAMERASRC_LOCK_H__ */
@@ -0,0 +1,499 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraMetrics"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "gstcamerasrc.h"
+#include "gstcamerastats.h"
+#include "gstcamerametrics.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+/* One exporter per process serves all the registered instances, the
+ * registry lock is never taken on the streaming path: the counters are
+ * read with relaxed atomics. The exporter runs while instances are
+ * registered, it is started and stopped under metrics_state_lock, which
+ * the exporter thread never takes */
+static GMutex metrics_lock;
+static GMutex metrics_state_lock;
+static GList *metrics_instances = NULL;
+static gchar *metrics_endpoint = NULL;
+static gchar *metrics_path = NULL;
+static int metrics_fd = -1;
+static int metrics_wake[2] = { -1, -1 };
+static GThread *metrics_thread = NULL;
+
+/* Time the exporter waits when it is out of file descriptors or memory */
+#define GST_CAMERASRC_METRICS_BACKOFF (100 * G_TIME_SPAN_MILLISECOND)
+/* Time a client has to send its request and to read the answer, in ms */
+#define GST_CAMERASRC_METRICS_REQUEST_TIMEOUT 100
+#define GST_CAMERASRC_METRICS_SEND_TIMEOUT 1000
+
+/* Only a socket nobody listens on anymore is removed, anything else at
+ * the path is left alone and the bind fails */
+static void
+gst_camerasrc_metrics_remove_stale(const struct sockaddr_un *addr)
+{
+  struct stat st;
+  int fd;
+
+  if (lstat(addr->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode))
+    return;
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return;
+  if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 &&
+      errno == ECONNREFUSED)
+    unlink(addr->sun_path);
+  close(fd);
+}
+
+static const double metrics_quantiles[] = { 0.5, 0.9, 0.99 };
+
+/* The socket file of the exporter is removed once it no longer listens */
+static void
+gst_camerasrc_metrics_remove_path(void)
+{
+  if (metrics_path)
+    unlink(metrics_path);
+  g_free(metrics_path);
+  metrics_path = NULL;
+}
+
+static int
+gst_camerasrc_metrics_listen(const gchar *endpoint)
+{
+  int fd;
+
+  if (g_str_has_prefix(endpoint, "unix:")) {
+    struct sockaddr_un addr;
+    const gchar *path = endpoint + strlen("unix:");
+
+    if (strlen(path) == 0 || strlen(path) >= sizeof(addr.sun_path))
+      return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return -1;
+    /* a socket left by a previous process */
+    gst_camerasrc_metrics_remove_stale(&addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+    metrics_path = g_strdup(path);
+  } else if (g_str_has_prefix(endpoint, "tcp:")) {
+    struct sockaddr_in addr;
+    int port = atoi(endpoint + strlen("tcp:"));
+    int reuse = 1;
+
+    if (port <= 0 || port > 65535)
+      return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+  } else {
+    return -1;
+  }
+
+  if (listen(fd, 4) < 0) {
+    close(fd);
+    gst_camerasrc_metrics_remove_path();
+    return -1;
+  }
+
+  return fd;
+}
+
+static void
+gst_camerasrc_metrics_header(GString *out, const gchar *name, const gchar *type,
+    const gchar *help)
+{
+  g_string_append_printf(out, "# HELP icamerasrc_%s %s\n# TYPE icamerasrc_%s %s\n",
+    name, help, name, type);
+}
+
+static void
+gst_camerasrc_metrics_summary(GString *out, const gchar *name, int device_id,
+    int stream_id, GstLatencyHistogram *histogram)
+{
+  for (guint q = 0; q < G_N_ELEMENTS(metrics_quantiles); q++)
+    g_string_append_printf(out,
+      "icamerasrc_%s{device_id=\"%d\",stream_id=\"%d\",quantile=\"%g\"} %.6f\n",
+      name, device_id, stream_id, metrics_quantiles[q],
+      (double)gst_camerasrc_histogram_quantile(histogram, metrics_quantiles[q]) / GST_SECOND);
+  g_string_append_printf(out,
+    "icamerasrc_%s_sum{device_id=\"%d\",stream_id=\"%d\"} %.6f\n",
+    name, device_id, stream_id, (double)GST_CAMERASRC_STATS_GET(histogram->sum) / GST_SECOND);
+  g_string_append_printf(out,
+    "icamerasrc_%s_count{device_id=\"%d\",stream_id=\"%d\"} %lu\n",
+    name, device_id, stream_id, GST_CAMERASRC_STATS_GET(histogram->count));
+}
+
+/* Text exposition format of the statistics of all instances, each
+ * metric lists the streams of every instance labelled by ids */
+static GString *
+gst_camerasrc_metrics_collect(void)
+{
+  GString *out = g_string_new(NULL);
+  GList *l;
+
+#define FOREACH_STREAM(body) \
+  for (l = metrics_instances; l; l = l->next) { \
+    Gstcamerasrc *camerasrc = (Gstcamerasrc *)l->data; \
+    int device_id = camerasrc->device_id; \
+    int n_streams = g_atomic_int_get(&camerasrc->number_of_activepads); \
+    for (int i = 0; i < n_streams && i < GST_CAMERASRC_MAX_STREAM_NUM; i++) { \
+      GstStreamStats *stats = &camerasrc->streams[i].stats; \
+      body \
+    } \
+  }
+#define LABELS "{device_id=\"%d\",stream_id=\"%d\"}"
+
+  gst_camerasrc_metrics_header(out, "frames_total", "counter", "Frames dequeued from HAL");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_frames_total" LABELS " %lu\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->frames));)
+
+  gst_camerasrc_metrics_header(out, "fps", "gauge", "Frame rate over the last interval");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_fps" LABELS " %.3f\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->fps));)
+
+  gst_camerasrc_metrics_header(out, "latency_seconds", "summary",
+    "Time from capture to push of the frames");
+  FOREACH_STREAM(gst_camerasrc_metrics_summary(out, "latency_seconds", device_id, i,
+    &stats->latency);)
+
+  gst_camerasrc_metrics_header(out, "sched_delay_seconds", "summary",
+    "Time the streaming thread waited for a cpu between two frames");
+  FOREACH_STREAM(gst_camerasrc_metrics_summary(out, "sched_delay_seconds", device_id, i,
+    &stats->sched_delay);)
+
+  gst_camerasrc_metrics_header(out, "sync_skew_seconds", "summary",
+    "Capture time distance of the frames to their sync group set");
+  FOREACH_STREAM(gst_camerasrc_metrics_summary(out, "sync_skew_seconds", device_id, i,
+    &stats->sync_skew);)
+
+  gst_camerasrc_metrics_header(out, "dqbuf_wait_seconds_total", "counter",
+    "Time spent waiting for frames in dqbuf");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_dqbuf_wait_seconds_total" LABELS " %.6f\n",
+    device_id, i, (double)GST_CAMERASRC_STATS_GET(stats->dqbuf_wait) / GST_SECOND);)
+
+  gst_camerasrc_metrics_header(out, "deinterlace_seconds_total", "counter",
+    "Time spent deinterlacing frames");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_deinterlace_seconds_total" LABELS " %.6f\n",
+    device_id, i, (double)GST_CAMERASRC_STATS_GET(stats->deinterlace) / GST_SECOND);)
+
+  gst_camerasrc_metrics_header(out, "buffers_held", "gauge", "Buffers held downstream");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_buffers_held" LABELS " %ld\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->held));)
+
+  gst_camerasrc_metrics_header(out, "buffers_queued", "gauge", "Buffers queued to HAL");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_buffers_queued" LABELS " %ld\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->hal_queued));)
+
+  gst_camerasrc_metrics_header(out, "frames_dropped_total", "counter",
+    "Frames missing in the HAL sequence");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_frames_dropped_total" LABELS " %lu\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->dropped));)
+
+  gst_camerasrc_metrics_header(out, "frames_duplicated_total", "counter",
+    "Frames delivered again by HAL");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_frames_duplicated_total" LABELS " %lu\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->duplicated));)
+
+  gst_camerasrc_metrics_header(out, "frames_late_total", "counter",
+    "Frames pushed later than the reported max latency");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_frames_late_total" LABELS " %lu\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->late));)
+
+  gst_camerasrc_metrics_header(out, "frames_unpaired_total", "counter",
+    "Frames missing in the sets of their capture for the pair pad");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_frames_unpaired_total" LABELS " %lu\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->unpaired));)
+
+  gst_camerasrc_metrics_header(out, "frames_decimated_total", "counter",
+    "Frames given back to HAL without being pushed by the stream decimation");
+  FOREACH_STREAM(g_string_append_printf(out, "icamerasrc_frames_decimated_total" LABELS " %lu\n",
+    device_id, i, GST_CAMERASRC_STATS_GET(stats->decimated));)
+
+#undef LABELS
+#undef FOREACH_STREAM
+
+  return out;
+}
+
+/**
+ * Wait until the client socket is ready for events or the deadline in
+ * us of the monotonic time, FALSE on timeout, error or when the wake
+ * pipe is written, so that a stalled client never holds up stop
+ */
+static gboolean
+gst_camerasrc_metrics_wait(int fd, short events, gint64 deadline)
+{
+  while (true) {
+    struct pollfd fds[2] = { { fd, events, 0 }, { metrics_wake[0], POLLIN, 0 } };
+    gint64 timeout = deadline - g_get_monotonic_time();
+    int ret;
+
+    if (timeout <= 0)
+      return FALSE;
+    ret = poll(fds, 2, (int)((timeout + 999) / 1000));
+    if (ret < 0 && errno == EINTR)
+      continue;
+    return ret > 0 && !fds[1].revents && fds[0].revents;
+  }
+}
+
+/* The client socket is non-blocking, a client not reading its answer
+ * within the send timeout is dropped */
+static void
+gst_camerasrc_metrics_write(int fd, const gchar *data, gsize size, gint64 deadline)
+{
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!gst_camerasrc_metrics_wait(fd, POLLOUT, deadline)) {
+        GST_DEBUG("metrics client not reading, dropped.");
+        return;
+      }
+      continue;
+    }
+    if (n <= 0)
+      return;
+    data += n;
+    size -= n;
+  }
+}
+
+/* Answer every connection with the current metrics over HTTP/1.0, until
+ * the wake pipe is written or accept fails for good */
+static gpointer
+gst_camerasrc_metrics_thread(gpointer data)
+{
+  int listen_fd = GPOINTER_TO_INT(data);
+
+  while (true) {
+    struct pollfd fds[2] = { { listen_fd, POLLIN, 0 }, { metrics_wake[0], POLLIN, 0 } };
+    gchar request[1024];
+    GString *body;
+    gchar *header;
+    gint64 deadline;
+    int fd;
+
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      GST_ERROR("metrics exporter failed to poll: %s.", g_strerror(errno));
+      break;
+    }
+    if (fds[1].revents)
+      break;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED || errno == EPROTO)
+        continue;
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+        GST_WARNING("metrics exporter failed to accept: %s, retrying.", g_strerror(errno));
+        g_usleep(GST_CAMERASRC_METRICS_BACKOFF);
+        continue;
+      }
+      GST_ERROR("metrics exporter failed to accept: %s, stopped.", g_strerror(errno));
+      break;
+    }
+
+    /* the request itself is not needed, give the client a moment to send it */
+    if (gst_camerasrc_metrics_wait(fd, POLLIN,
+          g_get_monotonic_time() + GST_CAMERASRC_METRICS_REQUEST_TIMEOUT * G_TIME_SPAN_MILLISECOND) &&
+        recv(fd, request, sizeof(request), 0) < 0)
+      GST_DEBUG("failed to read metrics request.");
+
+    g_mutex_lock(&metrics_lock);
+    body = gst_camerasrc_metrics_collect();
+    g_mutex_unlock(&metrics_lock);
+
+    header = g_strdup_printf("HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: %lu\r\n\r\n", body->len);
+    deadline = g_get_monotonic_time() + GST_CAMERASRC_METRICS_SEND_TIMEOUT * G_TIME_SPAN_MILLISECOND;
+    gst_camerasrc_metrics_write(fd, header, strlen(header), deadline);
+    gst_camerasrc_metrics_write(fd, body->str, body->len, deadline);
+
+    g_free(header);
+    g_string_free(body, TRUE);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+/* Called with metrics_state_lock */
+static gboolean
+gst_camerasrc_metrics_start(const gchar *endpoint)
+{
+  metrics_fd = gst_camerasrc_metrics_listen(endpoint);
+  if (metrics_fd < 0)
+    return FALSE;
+
+  if (pipe2(metrics_wake, O_CLOEXEC) < 0) {
+    close(metrics_fd);
+    metrics_fd = -1;
+    gst_camerasrc_metrics_remove_path();
+    return FALSE;
+  }
+
+  metrics_endpoint = g_strdup(endpoint);
+  metrics_thread = g_thread_new("icamerasrc-metrics", gst_camerasrc_metrics_thread,
+    GINT_TO_POINTER(metrics_fd));
+
+  return TRUE;
+}
+
+/* Called with metrics_state_lock, the thread may be collecting or
+ * answering a client, the wake pipe interrupts it and the client socket
+ * is closed before the thread returns */
+static void
+gst_camerasrc_metrics_stop(void)
+{
+  if (write(metrics_wake[1], "", 1) < 0)
+    GST_WARNING("failed to wake the metrics exporter: %s.", g_strerror(errno));
+  g_thread_join(metrics_thread);
+  metrics_thread = NULL;
+
+  close(metrics_wake[0]);
+  close(metrics_wake[1]);
+  metrics_wake[0] = metrics_wake[1] = -1;
+  close(metrics_fd);
+  metrics_fd = -1;
+  gst_camerasrc_metrics_remove_path();
+
+  GST_INFO("metrics no longer exported on %s.", metrics_endpoint);
+  g_free(metrics_endpoint);
+  metrics_endpoint = NULL;
+}
+
+/**
+ * Add an instance to the exporter, which is started by the first instance
+ * having an endpoint and stopped when the last one is removed.
+ */
+void
+gst_camerasrc_metrics_register(Gstcamerasrc *camerasrc)
+{
+  const gchar *endpoint = camerasrc->metrics_endpoint ?
+    camerasrc->metrics_endpoint : g_getenv(GST_CAMERASRC_METRICS_ENV);
+
+  if (!endpoint || !*endpoint)
+    return;
+
+  g_mutex_lock(&metrics_state_lock);
+  if (metrics_fd < 0) {
+    if (!gst_camerasrc_metrics_start(endpoint)) {
+      GST_ERROR("CameraId=%d failed to listen on metrics endpoint %s.",
+        camerasrc->device_id, endpoint);
+      g_mutex_unlock(&metrics_state_lock);
+      return;
+    }
+    GST_INFO("CameraId=%d metrics exported on %s.", camerasrc->device_id, endpoint);
+  } else if (g_strcmp0(endpoint, metrics_endpoint) != 0) {
+    GST_WARNING("CameraId=%d metrics are already exported on %s, %s is ignored.",
+      camerasrc->device_id, metrics_endpoint, endpoint);
+  }
+
+  g_mutex_lock(&metrics_lock);
+  if (!g_list_find(metrics_instances, camerasrc))
+    metrics_instances = g_list_prepend(metrics_instances, camerasrc);
+  g_mutex_unlock(&metrics_lock);
+  g_mutex_unlock(&metrics_state_lock);
+}
+
+/* Once this returns, the exporter no longer reads the instance */
+void
+gst_camerasrc_metrics_unregister(Gstcamerasrc *camerasrc)
+{
+  gboolean last;
+
+  g_mutex_lock(&metrics_state_lock);
+  g_mutex_lock(&metrics_lock);
+  metrics_instances = g_list_remove(metrics_instances, camerasrc);
+  last = metrics_instances == NULL;
+  g_mutex_unlock(&metrics_lock);
+
+  if (last && metrics_thread)
+    gst_camerasrc_metrics_stop();
+  g_mutex_unlock(&metrics_state_lock);
+}
@@ -0,0 +1,481 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraPair"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "gstcamerasrc.h"
+#include "gstcamerastats.h"
+#include "gstcamerapair.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+GType
+gst_camerasrc_capture_meta_api_get_type(void)
+{
+  static volatile GType type;
+  /* not tied to the memory or the format, kept by the transforms */
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter(&type)) {
+    GType _type = gst_meta_api_type_register("GstCamerasrcCaptureMetaAPI", tags);
+    g_once_init_leave(&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_camerasrc_capture_meta_transform(GstBuffer *dest, GstMeta *meta,
+    GstBuffer *buffer, GQuark type, gpointer data)
+{
+  GstCamerasrcCaptureMeta *smeta = (GstCamerasrcCaptureMeta *)meta;
+  GstCamerasrcCaptureMeta *dmeta = GST_CAMERASRC_CAPTURE_META_ADD(dest);
+
+  if (!dmeta)
+    return FALSE;
+
+  dmeta->capture_id = smeta->capture_id;
+  dmeta->stream_id = smeta->stream_id;
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_camerasrc_capture_meta_get_info(void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter(&meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register(gst_camerasrc_capture_meta_api_get_type(), "GstCamerasrcCaptureMeta",
+        sizeof(GstCamerasrcCaptureMeta), (GstMetaInitFunction) NULL,
+        (GstMetaFreeFunction) NULL, gst_camerasrc_capture_meta_transform);
+    g_once_init_leave(&meta_info, meta);
+  }
+  return meta_info;
+}
+
+/* The meta stays on the pool buffers, it is updated at every fill */
+void
+gst_camerasrc_pair_set_capture(Gstcamerasrc *camerasrc, int stream_id, GstBuffer *buf)
+{
+  GstCamerasrcCaptureMeta *meta = GST_CAMERASRC_CAPTURE_META_GET(buf);
+
+  if (!meta) {
+    meta = GST_CAMERASRC_CAPTURE_META_ADD(buf);
+    GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+  }
+  meta->capture_id = GST_CAMERASRC_CAPTURE_ID(camerasrc->streams[stream_id].reconfig_count,
+      camerasrc->streams[stream_id].sequence);
+  meta->stream_id = stream_id;
+}
+
+GType
+gst_camerasrc_pair_meta_api_get_type(void)
+{
+  static volatile GType type;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter(&type)) {
+    GType _type = gst_meta_api_type_register("GstCamerasrcPairMetaAPI", tags);
+    g_once_init_leave(&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_camerasrc_pair_meta_init(GstMeta *meta, gpointer params, GstBuffer *buffer)
+{
+  GstCamerasrcPairMeta *pmeta = (GstCamerasrcPairMeta *)meta;
+
+  pmeta->capture_id = 0;
+  memset(pmeta->frames, 0, sizeof(pmeta->frames));
+  return TRUE;
+}
+
+static void
+gst_camerasrc_pair_meta_free(GstMeta *meta, GstBuffer *buffer)
+{
+  GstCamerasrcPairMeta *pmeta = (GstCamerasrcPairMeta *)meta;
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++)
+    gst_buffer_replace(&pmeta->frames[i], NULL);
+}
+
+static gboolean
+gst_camerasrc_pair_meta_transform(GstBuffer *dest, GstMeta *meta,
+    GstBuffer *buffer, GQuark type, gpointer data)
+{
+  GstCamerasrcPairMeta *smeta = (GstCamerasrcPairMeta *)meta;
+  GstCamerasrcPairMeta *dmeta = GST_CAMERASRC_PAIR_META_ADD(dest);
+
+  if (!dmeta)
+    return FALSE;
+
+  dmeta->capture_id = smeta->capture_id;
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++)
+    gst_buffer_replace(&dmeta->frames[i], smeta->frames[i]);
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_camerasrc_pair_meta_get_info(void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter(&meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register(gst_camerasrc_pair_meta_api_get_type(), "GstCamerasrcPairMeta",
+        sizeof(GstCamerasrcPairMeta), gst_camerasrc_pair_meta_init,
+        gst_camerasrc_pair_meta_free, gst_camerasrc_pair_meta_transform);
+    g_once_init_leave(&meta_info, meta);
+  }
+  return meta_info;
+}
+
+/* The pair pad is as live as the src pad, its latency is the one of the
+ * video pads */
+static gboolean
+gst_camerasrc_pair_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  if (GST_QUERY_TYPE(query) == GST_QUERY_LATENCY)
+    return gst_pad_query(GST_CAM_BASE_SRC_PAD(parent), query);
+
+  return gst_pad_query_default(pad, parent, query);
+}
+
+/* stream-start in the group of the video pads, caps and the segment of the
+ * src pad the pts of the frames are in, with the STREAM_LOCK of the pad */
+static void
+gst_camerasrc_pair_start_stream(Gstcamerasrc *camerasrc, GstPad *pad)
+{
+  GstPad *srcpad = GST_CAM_BASE_SRC_PAD(camerasrc);
+  GstEvent *event, *start;
+  GstCaps *caps;
+  gchar *stream_id;
+  guint group_id;
+
+  stream_id = gst_pad_create_stream_id(pad, GST_ELEMENT(camerasrc), GST_CAMERASRC_PAIR_PAD_NAME);
+  event = gst_event_new_stream_start(stream_id);
+  g_free(stream_id);
+  start = gst_pad_get_sticky_event(srcpad, GST_EVENT_STREAM_START, 0);
+  if (start) {
+    if (gst_event_parse_group_id(start, &group_id))
+      gst_event_set_group_id(event, group_id);
+    gst_event_unref(start);
+  }
+  gst_pad_push_event(pad, event);
+
+  caps = gst_caps_from_string(GST_CAMERASRC_PAIR_CAPS);
+  gst_pad_push_event(pad, gst_event_new_caps(caps));
+  gst_caps_unref(caps);
+
+  event = gst_pad_get_sticky_event(srcpad, GST_EVENT_SEGMENT, 0);
+  if (!event) {
+    GstSegment segment;
+    gst_segment_init(&segment, GST_FORMAT_TIME);
+    event = gst_event_new_segment(&segment);
+  }
+  gst_pad_push_event(pad, event);
+
+  camerasrc->pair_events_sent = TRUE;
+}
+
+/* EOS and flushes of the src pad end or flush the pair pad too */
+static GstPadProbeReturn
+gst_camerasrc_pair_event_probe(GstPad *srcpad, GstPadProbeInfo *info, gpointer user_data)
+{
+  Gstcamerasrc *camerasrc = GST_CAMERASRC(user_data);
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  GstPad *pad = camerasrc->pair_pad;
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_FLUSH_START:
+      gst_pad_push_event(pad, gst_event_ref(event));
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      GST_PAD_STREAM_LOCK(pad);
+      gst_pad_push_event(pad, gst_event_ref(event));
+      /* the segment is sent again with the next set */
+      camerasrc->pair_events_sent = FALSE;
+      GST_PAD_STREAM_UNLOCK(pad);
+      break;
+    case GST_EVENT_EOS:
+      GST_PAD_STREAM_LOCK(pad);
+      if (!camerasrc->pair_events_sent)
+        gst_camerasrc_pair_start_stream(camerasrc, pad);
+      gst_pad_push_event(pad, gst_event_ref(event));
+      GST_PAD_STREAM_UNLOCK(pad);
+      break;
+    default:
+      break;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Called while stopped, the streaming threads read pair_pad without lock */
+GstPad *
+gst_camerasrc_pair_add_pad(Gstcamerasrc *camerasrc, GstPadTemplate *templ)
+{
+  GstPad *pad;
+
+  if (camerasrc->pair_pad) {
+    GST_ERROR("CameraId=%d pair pad already requested.", camerasrc->device_id);
+    return NULL;
+  }
+
+  pad = gst_pad_new_from_template(templ, GST_CAMERASRC_PAIR_PAD_NAME);
+  gst_pad_set_query_function(pad, gst_camerasrc_pair_query);
+  gst_pad_use_fixed_caps(pad);
+  if (!gst_element_add_pad(GST_ELEMENT(camerasrc), pad))
+    return NULL;
+
+  camerasrc->pair_probe = gst_pad_add_probe(GST_CAM_BASE_SRC_PAD(camerasrc),
+      (GstPadProbeType)(GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+      gst_camerasrc_pair_event_probe, camerasrc, NULL);
+  camerasrc->pair_pad = pad;
+
+  return pad;
+}
+
+void
+gst_camerasrc_pair_remove_pad(Gstcamerasrc *camerasrc, GstPad *pad)
+{
+  gst_pad_remove_probe(GST_CAM_BASE_SRC_PAD(camerasrc), camerasrc->pair_probe);
+  camerasrc->pair_probe = 0;
+  camerasrc->pair_pad = NULL;
+
+  gst_pad_set_active(pad, FALSE);
+  gst_element_remove_pad(GST_ELEMENT(camerasrc), pad);
+}
+
+/* Count the streams missing in the set and give its frames to be released
+ * once pair_lock is dropped */
+static void
+gst_camerasrc_pair_drop(Gstcamerasrc *camerasrc, GstCameraPairSet *set,
+    GstBuffer **release, guint *n_release)
+{
+  guint missing = set->expected & ~set->members;
+
+  GST_DEBUG("CameraId=%d capture %" G_GUINT64_FORMAT " not paired, missing streams 0x%x.",
+      camerasrc->device_id, set->capture_id, missing);
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    if (missing & (1u << i))
+      GST_CAMERASRC_STATS_ADD(camerasrc->streams[i].stats.unpaired, 1);
+    if (set->frames[i]) {
+      release[(*n_release)++] = set->frames[i];
+      set->frames[i] = NULL;
+    }
+  }
+  set->expected = 0;
+  set->members = 0;
+}
+
+static void
+gst_camerasrc_pair_released(gpointer data, GstMiniObject *pair)
+{
+  Gstcamerasrc *camerasrc = GST_CAMERASRC(data);
+
+  g_atomic_int_add(&camerasrc->pair_pending, -1);
+  gst_object_unref(camerasrc);
+}
+
+/* The frames of a complete set move to the meta of a new empty buffer,
+ * pending until it is released */
+static GstBuffer *
+gst_camerasrc_pair_take(Gstcamerasrc *camerasrc, GstCameraPairSet *set)
+{
+  GstBuffer *pair = gst_buffer_new();
+  GstCamerasrcPairMeta *meta = GST_CAMERASRC_PAIR_META_ADD(pair);
+  GstBuffer *first = NULL;
+
+  meta->capture_id = set->capture_id;
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    meta->frames[i] = set->frames[i];
+    set->frames[i] = NULL;
+    if (!first)
+      first = meta->frames[i];
+  }
+  GST_BUFFER_PTS(pair) = GST_BUFFER_PTS(first);
+  GST_BUFFER_DURATION(pair) = GST_BUFFER_DURATION(first);
+  GST_BUFFER_OFFSET(pair) = set->capture_id;
+  set->expected = 0;
+  set->members = 0;
+
+  g_atomic_int_inc(&camerasrc->pair_pending);
+  gst_mini_object_weak_ref(GST_MINI_OBJECT_CAST(pair), gst_camerasrc_pair_released,
+      gst_object_ref(camerasrc));
+
+  return pair;
+}
+
+static void
+gst_camerasrc_pair_push(Gstcamerasrc *camerasrc, GstBuffer *pair)
+{
+  GstPad *pad = camerasrc->pair_pad;
+  guint64 capture_id = GST_BUFFER_OFFSET(pair);
+  GstFlowReturn ret;
+
+  GST_PAD_STREAM_LOCK(pad);
+  /* sets completed by different video pads can get here out of order */
+  if (camerasrc->pair_pushed && capture_id <= camerasrc->pair_last_capture) {
+    GST_DEBUG("CameraId=%d capture %" G_GUINT64_FORMAT " completed after %" G_GUINT64_FORMAT
+        ", dropped.", camerasrc->device_id, capture_id, camerasrc->pair_last_capture);
+    GST_PAD_STREAM_UNLOCK(pad);
+    gst_buffer_unref(pair);
+    return;
+  }
+  if (!camerasrc->pair_events_sent)
+    gst_camerasrc_pair_start_stream(camerasrc, pad);
+  camerasrc->pair_pushed = TRUE;
+  camerasrc->pair_last_capture = capture_id;
+  ret = gst_pad_push(pad, pair);
+  GST_PAD_STREAM_UNLOCK(pad);
+
+  if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_FLUSHING)
+    GST_WARNING("CameraId=%d failed to push capture %" G_GUINT64_FORMAT " on pair pad: %s.",
+        camerasrc->device_id, capture_id, gst_flow_get_name(ret));
+}
+
+/**
+ * The frames are referenced once the base class is done with them, so the
+ * video pads push them unchanged and without copy. Frames of a stream come
+ * in capture order, the older sets still expecting it can't complete and
+ * are dropped. The pad completing a set pushes it, in multiplexed mode all
+ * the frames of a capture are pushed by the same thread. No set is started
+ * while GST_CAMERASRC_PAIR_MAX_PENDING pair buffers hold pool buffers, a
+ * slow pair branch doesn't starve the video pads.
+ */
+void
+gst_camerasrc_pair_offer(Gstcamerasrc *camerasrc, int stream_id, GstBuffer *buf)
+{
+  GstCamerasrcCaptureMeta *meta;
+  GstCameraPairSet *set;
+  GstBuffer *release[GST_CAMERASRC_PAIR_SETS * GST_CAMERASRC_MAX_STREAM_NUM];
+  guint n_release = 0;
+  GstBuffer *pair = NULL;
+  guint64 capture_id;
+  guint expected = 0;
+
+  if (!camerasrc->pair_pad)
+    return;
+  meta = GST_CAMERASRC_CAPTURE_META_GET(buf);
+  if (!meta)
+    return;
+
+  capture_id = meta->capture_id;
+  for (int i = 0; i < camerasrc->number_of_activepads; i++) {
+    if (GST_CAMERASRC_STREAM_KEEPS(&camerasrc->streams[i],
+            GST_CAMERASRC_CAPTURE_SEQUENCE(capture_id)))
+      expected |= 1u << i;
+  }
+  /* nothing to pair a capture pushed by one pad only with */
+  if (!(expected & (1u << stream_id)) || !(expected & (expected - 1)))
+    return;
+
+  g_mutex_lock(&camerasrc->pair_lock);
+  for (int i = 0; i < GST_CAMERASRC_PAIR_SETS; i++) {
+    set = &camerasrc->pair_sets[i];
+    if (set->expected && set->capture_id < capture_id &&
+        (set->expected & ~set->members & (1u << stream_id)))
+      gst_camerasrc_pair_drop(camerasrc, set, release, &n_release);
+  }
+
+  set = &camerasrc->pair_sets[capture_id % GST_CAMERASRC_PAIR_SETS];
+  if (set->expected && set->capture_id > capture_id) {
+    GST_DEBUG("CameraId=%d, StreamId=%d capture %" G_GUINT64_FORMAT " too late to pair.",
+        camerasrc->device_id, stream_id, capture_id);
+    GST_CAMERASRC_STATS_ADD(camerasrc->streams[stream_id].stats.unpaired, 1);
+  } else {
+    if (set->expected && set->capture_id != capture_id)
+      gst_camerasrc_pair_drop(camerasrc, set, release, &n_release);
+    if (!set->expected &&
+        g_atomic_int_get(&camerasrc->pair_pending) >= GST_CAMERASRC_PAIR_MAX_PENDING) {
+      GST_DEBUG("CameraId=%d, StreamId=%d capture %" G_GUINT64_FORMAT " not paired, "
+          "%d pair buffers pending.", camerasrc->device_id, stream_id, capture_id,
+          GST_CAMERASRC_PAIR_MAX_PENDING);
+      GST_CAMERASRC_STATS_ADD(camerasrc->streams[stream_id].stats.unpaired, 1);
+    } else if (!set->expected) {
+      set->capture_id = capture_id;
+      set->expected = expected;
+    }
+    /* a frame duplicated by HAL is already in the set */
+    if (set->expected && !(set->members & (1u << stream_id))) {
+      set->frames[stream_id] = gst_buffer_ref(buf);
+      set->members |= 1u << stream_id;
+      if (set->members == set->expected)
+        pair = gst_camerasrc_pair_take(camerasrc, set);
+    }
+  }
+  g_mutex_unlock(&camerasrc->pair_lock);
+
+  for (guint i = 0; i < n_release; i++)
+    gst_buffer_unref(release[i]);
+  if (pair)
+    gst_camerasrc_pair_push(camerasrc, pair);
+}
+
+/* Buffers go back to their pools before these are stopped */
+void
+gst_camerasrc_pair_clear(Gstcamerasrc *camerasrc)
+{
+  g_mutex_lock(&camerasrc->pair_lock);
+  for (int i = 0; i < GST_CAMERASRC_PAIR_SETS; i++) {
+    GstCameraPairSet *set = &camerasrc->pair_sets[i];
+
+    for (int j = 0; j < GST_CAMERASRC_MAX_STREAM_NUM; j++)
+      gst_buffer_replace(&set->frames[j], NULL);
+    set->expected = 0;
+    set->members = 0;
+  }
+  g_mutex_unlock(&camerasrc->pair_lock);
+
+  camerasrc->pair_events_sent = FALSE;
+  camerasrc->pair_pushed = FALSE;
+}
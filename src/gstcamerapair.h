@@ -0,0 +1,111 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+
+#ifndef __GST_CAMERASRC_PAIR_H__
+#define __GST_CAMERASRC_PAIR_H__
+
+#include <gst/gst.h>
+#include "gstcamerasrc.h"
+
+typedef struct _GstCamerasrcCaptureMeta GstCamerasrcCaptureMeta;
+typedef struct _GstCamerasrcPairMeta GstCamerasrcPairMeta;
+
+/* Request pad pushing the frames of the video pads from the same capture
+ * together, as empty buffers carrying a GstCamerasrcPairMeta */
+#define GST_CAMERASRC_PAIR_PAD_NAME "pair"
+#define GST_CAMERASRC_PAIR_CAPS "application/x-icamerasrc-pair"
+
+#define GST_CAMERASRC_CAPTURE_META_GET(buf) ((GstCamerasrcCaptureMeta *)gst_buffer_get_meta(buf,gst_camerasrc_capture_meta_api_get_type()))
+#define GST_CAMERASRC_CAPTURE_META_ADD(buf) ((GstCamerasrcCaptureMeta *)gst_buffer_add_meta(buf,gst_camerasrc_capture_meta_get_info(),NULL))
+
+#define GST_CAMERASRC_PAIR_META_GET(buf) ((GstCamerasrcPairMeta *)gst_buffer_get_meta(buf,gst_camerasrc_pair_meta_api_get_type()))
+#define GST_CAMERASRC_PAIR_META_ADD(buf) ((GstCamerasrcPairMeta *)gst_buffer_add_meta(buf,gst_camerasrc_pair_meta_get_info(),NULL))
+
+/* Capture id of the HAL sequence seq after reconfig_count reconfigurations
+ * of the device, it keeps increasing when the sequence restarts */
+#define GST_CAMERASRC_CAPTURE_ID(reconfig_count, seq) \
+  (((guint64)(guint32)(reconfig_count) << 32) | (guint32)(seq))
+#define GST_CAMERASRC_CAPTURE_SEQUENCE(capture_id) ((guint32)(capture_id))
+
+/* Capture a buffer comes from, the same on the buffers of all the pads
+ * for one capture. Applications find the API by its name with
+ * g_type_from_name("GstCamerasrcCaptureMetaAPI") */
+struct _GstCamerasrcCaptureMeta {
+  GstMeta meta;
+
+  /* reconfigurations of the device in the upper 32 bits and HAL sequence
+   * of the capture in the lower ones, see GST_CAMERASRC_CAPTURE_ID */
+  guint64 capture_id;
+  gint stream_id;
+};
+
+/* Frames of one capture on the buffers of the pair pad, by stream id and
+ * NULL for the streams decimating the capture. The frames are the buffers
+ * pushed on the video pads, they must not be modified and are held until
+ * the pair buffer is released. They come from the pools of the video pads,
+ * so while GST_CAMERASRC_PAIR_MAX_PENDING pair buffers are not released the
+ * captures are not paired and the video pads keep streaming. Found by the
+ * name "GstCamerasrcPairMetaAPI" */
+struct _GstCamerasrcPairMeta {
+  GstMeta meta;
+
+  guint64 capture_id;
+  GstBuffer *frames[GST_CAMERASRC_MAX_STREAM_NUM];
+};
+
+GType gst_camerasrc_capture_meta_api_get_type(void);
+const GstMetaInfo *gst_camerasrc_capture_meta_get_info(void);
+GType gst_camerasrc_pair_meta_api_get_type(void);
+const GstMetaInfo *gst_camerasrc_pair_meta_get_info(void);
+
+void gst_camerasrc_pair_set_capture(Gstcamerasrc *camerasrc, int stream_id, GstBuffer *buf);
+GstPad *gst_camerasrc_pair_add_pad(Gstcamerasrc *camerasrc, GstPadTemplate *templ);
+void gst_camerasrc_pair_remove_pad(Gstcamerasrc *camerasrc, GstPad *pad);
+/* Add a frame about to be pushed on its pad to the set of its capture,
+ * the set is pushed on the pair pad by the pad completing it */
+void gst_camerasrc_pair_offer(Gstcamerasrc *camerasrc, int stream_id, GstBuffer *buf);
+void gst_camerasrc_pair_clear(Gstcamerasrc *camerasrc);
+
+#endif /* __GST_CAMERASRC_PAIR_H__ */
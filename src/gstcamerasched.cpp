@@ -0,0 +1,290 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraSched"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "gstcamerasrc.h"
+#include "gstcamerastats.h"
+#include "gstcamerasched.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+/* Settings the thread had before entering the task, and the scheduler
+ * statistics of the thread used to sample how long it waited to run */
+class GstCameraSchedThread
+{
+public:
+  int schedstat_fd = -1;
+  guint64 run_delay = 0;
+  gboolean policy_changed = FALSE;
+  int policy = SCHED_OTHER;
+  struct sched_param param;
+  gboolean nice_changed = FALSE;
+  int nice_level = 0;
+  gboolean cpus_changed = FALSE;
+  cpu_set_t cpus;
+  ~GstCameraSchedThread() {
+    if (schedstat_fd >= 0)
+      close(schedstat_fd);
+  }
+};
+
+static thread_local GstCameraSchedThread sched_thread;
+
+static const gchar *
+gst_camerasrc_sched_policy_name(int policy)
+{
+  switch (policy) {
+    case SCHED_FIFO:
+      return "SCHED_FIFO";
+    case SCHED_RR:
+      return "SCHED_RR";
+    default:
+      return "SCHED_OTHER";
+  }
+}
+
+/* Parse a list of cpus and ranges like "0-3,6" */
+static gboolean
+gst_camerasrc_sched_parse_cpus(const gchar *cpus, cpu_set_t *set)
+{
+  gchar **ranges = g_strsplit(cpus, ",", -1);
+  gboolean ret = TRUE;
+
+  CPU_ZERO(set);
+  for (gchar **range = ranges; ret && *range; range++) {
+    gchar *start = g_strstrip(*range), *end;
+    guint64 first = g_ascii_strtoull(start, &end, 10), last = first;
+
+    if (end == start) {
+      ret = FALSE;
+      break;
+    }
+    if (*end == '-') {
+      start = end + 1;
+      last = g_ascii_strtoull(start, &end, 10);
+      if (end == start)
+        ret = FALSE;
+    }
+    if (*end != '\0' || first > last || last >= CPU_SETSIZE)
+      ret = FALSE;
+    for (guint64 cpu = first; ret && cpu <= last; cpu++)
+      CPU_SET(cpu, set);
+  }
+  g_strfreev(ranges);
+
+  return ret && CPU_COUNT(set) > 0;
+}
+
+/* Time in ns the thread has spent runnable but waiting for a cpu */
+static gboolean
+gst_camerasrc_sched_run_delay(guint64 *run_delay)
+{
+  char buf[64];
+  char *end;
+
+  ssize_t len = pread(sched_thread.schedstat_fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    return FALSE;
+  buf[len] = '\0';
+
+  /* "<time on cpu> <time waiting on a runqueue> <timeslices>" */
+  strtoull(buf, &end, 10);
+  *run_delay = strtoull(end, NULL, 10);
+  return TRUE;
+}
+
+/**
+ * Apply the sched-policy, sched-priority, sched-nice and cpu-affinity
+ * properties to the calling thread. Without the privileges for a real-time
+ * policy or a negative nice level, the thread keeps running under
+ * SCHED_OTHER with a warning.
+ */
+void
+gst_camerasrc_sched_enter(Gstcamerasrc *camerasrc, const gchar *thread)
+{
+  pthread_t self = pthread_self();
+  int ret;
+
+  GST_OBJECT_LOCK(camerasrc);
+  int policy = camerasrc->sched_policy;
+  int priority = camerasrc->sched_priority;
+  int nice_level = camerasrc->sched_nice;
+  gchar *cpus = g_strdup(camerasrc->cpu_affinity);
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  if (cpus) {
+    cpu_set_t set;
+    if (!gst_camerasrc_sched_parse_cpus(cpus, &set)) {
+      GST_WARNING("CameraId=%d, invalid cpu-affinity '%s'", camerasrc->device_id, cpus);
+    } else if (!sched_thread.cpus_changed &&
+        pthread_getaffinity_np(self, sizeof(sched_thread.cpus), &sched_thread.cpus) != 0) {
+      GST_WARNING("CameraId=%d, failed to get the cpu affinity of %s", camerasrc->device_id, thread);
+    } else if ((ret = pthread_setaffinity_np(self, sizeof(set), &set)) != 0) {
+      GST_WARNING("CameraId=%d, failed to set the cpu affinity of %s to %s: %s",
+          camerasrc->device_id, thread, cpus, strerror(ret));
+    } else {
+      sched_thread.cpus_changed = TRUE;
+    }
+    g_free(cpus);
+  }
+
+  switch (policy) {
+    case GST_CAMERASRC_SCHED_POLICY_FIFO:
+      policy = SCHED_FIFO;
+      break;
+    case GST_CAMERASRC_SCHED_POLICY_RR:
+      policy = SCHED_RR;
+      break;
+    default:
+      policy = SCHED_OTHER;
+      break;
+  }
+
+  if (policy != SCHED_OTHER) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = CLAMP(priority, sched_get_priority_min(policy),
+        sched_get_priority_max(policy));
+
+    if (!sched_thread.policy_changed)
+      pthread_getschedparam(self, &sched_thread.policy, &sched_thread.param);
+    ret = pthread_setschedparam(self, policy, &param);
+    if (ret == 0) {
+      sched_thread.policy_changed = TRUE;
+      GST_INFO("CameraId=%d, %s runs under %s priority %d", camerasrc->device_id,
+          thread, gst_camerasrc_sched_policy_name(policy), param.sched_priority);
+    } else {
+      GST_WARNING("CameraId=%d, failed to run %s under %s: %s, keeping SCHED_OTHER",
+          camerasrc->device_id, thread, gst_camerasrc_sched_policy_name(policy), strerror(ret));
+      policy = SCHED_OTHER;
+    }
+  }
+
+  if (policy == SCHED_OTHER && nice_level != 0) {
+    pid_t tid = gettid();
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, tid);
+    if (errno == 0 && setpriority(PRIO_PROCESS, tid, nice_level) == 0) {
+      if (!sched_thread.nice_changed)
+        sched_thread.nice_level = current;
+      sched_thread.nice_changed = TRUE;
+      GST_INFO("CameraId=%d, %s runs at nice level %d", camerasrc->device_id, thread, nice_level);
+    } else {
+      GST_WARNING("CameraId=%d, failed to set the nice level of %s to %d: %s",
+          camerasrc->device_id, thread, nice_level, strerror(errno));
+    }
+  }
+
+  if (sched_thread.schedstat_fd < 0) {
+    gchar *path = g_strdup_printf("/proc/self/task/%d/schedstat", (int)gettid());
+    sched_thread.schedstat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    g_free(path);
+  }
+  if (sched_thread.schedstat_fd >= 0 &&
+      !gst_camerasrc_sched_run_delay(&sched_thread.run_delay)) {
+    close(sched_thread.schedstat_fd);
+    sched_thread.schedstat_fd = -1;
+  }
+}
+
+/**
+ * Give the thread back its previous scheduling, task threads are shared
+ * with other elements through the default task pool
+ */
+void
+gst_camerasrc_sched_leave(Gstcamerasrc *camerasrc)
+{
+  pthread_t self = pthread_self();
+
+  if (sched_thread.policy_changed &&
+      pthread_setschedparam(self, sched_thread.policy, &sched_thread.param) != 0)
+    GST_WARNING("CameraId=%d, failed to restore the thread scheduling policy", camerasrc->device_id);
+  if (sched_thread.nice_changed &&
+      setpriority(PRIO_PROCESS, gettid(), sched_thread.nice_level) != 0)
+    GST_WARNING("CameraId=%d, failed to restore the thread nice level", camerasrc->device_id);
+  if (sched_thread.cpus_changed &&
+      pthread_setaffinity_np(self, sizeof(sched_thread.cpus), &sched_thread.cpus) != 0)
+    GST_WARNING("CameraId=%d, failed to restore the thread cpu affinity", camerasrc->device_id);
+
+  sched_thread.policy_changed = FALSE;
+  sched_thread.nice_changed = FALSE;
+  sched_thread.cpus_changed = FALSE;
+  if (sched_thread.schedstat_fd >= 0) {
+    close(sched_thread.schedstat_fd);
+    sched_thread.schedstat_fd = -1;
+  }
+}
+
+/**
+ * Record in histogram the time the calling thread waited for a cpu since
+ * its previous frame, read from its schedstat at every frame. Only threads
+ * that entered a task of the element read their schedstat.
+ */
+void
+gst_camerasrc_sched_sample(Gstcamerasrc *camerasrc, GstLatencyHistogram *histogram)
+{
+  guint64 run_delay;
+
+  if (sched_thread.schedstat_fd < 0)
+    return;
+
+  if (gst_camerasrc_sched_run_delay(&run_delay)) {
+    gst_camerasrc_histogram_record(histogram, run_delay - sched_thread.run_delay);
+    sched_thread.run_delay = run_delay;
+  }
+}
@@ -54,12 +54,14 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <new>
 #include <gst/video/gstvideometa.h>
 #include <gst/video/gstvideopool.h>
 #include <gst/gst.h>
 
 #include "ICamera.h"
 #include "ScopedAtrace.h"
+#include "gstcameratrace.h"
 
 #include "gstcamerasrcbufferpool.h"
 #include "gstcamerasrc.h"
@@ -68,6 +70,16 @@
 #include "gstcameraispinterface.h"
 #include "gstcameradewarpinginterface.h"
 #include "gstcamerawfovinterface.h"
+#include "gstcamera3astate.h"
+#include "gstcameraclock.h"
+#include "gstcamerastats.h"
+#include "gstcamerametrics.h"
+#include "gstcameratracer.h"
+#include "gstcamerasched.h"
+#include "gstcamerataskpool.h"
+#include "gstcamerasync.h"
+#include "gstcamerapair.h"
+#include "gstcameraconfig.h"
 #include "utils.h"
 
 using namespace icamera;
@@ -147,8 +159,34 @@ enum
   PROP_ISP_CONTROL,
   PROP_FISHEYE_DEWARPING_MODE,
   PROP_LTM_TUNING_DATA,
+  PROP_3A_STATE_DIR,
+  PROP_3A_CONVERGE_FRAMES,
+  PROP_STARTUP_FRAMES,
+  PROP_STARTUP_FRAME_BUDGET,
+  PROP_TIMESTAMP_MODE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_METRICS_ENDPOINT,
+  PROP_TRACE_FILE,
+  PROP_SCHED_POLICY,
+  PROP_SCHED_PRIORITY,
+  PROP_SCHED_NICE,
+  PROP_CPU_AFFINITY,
+  PROP_TASK_POOL_SIZE,
+  PROP_SYNC_GROUP,
+  PROP_SYNC_TOLERANCE,
+  PROP_SYNC_GROUP_SIZE,
+  PROP_DECIMATION,
 };
 
+enum
+{
+  SIGNAL_DUMP_TRACE,
+  LAST_SIGNAL
+};
+
+static guint gst_camerasrc_signals[LAST_SIGNAL] = { 0 };
+
 #define gst_camerasrc_parent_class parent_class
 
 static void gst_camerasrc_3a_interface_init (GstCamerasrc3AInterface *iface);
@@ -174,14 +212,18 @@ static gboolean gst_camerasrc_stop(GstCamBaseSrc *basesrc);
 static GstStateChangeReturn gst_camerasrc_change_state(GstElement * element,GstStateChange transition);
 static GstCaps *gst_camerasrc_fixate (GstCamBaseSrc * basesrc, GstCaps * caps);
 static gboolean gst_camerasrc_negotiate(GstCamBaseSrc *basesrc, GstPad *pad);
-static gboolean gst_camerasrc_query(GstCamBaseSrc * bsrc, GstQuery * query );
+static gboolean gst_camerasrc_post_message(GstElement *element, GstMessage *message);
+static gboolean gst_camerasrc_query(GstCamBaseSrc * bsrc, GstPad *pad, GstQuery * query );
+static gboolean gst_camerasrc_dump_trace(Gstcamerasrc *camerasrc, const gchar *path);
 static gboolean gst_camerasrc_decide_allocation(GstCamBaseSrc *bsrc,GstQuery *query, GstPad *pad);
 static GstFlowReturn gst_camerasrc_fill(GstCamPushSrc *src, GstPad *pad, GstBuffer *buf);
 static void gst_camerasrc_dispose(GObject *object);
 static gboolean gst_camerasrc_unlock(GstCamBaseSrc *src);
 static gboolean gst_camerasrc_unlock_stop(GstCamBaseSrc *src);
+static GstClockTime gst_camerasrc_get_ready_time(GstCamBaseSrc *src, GstPad *pad);
+static void gst_camerasrc_pre_push(GstCamBaseSrc *src, GstPad *pad, GstBuffer *buf);
 static GstPad *gst_camerasrc_request_new_pad (GstElement * element,
-    GstPadTemplate * templ, const gchar * unused, const GstCaps * caps);
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
 static void gst_camerasrc_release_pad (GstElement * element, GstPad * pad);
 
 
@@ -776,6 +818,59 @@ gst_camerasrc_buffer_usage_get_type(void)
   return buffer_usage_type;
 }
 
+static GType
+gst_camerasrc_startup_frames_mode_get_type(void)
+{
+  PERF_CAMERA_ATRACE();
+  static GType startup_frames_mode_type = 0;
+
+  if (!startup_frames_mode_type) {
+    static GEnumValue method_types[] = {
+      {GST_CAMERASRC_STARTUP_FRAMES_PUSH, "Push all frames", "push"},
+      {GST_CAMERASRC_STARTUP_FRAMES_DROP, "Drop frames until 3A converged", "drop"},
+      {GST_CAMERASRC_STARTUP_FRAMES_FLAG, "Flag frames until 3A converged", "flag"},
+      {0, NULL, NULL},
+    };
+    startup_frames_mode_type = g_enum_register_static ("GstCamerasrcStartupFramesMode", method_types);
+  }
+  return startup_frames_mode_type;
+}
+
+static GType
+gst_camerasrc_timestamp_mode_get_type(void)
+{
+  PERF_CAMERA_ATRACE();
+  static GType timestamp_mode_type = 0;
+
+  if (!timestamp_mode_type) {
+    static GEnumValue method_types[] = {
+      {GST_CAMERASRC_TIMESTAMP_MODE_CLOCK, "Pipeline clock when the frame is pushed", "clock"},
+      {GST_CAMERASRC_TIMESTAMP_MODE_CAPTURE, "Capture time mapped to the pipeline clock", "capture"},
+      {0, NULL, NULL},
+    };
+    timestamp_mode_type = g_enum_register_static ("GstCamerasrcTimestampMode", method_types);
+  }
+  return timestamp_mode_type;
+}
+
+static GType
+gst_camerasrc_sched_policy_get_type(void)
+{
+  PERF_CAMERA_ATRACE();
+  static GType sched_policy_type = 0;
+
+  if (!sched_policy_type) {
+    static GEnumValue method_types[] = {
+      {GST_CAMERASRC_SCHED_POLICY_OTHER, "Default time sharing (SCHED_OTHER)", "other"},
+      {GST_CAMERASRC_SCHED_POLICY_FIFO, "Real-time first in first out (SCHED_FIFO)", "fifo"},
+      {GST_CAMERASRC_SCHED_POLICY_RR, "Real-time round robin (SCHED_RR)", "rr"},
+      {0, NULL, NULL},
+    };
+    sched_policy_type = g_enum_register_static ("GstCamerasrcSchedPolicy", method_types);
+  }
+  return sched_policy_type;
+}
+
 static void
 gst_camerasrc_dispose(GObject *object)
 {
@@ -794,6 +889,32 @@ gst_camerasrc_finalize (Gstcamerasrc *camerasrc)
   delete camerasrc->param;
   camerasrc->param = NULL;
 
+  delete camerasrc->result_param;
+  camerasrc->result_param = NULL;
+
+  g_free(camerasrc->state_dir);
+  camerasrc->state_dir = NULL;
+
+  g_free(camerasrc->metrics_endpoint);
+  camerasrc->metrics_endpoint = NULL;
+
+  g_free(camerasrc->trace_file);
+  camerasrc->trace_file = NULL;
+
+  g_free(camerasrc->cpu_affinity);
+  camerasrc->cpu_affinity = NULL;
+  g_free(camerasrc->sync_group);
+  camerasrc->sync_group = NULL;
+  g_free(camerasrc->decimation);
+  camerasrc->decimation = NULL;
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    gst_caps_replace(&camerasrc->streams[i].capture_caps, NULL);
+    camerasrc->streams[i].~GstStreamInfo();
+  }
+  free(camerasrc->streams);
+  camerasrc->streams = NULL;
+
   delete camerasrc->isp_control_tags;
   camerasrc->isp_control_tags = NULL;
 
@@ -802,6 +923,9 @@ gst_camerasrc_finalize (Gstcamerasrc *camerasrc)
 
   g_mutex_clear(&camerasrc->qbuf_mutex);
 
+  gst_camerasrc_pair_clear(camerasrc);
+  g_mutex_clear(&camerasrc->pair_lock);
+
   G_OBJECT_CLASS (parent_class)->finalize ((GObject *) (camerasrc));
 }
 
@@ -825,9 +949,12 @@ gst_camerasrc_class_init (GstcamerasrcClass * klass)
   gobject_class->finalize = (GObjectFinalizeFunc) gst_camerasrc_finalize;
   gobject_class->dispose = gst_camerasrc_dispose;
 
+  klass->dump_trace = gst_camerasrc_dump_trace;
+
   gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_camerasrc_change_state);
   gstelement_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_camerasrc_request_new_pad);
   gstelement_class->release_pad = GST_DEBUG_FUNCPTR(gst_camerasrc_release_pad);
+  gstelement_class->post_message = GST_DEBUG_FUNCPTR(gst_camerasrc_post_message);
 
   g_object_class_install_property(gobject_class,PROP_BUFFERCOUNT,
       g_param_spec_int("buffer-count","buffer count","The number of buffer to allocate when do the streaming",
@@ -1048,6 +1175,130 @@ gst_camerasrc_class_init (GstcamerasrcClass * klass)
       g_param_spec_string("ltm-tuning","ltm tuning","Use a file which contains the ltm tuning data",
         DEFAULT_PROP_LTM_TUNING_DATA,(GParamFlags)(G_PARAM_STATIC_STRINGS | G_PARAM_WRITABLE)));
 
+  g_object_class_install_property(gobject_class,PROP_3A_STATE_DIR,
+      g_param_spec_string("3a-state-dir","3A state directory",
+        "Directory to save the converged AE/AWB state of each device at stop, and to seed 3A from at start",
+        DEFAULT_PROP_3A_STATE_DIR,(GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_3A_CONVERGE_FRAMES,
+      g_param_spec_int("3a-converge-frames","3A converge frames",
+        "Number of frames AE/AWB took to converge since start, -1 if not converged. "
+        "Only tracked with 3a-state-dir set or startup-frames other than push",
+        -1,G_MAXINT,-1,(GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STARTUP_FRAMES,
+      g_param_spec_enum ("startup-frames", "Startup frames",
+        "How to handle frames captured before AE/AWB converged",
+        gst_camerasrc_startup_frames_mode_get_type(), DEFAULT_PROP_STARTUP_FRAMES_MODE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_STARTUP_FRAME_BUDGET,
+      g_param_spec_int("startup-frame-budget","Startup frame budget",
+        "Maximum number of startup frames dropped or flagged while waiting for AE/AWB to converge",
+        0,MAX_PROP_STARTUP_FRAME_BUDGET,DEFAULT_PROP_STARTUP_FRAME_BUDGET,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TIMESTAMP_MODE,
+      g_param_spec_enum ("timestamp-mode", "Timestamp mode",
+        "How buffer timestamps are computed",
+        gst_camerasrc_timestamp_mode_get_type(), DEFAULT_PROP_TIMESTAMP_MODE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_STATS,
+      g_param_spec_boxed("stats","Statistics",
+        "Runtime statistics of the source and of each stream",
+        GST_TYPE_STRUCTURE,(GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_STATS_INTERVAL,
+      g_param_spec_uint("stats-interval","Statistics interval",
+        "Period in ms of the element message carrying the statistics, 0 to disable",
+        0,MAX_PROP_STATS_INTERVAL,DEFAULT_PROP_STATS_INTERVAL,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_METRICS_ENDPOINT,
+      g_param_spec_string("metrics-endpoint","Metrics endpoint",
+        "Export statistics in Prometheus text format on 'unix:<path>' or 'tcp:<port>' (loopback), "
+        "shared by all instances of the process, defaults to $" GST_CAMERASRC_METRICS_ENV,
+        DEFAULT_PROP_METRICS_ENDPOINT,(GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_TRACE_FILE,
+      g_param_spec_string("trace-file","Trace file",
+        "Record the frame path log, and trace scopes with --enable-trace-export, and write "
+        "them there in Chrome trace format at stop, defaults to $" GST_CAMERASRC_TRACE_ENV,
+        DEFAULT_PROP_TRACE_FILE,(GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SCHED_POLICY,
+      g_param_spec_enum ("sched-policy", "Scheduling policy",
+        "Scheduling policy of the streaming threads, real-time policies need "
+        "CAP_SYS_NICE or RLIMIT_RTPRIO and fall back to other",
+        gst_camerasrc_sched_policy_get_type(), DEFAULT_PROP_SCHED_POLICY,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_SCHED_PRIORITY,
+      g_param_spec_int("sched-priority","Scheduling priority",
+        "Real-time priority of the streaming threads with the fifo and rr policies",
+        MIN_PROP_SCHED_PRIORITY,MAX_PROP_SCHED_PRIORITY,DEFAULT_PROP_SCHED_PRIORITY,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_SCHED_NICE,
+      g_param_spec_int("sched-nice","Nice level",
+        "Nice level of the streaming threads with the other policy, 0 to leave it unchanged",
+        MIN_PROP_SCHED_NICE,MAX_PROP_SCHED_NICE,DEFAULT_PROP_SCHED_NICE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_CPU_AFFINITY,
+      g_param_spec_string("cpu-affinity","CPU affinity",
+        "CPUs the streaming threads run on, as a list of cpus and ranges like '0-3,6'",
+        DEFAULT_PROP_CPU_AFFINITY,(GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_TASK_POOL_SIZE,
+      g_param_spec_uint("task-pool-size","Task pool size",
+        "Threads of the task pool shared by the streaming tasks of all the instances, "
+        "set by the first instance starting, a pipeline whose tasks find no free thread "
+        "fails to start, multiplex=true runs one task per instance, "
+        "0 for a thread per task (" GST_CAMERA_TASK_POOL_ENV ")",
+        0,MAX_PROP_TASK_POOL_SIZE,DEFAULT_PROP_TASK_POOL_SIZE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_SYNC_GROUP,
+      g_param_spec_string("sync-group","Sync group",
+        "Name of the group of instances in the process whose frames captured "
+        "together get the same PTS, NULL for none",
+        DEFAULT_PROP_SYNC_GROUP,(GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_SYNC_TOLERANCE,
+      g_param_spec_uint("sync-tolerance","Sync tolerance",
+        "Largest capture time distance in us of the frames of a sync group set",
+        0,MAX_PROP_SYNC_TOLERANCE,DEFAULT_PROP_SYNC_TOLERANCE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_SYNC_GROUP_SIZE,
+      g_param_spec_uint("sync-group-size","Sync group size",
+        "Instances of the sync group starting their devices together, required with sync-group",
+        0,GST_CAMERASRC_SYNC_MAX_MEMBERS,DEFAULT_PROP_SYNC_GROUP_SIZE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class,PROP_DECIMATION,
+      g_param_spec_string("decimation","Decimation",
+        "Push every Nth frame of each stream, as a list by stream id like '1,6', "
+        "streams whose caps framerate is lower than the device one are decimated to it",
+        DEFAULT_PROP_DECIMATION,(GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  /**
+   * Gstcamerasrc::dump-trace:
+   * @camerasrc: the camerasrc instance
+   * @path: file to write the trace to
+   *
+   * Write the frame path log and trace scopes recorded so far by the
+   * running threads in Chrome trace format, returns FALSE if it failed.
+   * Nothing is recorded unless an instance started with a trace file.
+   */
+  gst_camerasrc_signals[SIGNAL_DUMP_TRACE] =
+      g_signal_new("dump-trace", G_TYPE_FROM_CLASS(klass),
+        (GSignalFlags)(G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+        G_STRUCT_OFFSET(GstcamerasrcClass, dump_trace), NULL, NULL, NULL,
+        G_TYPE_BOOLEAN, 1, G_TYPE_STRING);
+
   gst_element_class_set_static_metadata(gstelement_class,
       "icamerasrc",
       "Source/Video",
@@ -1062,6 +1313,14 @@ gst_camerasrc_class_init (GstcamerasrcClass * klass)
   gst_element_class_add_pad_template
     (gstelement_class, gst_pad_template_new (GST_CAM_BASE_VIDEO_PAD_NAME, GST_PAD_SRC, GST_PAD_REQUEST, cap_camsrc));
 
+  gst_element_class_add_pad_template
+    (gstelement_class, gst_pad_template_new (GST_CAM_BASE_VIDEO_PAD_TEMPLATE, GST_PAD_SRC, GST_PAD_REQUEST, cap_camsrc));
+
+  gst_caps_unref(cap_camsrc);
+
+  cap_camsrc = gst_caps_from_string(GST_CAMERASRC_PAIR_CAPS);
+  gst_element_class_add_pad_template
+    (gstelement_class, gst_pad_template_new (GST_CAMERASRC_PAIR_PAD_NAME, GST_PAD_SRC, GST_PAD_REQUEST, cap_camsrc));
   gst_caps_unref(cap_camsrc);
 
   basesrc_class->get_caps = GST_DEBUG_FUNCPTR(gst_camerasrc_get_caps);
@@ -1069,6 +1328,8 @@ gst_camerasrc_class_init (GstcamerasrcClass * klass)
   basesrc_class->start = GST_DEBUG_FUNCPTR(gst_camerasrc_start);
   basesrc_class->unlock = GST_DEBUG_FUNCPTR(gst_camerasrc_unlock);
   basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_camerasrc_unlock_stop);
+  basesrc_class->get_ready_time = GST_DEBUG_FUNCPTR(gst_camerasrc_get_ready_time);
+  basesrc_class->pre_push = GST_DEBUG_FUNCPTR(gst_camerasrc_pre_push);
   basesrc_class->fixate = GST_DEBUG_FUNCPTR(gst_camerasrc_fixate);
   basesrc_class->stop = GST_DEBUG_FUNCPTR(gst_camerasrc_stop);
   basesrc_class->query = GST_DEBUG_FUNCPTR(gst_camerasrc_query);
@@ -1084,6 +1345,15 @@ gst_camerasrc_init (Gstcamerasrc * camerasrc)
 {
   PERF_CAMERA_ATRACE();
   GST_INFO("\n");
+  void *streams = NULL;
+
+  /* GObject instances are not aligned on a cache line */
+  if (posix_memalign(&streams, GST_CAMERASRC_CACHE_LINE,
+        sizeof(GstStreamInfo) * GST_CAMERASRC_MAX_STREAM_NUM) != 0)
+    g_error("failed to allocate %d streams", GST_CAMERASRC_MAX_STREAM_NUM);
+  camerasrc->streams = (GstStreamInfo *)streams;
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++)
+    new (&camerasrc->streams[i]) GstStreamInfo();
 
   /* no need to add anything to init pad*/
   gst_cam_base_src_set_format (GST_CAM_BASE_SRC (camerasrc), GST_FORMAT_TIME,
@@ -1092,10 +1362,6 @@ gst_camerasrc_init (Gstcamerasrc * camerasrc)
   camerasrc->number_of_cameras = get_number_of_cameras();
   /* src pad is already active at the beginning */
   camerasrc->number_of_activepads = 1;
-  /* strore src pad name and stream id,
-   * src pad provides data in main stream */
-  camerasrc->stream_map.clear();
-  camerasrc->stream_map.insert(make_pair(GST_CAM_BASE_SRC_PAD_NAME, GST_CAMERASRC_MAIN_STREAM_ID));
 
   camerasrc->number_of_buffers = DEFAULT_PROP_BUFFERCOUNT;
   camerasrc->interlace_field = DEFAULT_PROP_INTERLACE_MODE;
@@ -1115,8 +1381,8 @@ gst_camerasrc_init (Gstcamerasrc * camerasrc)
   camerasrc->input_config.width = DEFAULT_PROP_INPUT_WIDTH;
   camerasrc->input_config.height = DEFAULT_PROP_INPUT_HEIGHT;
   camerasrc->input_config.format = -1;
-  camerasrc->start_config = FALSE;
-  camerasrc->start_streams = FALSE;
+  camerasrc->config_state = GST_CAMERASRC_CONFIG_IDLE;
+  camerasrc->config_deadline = 0;
 
   /* lock and cond are used to ensure icamerasrc only call interfaces once,
   * including: camera_device_config_streams(), camera_device_start() and
@@ -1128,14 +1394,17 @@ gst_camerasrc_init (Gstcamerasrc * camerasrc)
   * from each stream and queue to HAL together at once */
   g_mutex_init(&camerasrc->qbuf_mutex);
 
+  g_mutex_init(&camerasrc->pair_lock);
+  camerasrc->pair_pending = 0;
+
   /* init buffer timestamp for main stream */
   camerasrc->streams[GST_CAMERASRC_MAIN_STREAM_ID].time_start = 0;
   camerasrc->streams[GST_CAMERASRC_MAIN_STREAM_ID].time_end = 0;
   camerasrc->streams[GST_CAMERASRC_MAIN_STREAM_ID].gstbuf_timestamp = 0;
-  camerasrc->streams[GST_CAMERASRC_MAIN_STREAM_ID].stream_config_done = FALSE;
 
   /* set default value for 3A manual control*/
   camerasrc->param = new Parameters;
+  camerasrc->result_param = new Parameters;
   camerasrc->isp_control_tags = new set <unsigned int>;
   memset(&(camerasrc->man_ctl), 0, sizeof(camerasrc->man_ctl));
   memset(camerasrc->man_ctl.ae_region, 0, sizeof(camerasrc->man_ctl.ae_region));
@@ -1158,6 +1427,44 @@ gst_camerasrc_init (Gstcamerasrc * camerasrc)
   camerasrc->man_ctl.manual_set_exposure_time = FALSE;
   camerasrc->man_ctl.manual_set_gain = FALSE;
   camerasrc->man_ctl.manual_set_scene_mode = FALSE;
+
+  camerasrc->state_dir = DEFAULT_PROP_3A_STATE_DIR;
+  memset(&camerasrc->state_3a, 0, sizeof(camerasrc->state_3a));
+  camerasrc->state_3a.converge_frames = -1;
+  camerasrc->startup_frames_mode = DEFAULT_PROP_STARTUP_FRAMES_MODE;
+  camerasrc->startup_frame_budget = DEFAULT_PROP_STARTUP_FRAME_BUDGET;
+
+  camerasrc->scene_switch_pending = FALSE;
+  camerasrc->scene_mode_applied = DEFAULT_PROP_SCENE_MODE;
+  camerasrc->reconfiguring = FALSE;
+  camerasrc->reconfig_count = 0;
+  camerasrc->scene_switch_time = 0;
+  camerasrc->scene_switch_last_ts = 0;
+
+  camerasrc->timestamp_mode = DEFAULT_PROP_TIMESTAMP_MODE;
+  camerasrc->min_latency = 0;
+  camerasrc->max_latency = 0;
+  camerasrc->late_latency.store(0, std::memory_order_relaxed);
+  camerasrc->latency_update_time = 0;
+  camerasrc->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+  camerasrc->stats_last_post = 0;
+  camerasrc->metrics_endpoint = DEFAULT_PROP_METRICS_ENDPOINT;
+  camerasrc->trace_file = DEFAULT_PROP_TRACE_FILE;
+  camerasrc->trace_recording = FALSE;
+  camerasrc->sched_policy = DEFAULT_PROP_SCHED_POLICY;
+  camerasrc->sched_priority = DEFAULT_PROP_SCHED_PRIORITY;
+  camerasrc->sched_nice = DEFAULT_PROP_SCHED_NICE;
+  camerasrc->cpu_affinity = DEFAULT_PROP_CPU_AFFINITY;
+  camerasrc->sync_group = DEFAULT_PROP_SYNC_GROUP;
+  camerasrc->sync_tolerance = DEFAULT_PROP_SYNC_TOLERANCE;
+  camerasrc->sync_group_size = DEFAULT_PROP_SYNC_GROUP_SIZE;
+  camerasrc->decimation = DEFAULT_PROP_DECIMATION;
+  camerasrc->sync = NULL;
+  camerasrc->sync_member = -1;
+  const gchar *task_pool_size = g_getenv(GST_CAMERA_TASK_POOL_ENV);
+  camerasrc->task_pool_size = task_pool_size ?
+    (guint)MIN(g_ascii_strtoull(task_pool_size, NULL, 10), (guint64)MAX_PROP_TASK_POOL_SIZE) :
+    DEFAULT_PROP_TASK_POOL_SIZE;
 }
 
 static void
@@ -1233,54 +1540,115 @@ gst_camerasrc_wfov_interface_init (GstCamerasrcWFOVInterface *wfovIface)
 /**
  * This function is to avtivate a request pad from GstCamBaseSrc
  * through interface method. The requested pad is got according
- * to user's setting in gst pipeline. Each pad added won't start
+ * to user's setting in gst pipeline, either the legacy "video" pad
+ * or any number of "video_%u" pads, or the "pair" pad pushing the frames
+ * of the video pads from the same capture together. Each pad added won't start
  * streaming until it finishes several steps, e.g.: fiXate, set_caps,
  * decide_allocation, along with BufferPool configuration, aquire_buffer
  * and release_buffer. RequestPad will be removed when receive EOS.
+ *
+ * The stream id of a pad is its index in the base class, the indexes stay
+ * contiguous when pads are released so the HAL streams are always 0 to
+ * number_of_activepads - 1. Pads can't be requested while started, a warning
+ * message is posted.
  */
 static GstPad *gst_camerasrc_request_new_pad (GstElement * element,
-    GstPadTemplate * templ, const gchar * unused, const GstCaps * caps)
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
 {
   Gstcamerasrc *camerasrc = GST_CAMERASRC(element);
   GST_INFO("CameraId=%d.", camerasrc->device_id);
   GstElementClass *element_klass = GST_ELEMENT_GET_CLASS(element);
   GstCamBaseSrc *basesrc = GST_CAM_BASE_SRC(element);
-  GstCamBaseSrcClass *klass = GST_CAM_BASE_SRC_GET_CLASS(element);
   GstPad *req_pad = NULL;
+  int stream_id;
+
+  if (GST_CAM_BASE_SRC_IS_STARTED(basesrc)) {
+    GST_ERROR("CameraId=%d can't request pad %s while started.", camerasrc->device_id,
+        GST_PAD_TEMPLATE_NAME_TEMPLATE(templ));
+    GST_ELEMENT_WARNING(camerasrc, CORE, PAD,
+        ("Can't request pad %s while started.", GST_PAD_TEMPLATE_NAME_TEMPLATE(templ)),
+        ("the HAL streams are configured from the pads at start, request the pads "
+         "before going to PAUSED"));
+    return NULL;
+  }
 
-  if (templ == gst_element_class_get_pad_template(element_klass, GST_CAM_BASE_VIDEO_PAD_NAME)) {
-    /* store video pad name and stream id */
-    camerasrc->stream_map.insert(make_pair(GST_CAM_BASE_VIDEO_PAD_NAME, GST_CAMERASRC_VIDEO_STREAM_ID));
-    camerasrc->number_of_activepads++;
-    /* init buffer timestamp for video stream */
-    camerasrc->streams[GST_CAMERASRC_VIDEO_STREAM_ID].time_start = 0;
-    camerasrc->streams[GST_CAMERASRC_VIDEO_STREAM_ID].time_end = 0;
-    camerasrc->streams[GST_CAMERASRC_VIDEO_STREAM_ID].gstbuf_timestamp = 0;
-    camerasrc->streams[GST_CAMERASRC_VIDEO_STREAM_ID].stream_config_done = FALSE;
-    gst_cam_base_src_set_format (GST_CAM_BASE_SRC (camerasrc), GST_FORMAT_TIME,
-      GST_CAM_BASE_VIDEO_PAD_NAME);
-
-    /* call base class interface to add video pad */
-    req_pad = GST_CAM_BASE_SRC_CLASS (parent_class)->add_video_pad (basesrc, klass);
-    if (!req_pad) {
-     GST_ERROR("CameraId=%d failed to add video source pad.", camerasrc->device_id);
-     return NULL;
-    }
+  if (templ == gst_element_class_get_pad_template(element_klass, GST_CAMERASRC_PAIR_PAD_NAME))
+    return gst_camerasrc_pair_add_pad(camerasrc, templ);
+
+  if (templ == gst_element_class_get_pad_template(element_klass, GST_CAM_BASE_VIDEO_PAD_NAME))
+    name = GST_CAM_BASE_VIDEO_PAD_NAME;
+  else if (templ != gst_element_class_get_pad_template(element_klass, GST_CAM_BASE_VIDEO_PAD_TEMPLATE))
+    return NULL;
+
+  if (camerasrc->number_of_activepads >= GST_CAMERASRC_MAX_STREAM_NUM) {
+    GST_ERROR("CameraId=%d no free stream for a new pad, max %d.",
+        camerasrc->device_id, GST_CAMERASRC_MAX_STREAM_NUM);
+    return NULL;
+  }
+
+  gst_cam_base_src_set_format (GST_CAM_BASE_SRC (camerasrc), GST_FORMAT_TIME,
+    GST_CAM_BASE_VIDEO_PAD_NAME);
+
+  /* call base class interface to add video pad */
+  req_pad = GST_CAM_BASE_SRC_CLASS (parent_class)->add_video_pad (basesrc, templ, name);
+  if (!req_pad) {
+   GST_ERROR("CameraId=%d failed to add video source pad.", camerasrc->device_id);
+   return NULL;
   }
 
+  stream_id = GST_CAMERASRC_PAD_STREAM_ID(req_pad);
+  if (stream_id >= GST_CAMERASRC_MAX_STREAM_NUM) {
+    GST_ERROR("CameraId=%d, StreamId=%d out of range.", camerasrc->device_id, stream_id);
+    GST_CAM_BASE_SRC_CLASS (parent_class)->remove_video_pad (basesrc, req_pad);
+    return NULL;
+  }
+
+  /* init buffer timestamp for the stream */
+  camerasrc->streams[stream_id].time_start = 0;
+  camerasrc->streams[stream_id].time_end = 0;
+  camerasrc->streams[stream_id].gstbuf_timestamp = 0;
+  camerasrc->number_of_activepads++;
+
+  GST_INFO("CameraId=%d, StreamId=%d added pad %s.", camerasrc->device_id,
+      stream_id, GST_PAD_NAME(req_pad));
+
   return req_pad;
 }
 
+/**
+ * The HAL streams are configured from the pads once started, a pad can
+ * only be released while stopped, a warning message is posted otherwise. The pads after it take the stream id
+ * below theirs and restart their statistics.
+ */
 static void gst_camerasrc_release_pad (GstElement * element, GstPad * pad)
 {
   Gstcamerasrc *camerasrc = GST_CAMERASRC(element);
-  gchar *padname = gst_pad_get_name(pad);
-  GST_INFO("CameraId=%d.", camerasrc->device_id);
-  camerasrc->stream_map.erase(padname);
+  GstCamBaseSrc *basesrc = GST_CAM_BASE_SRC(element);
+  int stream_id;
+
+  if (GST_CAM_BASE_SRC_IS_STARTED(basesrc)) {
+    GST_ERROR("CameraId=%d can't release pad %s while started.",
+        camerasrc->device_id, GST_PAD_NAME(pad));
+    GST_ELEMENT_WARNING(camerasrc, CORE, PAD,
+        ("Can't release pad %s while started.", GST_PAD_NAME(pad)),
+        ("the HAL streams are configured from the pads at start, release the pads "
+         "after going to READY"));
+    return;
+  }
+
+  if (pad == camerasrc->pair_pad) {
+    GST_INFO("CameraId=%d release pair pad.", camerasrc->device_id);
+    gst_camerasrc_pair_remove_pad(camerasrc, pad);
+    return;
+  }
+
+  stream_id = GST_CAMERASRC_PAD_STREAM_ID(pad);
+  GST_INFO("CameraId=%d, StreamId=%d.", camerasrc->device_id, stream_id);
+
   camerasrc->number_of_activepads--;
-  gst_pad_set_active(pad, FALSE);
-  gst_element_remove_pad (element, pad);
-  g_free (padname);
+  GST_CAM_BASE_SRC_CLASS (parent_class)->remove_video_pad (basesrc, pad);
+  for (int i = stream_id; i < GST_CAMERASRC_MAX_STREAM_NUM; i++)
+    gst_camerasrc_stats_reset(&camerasrc->streams[i].stats);
 }
 
 /**
@@ -1533,6 +1901,88 @@ gst_camerasrc_config_ae_params(Gstcamerasrc *src)
     src->param->setSceneMode((camera_scene_mode_t)src->man_ctl.scene_mode);
 }
 
+/* When streaming, let main stream switch the device to the operation
+ * mode of the new scene mode before its next dqbuf */
+static void
+gst_camerasrc_request_scene_switch(Gstcamerasrc *src)
+{
+  if (src->camera_open &&
+      g_atomic_int_get(&src->config_state) == GST_CAMERASRC_CONFIG_STARTED &&
+      src->running == GST_CAMERASRC_STATUS_RUNNING)
+    g_atomic_int_set(&src->scene_switch_pending, TRUE);
+}
+
+/**
+  * Recompute the reported latency, called with the object lock.
+  * Min latency is the slowest capture to push time of all streams, one
+  * frame until measured. With clock timestamps the PTS is taken at push,
+  * so there is no capture latency to report. Max latency adds the time
+  * the other buffers of the pool can hold a frame for. TRUE if it changed.
+  * The measured latency of the frames only changes it with hysteresis,
+  * configuration changes do it at once.
+  */
+static gboolean
+gst_camerasrc_update_latency(Gstcamerasrc *src, gboolean measured)
+{
+  GstClockTime min_latency = 0, frame_duration = 0, max_latency;
+  gboolean capture = g_atomic_int_get(&src->timestamp_mode) == GST_CAMERASRC_TIMESTAMP_MODE_CAPTURE;
+  gboolean changed;
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    GstStreamInfo *stream = &src->streams[i];
+    if (stream->frame_duration == 0)
+      continue;
+    if (capture)
+      min_latency = MAX(min_latency,
+        stream->latency_reported ? stream->latency_reported : stream->frame_duration);
+    frame_duration = MAX(frame_duration, stream->frame_duration);
+  }
+  max_latency = min_latency + (src->number_of_buffers > 1 ?
+    (src->number_of_buffers - 1) * frame_duration : 0);
+
+  changed = ABS(GST_CLOCK_DIFF(src->min_latency, min_latency)) > (GstClockTimeDiff)GST_CAMERASRC_LATENCY_THRESHOLD ||
+    ABS(GST_CLOCK_DIFF(src->max_latency, max_latency)) > (GstClockTimeDiff)GST_CAMERASRC_LATENCY_THRESHOLD;
+  if (changed && measured) {
+    guint64 now = gst_camerasrc_clock_monotonic_ns();
+    gboolean rise = min_latency > src->min_latency + src->min_latency / GST_CAMERASRC_LATENCY_RISE;
+    gboolean fall = min_latency < src->min_latency - src->min_latency / GST_CAMERASRC_LATENCY_FALL;
+
+    /* a too low latency makes frames late so rises are taken at once,
+     * the first measure too, and a lower latency once in a while */
+    changed = src->min_latency == 0 || rise ||
+      (fall && now - src->latency_update_time >= GST_CAMERASRC_LATENCY_INTERVAL);
+  }
+  if (changed) {
+    src->min_latency = min_latency;
+    src->max_latency = max_latency;
+    src->late_latency.store(max_latency, std::memory_order_relaxed);
+    src->latency_update_time = gst_camerasrc_clock_monotonic_ns();
+  }
+
+  return changed;
+}
+
+/* Let the pipeline query latency again if it changed */
+static void
+gst_camerasrc_latency_changed(Gstcamerasrc *src)
+{
+  GstClockTime min_latency, max_latency;
+  gboolean changed;
+
+  GST_OBJECT_LOCK(src);
+  changed = gst_camerasrc_update_latency(src, FALSE);
+  min_latency = src->min_latency;
+  max_latency = src->max_latency;
+  GST_OBJECT_UNLOCK(src);
+
+  if (changed) {
+    GST_INFO("CameraId=%d latency changed, min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT ".",
+      src->device_id, GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+    gst_element_post_message(GST_ELEMENT_CAST(src),
+        gst_message_new_latency(GST_OBJECT_CAST(src)));
+  }
+}
+
 static int
 gst_camerasrc_analyze_isp_control(Gstcamerasrc *src, const char *bin_name)
 {
@@ -1644,14 +2094,17 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
     case PROP_BUFFERCOUNT:
       manual_setting = false;
       src->number_of_buffers = g_value_get_int (value);
+      gst_camerasrc_latency_changed(src);
       break;
     case PROP_PRINT_FPS:
       manual_setting = false;
       src->print_fps = g_value_get_boolean(value);
+      g_atomic_int_inc(&src->frame_path_serial);
       break;
     case PROP_PRINT_FIELD:
       manual_setting = false;
       src->print_field = g_value_get_boolean(value);
+      g_atomic_int_inc(&src->frame_path_serial);
       break;
     case PROP_INTERLACE_MODE:
       manual_setting = false;
@@ -1674,6 +2127,7 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
           break;
       }
       src->deinterlace_method = g_value_get_enum (value);
+      g_atomic_int_inc(&src->frame_path_serial);
       break;
     case PROP_IO_MODE:
       manual_setting = false;
@@ -1730,15 +2184,21 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
       src->param->setIrisLevel(g_value_get_int(value));
       src->man_ctl.iris_level = g_value_get_int (value);
       break;
+    /* the 3A settings below are also restored by the streaming thread
+     * when it releases the seeded 3A state */
     case PROP_EXPOSURE_TIME:
+      GST_OBJECT_LOCK(src);
       src->man_ctl.exposure_time = g_value_get_int(value);
       src->man_ctl.manual_set_exposure_time = TRUE;
       gst_camerasrc_config_ae_params(src);
+      GST_OBJECT_UNLOCK(src);
       break;
     case PROP_GAIN:
+      GST_OBJECT_LOCK(src);
       src->man_ctl.gain = g_value_get_float (value);
       src->man_ctl.manual_set_gain = TRUE;
       gst_camerasrc_config_ae_params(src);
+      GST_OBJECT_UNLOCK(src);
       break;
     case PROP_BLC_AREA_MODE:
       src->param->setBlcAreaMode((camera_blc_area_mode_t)g_value_get_enum(value));
@@ -1749,31 +2209,40 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
       src->man_ctl.wdr_level = g_value_get_int (value);
       break;
     case PROP_AWB_MODE:
+      GST_OBJECT_LOCK(src);
       src->param->setAwbMode((camera_awb_mode_t)g_value_get_enum(value));
       src->man_ctl.awb_mode = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK(src);
       break;
     case PROP_AWB_GAIN_R:
+      GST_OBJECT_LOCK(src);
       src->param->getAwbGains(awb_gain);
       awb_gain.r_gain = g_value_get_int (value);
       src->param->setAwbGains(awb_gain);
       src->man_ctl.awb_gain_r = awb_gain.r_gain;
+      GST_OBJECT_UNLOCK(src);
       break;
     case PROP_AWB_GAIN_G:
+      GST_OBJECT_LOCK(src);
       src->param->getAwbGains(awb_gain);
       awb_gain.g_gain = g_value_get_int (value);
       src->param->setAwbGains(awb_gain);
       src->man_ctl.awb_gain_g = awb_gain.g_gain;
+      GST_OBJECT_UNLOCK(src);
       break;
     case PROP_AWB_GAIN_B:
+      GST_OBJECT_LOCK(src);
       src->param->getAwbGains(awb_gain);
       awb_gain.b_gain = g_value_get_int (value);
       src->param->setAwbGains(awb_gain);
       src->man_ctl.awb_gain_b = awb_gain.b_gain;
+      GST_OBJECT_UNLOCK(src);
       break;
     case PROP_SCENE_MODE:
       src->man_ctl.scene_mode = g_value_get_enum (value);
       src->man_ctl.manual_set_scene_mode = TRUE;
       gst_camerasrc_config_ae_params(src);
+      gst_camerasrc_request_scene_switch(src);
       break;
     case PROP_SENSOR_RESOLUTION:
       //implement this in the future.
@@ -1908,6 +2377,7 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
       break;
     case PROP_BUFFER_USAGE:
       src->buffer_usage = g_value_get_enum(value);
+      g_atomic_int_inc(&src->frame_path_serial);
       break;
     case PROP_INPUT_WIDTH:
       src->input_config.width = g_value_get_int(value);
@@ -1927,6 +2397,85 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
       if (ret != 0)
         GST_ERROR("Failed to set ltm tuning data: please check data in the bin file");
       break;
+    case PROP_3A_STATE_DIR:
+      manual_setting = false;
+      g_free(src->state_dir);
+      src->state_dir = g_value_dup_string(value);
+      break;
+    case PROP_STARTUP_FRAMES:
+      manual_setting = false;
+      src->startup_frames_mode = g_value_get_enum(value);
+      break;
+    case PROP_STARTUP_FRAME_BUDGET:
+      manual_setting = false;
+      src->startup_frame_budget = g_value_get_int(value);
+      break;
+    case PROP_TIMESTAMP_MODE:
+      manual_setting = false;
+      GST_OBJECT_LOCK(src);
+      g_atomic_int_set(&src->timestamp_mode, g_value_get_enum(value));
+      GST_OBJECT_UNLOCK(src);
+      gst_camerasrc_latency_changed(src);
+      break;
+    case PROP_STATS_INTERVAL:
+      manual_setting = false;
+      src->stats_interval = g_value_get_uint(value);
+      break;
+    case PROP_METRICS_ENDPOINT:
+      manual_setting = false;
+      g_free(src->metrics_endpoint);
+      src->metrics_endpoint = g_value_dup_string(value);
+      break;
+    case PROP_TRACE_FILE:
+      manual_setting = false;
+      g_free(src->trace_file);
+      src->trace_file = g_value_dup_string(value);
+      break;
+    case PROP_SCHED_POLICY:
+      manual_setting = false;
+      src->sched_policy = g_value_get_enum(value);
+      break;
+    case PROP_SCHED_PRIORITY:
+      manual_setting = false;
+      src->sched_priority = g_value_get_int(value);
+      break;
+    case PROP_SCHED_NICE:
+      manual_setting = false;
+      src->sched_nice = g_value_get_int(value);
+      break;
+    case PROP_CPU_AFFINITY:
+      manual_setting = false;
+      GST_OBJECT_LOCK(src);
+      g_free(src->cpu_affinity);
+      src->cpu_affinity = g_value_dup_string(value);
+      GST_OBJECT_UNLOCK(src);
+      break;
+    case PROP_TASK_POOL_SIZE:
+      manual_setting = false;
+      src->task_pool_size = g_value_get_uint(value);
+      break;
+    case PROP_SYNC_GROUP:
+      manual_setting = false;
+      GST_OBJECT_LOCK(src);
+      g_free(src->sync_group);
+      src->sync_group = g_value_dup_string(value);
+      GST_OBJECT_UNLOCK(src);
+      break;
+    case PROP_SYNC_TOLERANCE:
+      manual_setting = false;
+      src->sync_tolerance = g_value_get_uint(value);
+      break;
+    case PROP_SYNC_GROUP_SIZE:
+      manual_setting = false;
+      src->sync_group_size = g_value_get_uint(value);
+      break;
+    case PROP_DECIMATION:
+      manual_setting = false;
+      GST_OBJECT_LOCK(src);
+      g_free(src->decimation);
+      src->decimation = g_value_dup_string(value);
+      GST_OBJECT_UNLOCK(src);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1938,6 +2487,79 @@ gst_camerasrc_set_property (GObject * object, guint prop_id,
 
 }
 
+/**
+  * Snapshot of the runtime statistics, owned by the caller.
+  * Each stream has its own "stream-<id>" structure, drop counts are
+  * also summed over streams.
+  */
+GstStructure *
+gst_camerasrc_get_stats(Gstcamerasrc *src)
+{
+  GstStructure *stats = gst_structure_new("icamerasrc-stats",
+      "device-id", G_TYPE_INT, src->device_id, NULL);
+  guint64 now = gst_camerasrc_clock_monotonic_ns();
+  guint64 dropped = 0, duplicated = 0, late = 0;
+
+  GST_OBJECT_LOCK(src);
+  gst_camerasrc_sync_fill_stats(src, stats);
+  gst_structure_set(stats,
+      "min-latency", G_TYPE_UINT64, src->min_latency,
+      "max-latency", G_TYPE_UINT64, src->max_latency, NULL);
+  GST_OBJECT_UNLOCK(src);
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    GstStreamStats *stream_stats = &src->streams[i].stats;
+    if (i >= src->number_of_activepads && GST_CAMERASRC_STATS_GET(stream_stats->frames) == 0)
+      continue;
+
+    GstStructure *stream = gst_camerasrc_stats_to_structure(stream_stats, i, now);
+    gchar *name = g_strdup_printf("stream-%d", i);
+    gst_structure_set(stats, name, GST_TYPE_STRUCTURE, stream, NULL);
+    g_free(name);
+    gst_structure_free(stream);
+
+    dropped += GST_CAMERASRC_STATS_GET(stream_stats->dropped);
+    duplicated += GST_CAMERASRC_STATS_GET(stream_stats->duplicated);
+    late += GST_CAMERASRC_STATS_GET(stream_stats->late);
+  }
+
+  gst_structure_set(stats,
+      "frames-dropped", G_TYPE_UINT64, dropped,
+      "frames-duplicated", G_TYPE_UINT64, duplicated,
+      "frames-late", G_TYPE_UINT64, late, NULL);
+
+#ifdef ENABLE_LOCK_PROFILING
+  {
+    GstCamBaseSrc *basesrc = GST_CAM_BASE_SRC(src);
+    GstLockStats *lock_stats[] = { &src->lock_stats, &src->qbuf_lock_stats,
+        &basesrc->live_lock_stats };
+    const gchar *lock_names[] = { "lock-element", "lock-qbuf", "lock-live" };
+
+    for (guint i = 0; i < G_N_ELEMENTS(lock_stats); i++) {
+      GstStructure *lock = gst_camerasrc_lock_to_structure(lock_stats[i], lock_names[i]);
+      gst_structure_set(stats, lock_names[i], GST_TYPE_STRUCTURE, lock, NULL);
+      gst_structure_free(lock);
+    }
+
+    /* one live lock per request pad */
+    GST_OBJECT_LOCK(basesrc);
+    for (guint i = 1; i < basesrc->pads->len; i++) {
+      GstCamBaseSrcPadState *state = (GstCamBaseSrcPadState *) g_ptr_array_index(basesrc->pads, i);
+      if (!state)
+        continue;
+      gchar *name = g_strdup_printf("lock-live-%s", GST_PAD_NAME(state->pad));
+      GstStructure *lock = gst_camerasrc_lock_to_structure(&state->live_lock_stats, name);
+      gst_structure_set(stats, name, GST_TYPE_STRUCTURE, lock, NULL);
+      gst_structure_free(lock);
+      g_free(name);
+    }
+    GST_OBJECT_UNLOCK(basesrc);
+  }
+#endif
+
+  return stats;
+}
+
 static void
 gst_camerasrc_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -2101,6 +2723,66 @@ gst_camerasrc_get_property (GObject * object, guint prop_id,
     case PROP_INPUT_HEIGHT:
       g_value_set_int(value, src->input_config.height);
       break;
+    case PROP_3A_STATE_DIR:
+      g_value_set_string(value, src->state_dir);
+      break;
+    case PROP_3A_CONVERGE_FRAMES:
+      g_value_set_int(value, src->state_3a.converge_frames);
+      break;
+    case PROP_STARTUP_FRAMES:
+      g_value_set_enum(value, src->startup_frames_mode);
+      break;
+    case PROP_STARTUP_FRAME_BUDGET:
+      g_value_set_int(value, src->startup_frame_budget);
+      break;
+    case PROP_TIMESTAMP_MODE:
+      g_value_set_enum(value, src->timestamp_mode);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed(value, gst_camerasrc_get_stats(src));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint(value, src->stats_interval);
+      break;
+    case PROP_METRICS_ENDPOINT:
+      g_value_set_string(value, src->metrics_endpoint);
+      break;
+    case PROP_TRACE_FILE:
+      g_value_set_string(value, src->trace_file);
+      break;
+    case PROP_SCHED_POLICY:
+      g_value_set_enum(value, src->sched_policy);
+      break;
+    case PROP_SCHED_PRIORITY:
+      g_value_set_int(value, src->sched_priority);
+      break;
+    case PROP_SCHED_NICE:
+      g_value_set_int(value, src->sched_nice);
+      break;
+    case PROP_CPU_AFFINITY:
+      GST_OBJECT_LOCK(src);
+      g_value_set_string(value, src->cpu_affinity);
+      GST_OBJECT_UNLOCK(src);
+      break;
+    case PROP_TASK_POOL_SIZE:
+      g_value_set_uint(value, src->task_pool_size);
+      break;
+    case PROP_SYNC_GROUP:
+      GST_OBJECT_LOCK(src);
+      g_value_set_string(value, src->sync_group);
+      GST_OBJECT_UNLOCK(src);
+      break;
+    case PROP_SYNC_TOLERANCE:
+      g_value_set_uint(value, src->sync_tolerance);
+      break;
+    case PROP_SYNC_GROUP_SIZE:
+      g_value_set_uint(value, src->sync_group_size);
+      break;
+    case PROP_DECIMATION:
+      GST_OBJECT_LOCK(src);
+      g_value_set_string(value, src->decimation);
+      GST_OBJECT_UNLOCK(src);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -2112,20 +2794,11 @@ static int
 gst_camerasrc_get_stream_id_by_pad(Gstcamerasrc *camerasrc,
                                GstPad *pad)
 {
-  int stream_id = -1;
-  gchar *name = gst_pad_get_name(pad);
-
-  map<std::string, int> :: iterator iter;
-  iter = camerasrc->stream_map.find(name);
-  if (iter != camerasrc->stream_map.end())
-    stream_id = iter->second;
-  else {
-    GST_ERROR("CameraId=%d failed to get StreamId: %d", camerasrc->device_id, stream_id);
-    g_free (name);
-    return -1;
-  }
+  int stream_id = GST_CAMERASRC_PAD_STREAM_ID(pad);
 
-  g_free (name);
+  if (stream_id < 0)
+    GST_ERROR("CameraId=%d failed to get StreamId of pad %s", camerasrc->device_id,
+      GST_PAD_NAME(pad));
 
   return stream_id;
 }
@@ -2212,16 +2885,20 @@ gst_camerasrc_get_caps_info (Gstcamerasrc* camerasrc,
     return ret;
   }
 
-  /* if 'framerate' label is configured in Capsfilter, call HAL interface, otherwise is 0 */
+  /* 'framerate' label configured in Capsfilter is given to HAL with the
+   * other streams' at configure, otherwise is 0 */
   int fps_numerator = GST_VIDEO_INFO_FPS_N(&info);
   int fps_denominator = GST_VIDEO_INFO_FPS_D(&info);
-  camerasrc->param->setFrameRate(static_cast<float>(fps_numerator) / fps_denominator);
-
-  camera_set_parameters(camerasrc->device_id, *(camerasrc->param));
 
   camerasrc->streams[stream_id].info = info;
   camerasrc->streams[stream_id].fmt_name = gst_video_format_to_string(gst_fmt);
 
+  GST_OBJECT_LOCK(camerasrc);
+  camerasrc->streams[stream_id].frame_duration = fps_numerator > 0 ?
+    gst_util_uint64_scale_int(GST_SECOND, fps_denominator, fps_numerator) : 0;
+  GST_OBJECT_UNLOCK(camerasrc);
+  gst_camerasrc_latency_changed(camerasrc);
+
   GST_INFO("CameraId=%d, StreamId=%d Caps info: format=%s width=%d height=%d field=%d framerate %d/%d.",
              camerasrc->device_id, stream_id, camerasrc->streams[stream_id].fmt_name, info.width, info.height,
              camerasrc->interlace_field, fps_numerator, fps_denominator);
@@ -2293,12 +2970,248 @@ gst_camerasrc_get_configuration_mode(Gstcamerasrc* camerasrc, stream_config_t *s
     }
 }
 
+/**
+  * Switch the device in place to the operation mode of the current scene
+  * mode: it's stopped, the same streams are configured again and started,
+  * so buffer pools and negotiated caps are kept. Called by main stream
+  * between two dqbuf, the other streams retry dqbuf once it's done.
+  */
+void
+gst_camerasrc_switch_scene_mode(Gstcamerasrc *camerasrc)
+{
+  PERF_CAMERA_ATRACE();
+  gint64 start_time = g_get_monotonic_time();
+  unsigned int old_mode;
+  int scene_mode = camerasrc->man_ctl.scene_mode;
+  int ret;
+
+  g_atomic_int_set(&camerasrc->scene_switch_pending, FALSE);
+
+  /* HAL buffers are requeued below, so qbuf_mutex is taken first as
+   * everywhere both locks are held */
+  GST_CAMSRC_QBUF_LOCK(camerasrc);
+  GST_CAMSRC_LOCK(camerasrc);
+
+  old_mode = camerasrc->stream_list.operation_mode;
+  gst_camerasrc_get_configuration_mode(camerasrc, &camerasrc->stream_list);
+  if (!camerasrc->camera_open || camerasrc->stream_list.operation_mode == old_mode) {
+    camerasrc->scene_mode_applied = scene_mode;
+    GST_CAMSRC_UNLOCK(camerasrc);
+    GST_CAMSRC_QBUF_UNLOCK(camerasrc);
+    return;
+  }
+
+  GST_INFO("CameraId=%d switch operation mode 0x%x -> 0x%x.",
+    camerasrc->device_id, old_mode, camerasrc->stream_list.operation_mode);
+
+  g_atomic_int_set(&camerasrc->reconfiguring, TRUE);
+  g_atomic_int_inc(&camerasrc->reconfig_count);
+
+  camera_device_stop(camerasrc->device_id);
+  /* the frames other streams dequeued before stop are theirs */
+  gst_camerasrc_wait_dqbuf_idle(camerasrc, GST_CAMERASRC_MAIN_STREAM_ID);
+  ret = camera_device_config_streams(camerasrc->device_id, &camerasrc->stream_list);
+  if (ret < 0) {
+    GST_ERROR("CameraId=%d failed to config streams for operation mode 0x%x, keep 0x%x.",
+      camerasrc->device_id, camerasrc->stream_list.operation_mode, old_mode);
+    camerasrc->stream_list.operation_mode = old_mode;
+    camera_device_config_streams(camerasrc->device_id, &camerasrc->stream_list);
+    /* the property reports the mode the device runs, unless it was set
+     * again meanwhile, which switches once more */
+    camerasrc->param->setSceneMode((camera_scene_mode_t)camerasrc->scene_mode_applied);
+    if (g_atomic_int_get(&camerasrc->scene_switch_pending) == FALSE)
+      camerasrc->man_ctl.scene_mode = camerasrc->scene_mode_applied;
+  } else {
+    camerasrc->scene_mode_applied = scene_mode;
+  }
+  camera_set_parameters(camerasrc->device_id, *(camerasrc->param));
+  camera_device_start(camerasrc->device_id);
+
+  /* buffers HAL owned before stop are queued again */
+  gst_camerasrc_requeue_hal_buffers(camerasrc);
+
+  g_atomic_int_set(&camerasrc->reconfiguring, FALSE);
+  g_cond_broadcast(GST_CAMSRC_GET_COND(camerasrc));
+  GST_CAMSRC_UNLOCK(camerasrc);
+  GST_CAMSRC_QBUF_UNLOCK(camerasrc);
+
+  if (ret < 0) {
+    g_object_notify(G_OBJECT(camerasrc), "scene-mode");
+    return;
+  }
+
+  camerasrc->scene_switch_time = (g_get_monotonic_time() - start_time) * GST_USECOND;
+  /* glitch is reported when the first frame comes out of new mode */
+  camerasrc->scene_switch_last_ts = camerasrc->streams[GST_CAMERASRC_MAIN_STREAM_ID].time_end;
+}
+
+/**
+  * Post the duration of the scene mode switch, glitch is the gap between
+  * the capture timestamps of the last frame before and the first frame after
+  */
+void
+gst_camerasrc_post_scene_switch(Gstcamerasrc *camerasrc, GstClockTime timestamp)
+{
+  GstClockTime glitch = timestamp - camerasrc->scene_switch_last_ts;
+
+  camerasrc->scene_switch_last_ts = 0;
+
+  GST_INFO("CameraId=%d scene mode %d switched, reconfigure time %" GST_TIME_FORMAT
+    ", glitch %" GST_TIME_FORMAT ".", camerasrc->device_id, camerasrc->man_ctl.scene_mode,
+    GST_TIME_ARGS(camerasrc->scene_switch_time), GST_TIME_ARGS(glitch));
+
+  gst_element_post_message(GST_ELEMENT_CAST(camerasrc),
+      gst_message_new_element(GST_OBJECT_CAST(camerasrc),
+        gst_structure_new("scene-mode-changed",
+          "device-id", G_TYPE_INT, camerasrc->device_id,
+          "scene-mode", G_TYPE_INT, camerasrc->man_ctl.scene_mode,
+          "reconfigure-time", G_TYPE_UINT64, camerasrc->scene_switch_time,
+          "glitch", G_TYPE_UINT64, glitch, NULL)));
+}
+
+/**
+  * Run the device at the highest framerate of the configured streams and
+  * decimate the streams with a lower one to their exact rate, or to every
+  * Nth frame as set by the decimation property, so their skipped frames
+  * never leave the pool
+  */
+static void
+gst_camerasrc_set_stream_rates(Gstcamerasrc *camerasrc)
+{
+  guint decimation[GST_CAMERASRC_MAX_STREAM_NUM] = { 0 };
+  gint device_n = 0, device_d = 1;
+
+  GST_OBJECT_LOCK(camerasrc);
+  if (camerasrc->decimation) {
+    gchar **tokens = g_strsplit(camerasrc->decimation, ",", GST_CAMERASRC_MAX_STREAM_NUM);
+    for (int i = 0; tokens[i] && i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+      gchar *end = NULL;
+      guint64 value = g_ascii_strtoull(tokens[i], &end, 10);
+      if (end == tokens[i] || *end != '\0' || value > G_MAXUINT) {
+        GST_WARNING("CameraId=%d, StreamId=%d invalid decimation '%s', using caps framerate.",
+          camerasrc->device_id, i, tokens[i]);
+        continue;
+      }
+      decimation[i] = (guint)value;
+    }
+    g_strfreev(tokens);
+  }
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    GstVideoInfo *info = &camerasrc->streams[i].info;
+    if (!(camerasrc->config_streams & (1u << i)) || GST_VIDEO_INFO_FPS_N(info) <= 0)
+      continue;
+    if (gst_util_fraction_compare(GST_VIDEO_INFO_FPS_N(info), GST_VIDEO_INFO_FPS_D(info),
+          device_n, device_d) > 0) {
+      device_n = GST_VIDEO_INFO_FPS_N(info);
+      device_d = GST_VIDEO_INFO_FPS_D(info);
+    }
+  }
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    GstStreamInfo *stream = &camerasrc->streams[i];
+    GstVideoInfo *info = &stream->info;
+    gint num = 1, den = 1;
+    if (!(camerasrc->config_streams & (1u << i)))
+      continue;
+    if (decimation[i] > 0) {
+      den = decimation[i];
+    } else if (GST_VIDEO_INFO_FPS_N(info) > 0 &&
+        !gst_util_fraction_multiply(GST_VIDEO_INFO_FPS_N(info), GST_VIDEO_INFO_FPS_D(info),
+          device_d, device_n, &num, &den)) {
+      /* too large to be exact, the closest 1 of N */
+      num = 1;
+      den = (gint)((double)device_n * GST_VIDEO_INFO_FPS_D(info) /
+        ((double)device_d * GST_VIDEO_INFO_FPS_N(info)) + 0.5);
+    }
+    stream->decimation_num = (guint)MAX(num, 1);
+    stream->decimation_den = (guint)MAX(den, 1);
+    GST_INFO("CameraId=%d, StreamId=%d pushes %u frames of %u at device framerate %d/%d.",
+      camerasrc->device_id, i, stream->decimation_num, stream->decimation_den,
+      device_n, device_d);
+  }
+
+  camerasrc->param->setFrameRate(static_cast<float>((double)device_n / device_d));
+  camera_set_parameters(camerasrc->device_id, *(camerasrc->param));
+}
+
+/**
+  * Configure the HAL streams of all the active pads, called with
+  * GST_CAMSRC_LOCK by the stream whose caps completed the set of streams.
+  * HAL takes the streams by index, so stream ids are the first ones.
+  */
+gboolean
+gst_camerasrc_configure_device(Gstcamerasrc *camerasrc, int stream_id, guint32 streams)
+{
+  int num_streams = g_bit_storage(streams);
+
+  if (streams != (1u << num_streams) - 1) {
+    GST_ERROR("CameraId=%d, StreamId=%d stream ids 0x%x not contiguous from 0.",
+      camerasrc->device_id, stream_id, streams);
+    return FALSE;
+  }
+
+  /* Check if input format is valid and convert to fourcc */
+  if (camerasrc->input_fmt) {
+    if (!CameraSrcUtils::check_format_by_name(camerasrc->input_fmt)) {
+      GST_ERROR("failed to find match in supported format list.");
+      return FALSE;
+    }
+    camerasrc->input_config.format =
+      CameraSrcUtils::string_2_fourcc(camerasrc->input_fmt);
+  }
+
+  if (camerasrc->input_config.width < MIN_PROP_INPUT_WIDTH ||
+    camerasrc->input_config.width > MAX_PROP_INPUT_WIDTH) {
+      GST_ERROR("CameraId=%d, streamId=%d unsupported input width %d.",
+        camerasrc->device_id, stream_id, camerasrc->input_config.width);
+      return FALSE;
+  }
+
+  if (camerasrc->input_config.height < MIN_PROP_INPUT_HEIGHT ||
+    camerasrc->input_config.height > MAX_PROP_INPUT_HEIGHT) {
+      GST_ERROR("CameraId=%d, streamId=%d unsupported input height %d.",
+          camerasrc->device_id, stream_id, camerasrc->input_config.height);
+      return FALSE;
+  }
+
+  GST_INFO("CameraId=%d, streamId=%d input format: %s(fourcc=%d)."
+    "input width:=%d, input height=%d.",
+    camerasrc->device_id, stream_id,
+    (camerasrc->input_fmt) ? (camerasrc->input_fmt) : "NULL",
+    camerasrc->input_config.format,
+    camerasrc->input_config.width,
+    camerasrc->input_config.height);
+
+  gst_camerasrc_set_stream_rates(camerasrc);
+  gst_camerasrc_get_configuration_mode(camerasrc, &camerasrc->stream_list);
+  camerasrc->scene_mode_applied = camerasrc->man_ctl.scene_mode;
+
+  for (int i = 0; i < num_streams; i++) {
+      // Set usage to CAMERA_STREAM_VIDEO_CAPTURE for video user cases
+      camerasrc->s[i].usage = CAMERA_STREAM_VIDEO_CAPTURE;
+  }
+  camerasrc->stream_list.num_streams = num_streams;
+  camerasrc->stream_list.streams = camerasrc->s;
+  int ret = camera_device_config_sensor_input(camerasrc->device_id, &camerasrc->input_config);
+  ret |= camera_device_config_streams(camerasrc->device_id, &camerasrc->stream_list);
+  if(ret < 0) {
+    GST_ERROR("CameraId=%d, StreamId=%d failed to config stream for format %s %dx%d.",
+      camerasrc->device_id, stream_id, camerasrc->streams[stream_id].fmt_name,
+      camerasrc->s[stream_id].width, camerasrc->s[stream_id].height);
+    return FALSE;
+  }
+  GST_INFO("CameraId=%d, StreamId=%d config stream done.", camerasrc->device_id, stream_id);
+
+  return TRUE;
+}
+
 static gboolean
 gst_camerasrc_set_caps(GstCamBaseSrc *src, GstPad *pad, GstCaps *caps)
 {
   PERF_CAMERA_ATRACE();
   Gstcamerasrc *camerasrc = GST_CAMERASRC (src);
-  gboolean ready_config = TRUE;
   int stream_id = gst_camerasrc_get_stream_id_by_pad(camerasrc, pad);
   gchar *padname = gst_pad_get_name(pad);
   if (stream_id < 0) {
@@ -2334,89 +3247,10 @@ gst_camerasrc_set_caps(GstCamBaseSrc *src, GstPad *pad, GstCaps *caps)
     return FALSE;
   }
 
-  GST_CAMSRC_LOCK(camerasrc);
-  camerasrc->streams[stream_id].stream_config_done = TRUE;
-
-  for (int i = 0; i < camerasrc->number_of_activepads; i++) {
-    ready_config *=
-      camerasrc->streams[i].stream_config_done;
-  }
-
-  /* HAL interface:camera_device_config_streams() won't be called
-  * until all other requested pats are done configuring, otherwise
-  * keep waiting until it does */
-  if (ready_config) {
-    /* Check if input format is valid and convert to fourcc */
-    if (camerasrc->input_fmt) {
-      if (!CameraSrcUtils::check_format_by_name(camerasrc->input_fmt)) {
-        GST_ERROR("failed to find match in supported format list.");
-        GST_CAMSRC_UNLOCK(camerasrc);
-        g_free (padname);
-        return FALSE;
-      }
-      camerasrc->input_config.format =
-        CameraSrcUtils::string_2_fourcc(camerasrc->input_fmt);
-     }
-
-    if (camerasrc->input_config.width < MIN_PROP_INPUT_WIDTH ||
-      camerasrc->input_config.width > MAX_PROP_INPUT_WIDTH) {
-        GST_ERROR("CameraId=%d, streamId=%d unsupported input width %d.",
-          camerasrc->device_id, stream_id, camerasrc->input_config.width);
-        GST_CAMSRC_UNLOCK(camerasrc);
-        g_free (padname);
-        return FALSE;
-    }
-
-    if (camerasrc->input_config.height < MIN_PROP_INPUT_HEIGHT ||
-      camerasrc->input_config.height > MAX_PROP_INPUT_HEIGHT) {
-        GST_ERROR("CameraId=%d, streamId=%d unsupported input height %d.",
-            camerasrc->device_id, stream_id, camerasrc->input_config.height);
-        GST_CAMSRC_UNLOCK(camerasrc);
-        g_free (padname);
-        return FALSE;
-    }
-
-    GST_INFO("CameraId=%d, streamId=%d input format: %s(fourcc=%d)."
-      "input width:=%d, input height=%d.",
-      camerasrc->device_id, stream_id,
-      (camerasrc->input_fmt) ? (camerasrc->input_fmt) : "NULL",
-      camerasrc->input_config.format,
-      camerasrc->input_config.width,
-      camerasrc->input_config.height);
-
-    gst_camerasrc_get_configuration_mode(camerasrc, &camerasrc->stream_list);
-
-    for (int i = 0; i < camerasrc->number_of_activepads; i++) {
-        // Set usage to CAMERA_STREAM_VIDEO_CAPTURE for video user cases
-        camerasrc->s[i].usage = CAMERA_STREAM_VIDEO_CAPTURE;
-    }
-    camerasrc->stream_start_count= camerasrc->number_of_activepads;
-    camerasrc->stream_list.num_streams = camerasrc->number_of_activepads;
-    camerasrc->stream_list.streams = camerasrc->s;
-    int ret = camera_device_config_sensor_input(camerasrc->device_id, &camerasrc->input_config);
-    ret |= camera_device_config_streams(camerasrc->device_id, &camerasrc->stream_list);
-    if(ret < 0) {
-      GST_ERROR("CameraId=%d, StreamId=%d failed to config stream for format %s %dx%d.",
-        camerasrc->device_id, stream_id, camerasrc->streams[stream_id].fmt_name,
-        camerasrc->s[stream_id].width, camerasrc->s[stream_id].height);
-      GST_CAMSRC_UNLOCK(camerasrc);
-      g_free (padname);
-      return FALSE;
-    }
-    GST_INFO("CameraId=%d, StreamId=%d config stream done.", camerasrc->device_id, stream_id);
-
-    camerasrc->start_config = TRUE;
-    GST_CAMSRC_SIGNAL(camerasrc);
-  } else {
-    while(!camerasrc->start_config) {
-      GST_CAMSRC_WAIT(camerasrc);
-    }
-  }
-  GST_CAMSRC_UNLOCK(camerasrc);
-
   g_free (padname);
 
-  return TRUE;
+  /* the stream completing the set configures the device, no stream waits */
+  return gst_camerasrc_config_stream(camerasrc, stream_id);
 }
 
 static GstCaps *
@@ -2464,6 +3298,17 @@ gst_camerasrc_start(GstCamBaseSrc *basesrc)
   GST_INFO("Deinterlace_method=%d, io_mode=%d interlace_field=%d",
   camerasrc->deinterlace_method, camerasrc->io_mode, camerasrc->interlace_field);
 
+  /* the start barrier can't tell how many members are still to come */
+  GST_OBJECT_LOCK(camerasrc);
+  gboolean sync_size_missing = camerasrc->sync_group && *camerasrc->sync_group &&
+    camerasrc->sync_group_size == 0;
+  if (sync_size_missing)
+    GST_ERROR("CameraId=%d sync-group %s is set without sync-group-size.",
+      camerasrc->device_id, camerasrc->sync_group);
+  GST_OBJECT_UNLOCK(camerasrc);
+  if (sync_size_missing)
+    return FALSE;
+
   /* Init HAL */
   int ret = camera_hal_init();
   if (ret < 0) {
@@ -2482,9 +3327,36 @@ gst_camerasrc_start(GstCamBaseSrc *basesrc)
   }
   camerasrc->camera_open = true;
 
+  /* restore the last converged 3A state before the first frame */
+  gst_camerasrc_3a_state_seed(camerasrc);
+
+  GST_OBJECT_LOCK(camerasrc);
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    gst_camerasrc_clock_map_reset(&camerasrc->streams[i].clock_map);
+    camerasrc->streams[i].latency = 0;
+    camerasrc->streams[i].latency_reported = 0;
+  }
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    gst_caps_replace(&camerasrc->streams[i].capture_caps, NULL);
+    camerasrc->streams[i].capture_caps = gst_caps_new_simple(GST_CAMERASRC_CAPTURE_TIMESTAMP_CAPS,
+        "device-id", G_TYPE_INT, camerasrc->device_id,
+        "stream-id", G_TYPE_INT, i, NULL);
+  }
+
   //set all the params first time.
   camera_set_parameters(camerasrc->device_id, *(camerasrc->param));
 
+  gst_camerasrc_config_reset(camerasrc);
+
+  gst_camerasrc_metrics_register(camerasrc);
+  gst_camerasrc_sync_join(camerasrc);
+
+  camerasrc->trace_recording = camerasrc->trace_file || g_getenv(GST_CAMERASRC_TRACE_ENV);
+  if (camerasrc->trace_recording)
+    gst_camerasrc_trace_start();
+
   return TRUE;
 }
 
@@ -2495,12 +3367,70 @@ gst_camerasrc_stop(GstCamBaseSrc *basesrc)
   Gstcamerasrc *camerasrc = GST_CAMERASRC(basesrc);
   GST_INFO("CameraId=%d.", camerasrc->device_id);
 
-  if (camerasrc->stream_map.size())
-    camerasrc->stream_map.clear();
+  gst_camerasrc_3a_state_persist(camerasrc);
+  gst_camerasrc_metrics_unregister(camerasrc);
+  gst_camerasrc_sync_leave(camerasrc);
+  gst_camerasrc_pair_clear(camerasrc);
+
+  if (camerasrc->trace_recording) {
+    gst_camerasrc_dump_trace(camerasrc, camerasrc->trace_file ?
+        camerasrc->trace_file : g_getenv(GST_CAMERASRC_TRACE_ENV));
+    gst_camerasrc_trace_stop();
+    camerasrc->trace_recording = FALSE;
+  }
+
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++)
+    gst_caps_replace(&camerasrc->streams[i].capture_caps, NULL);
 
   return TRUE;
 }
 
+/* Move a task being created to the task pool shared by all the instances */
+static void
+gst_camerasrc_set_task_pool(Gstcamerasrc *camerasrc, GstMessage *message)
+{
+  GstTaskPool *pool = gst_camera_task_pool_get_shared(camerasrc->task_pool_size);
+  const GValue *object = gst_message_get_stream_status_object(message);
+
+  if (!pool)
+    return;
+
+  if (object && G_VALUE_HOLDS(object, GST_TYPE_TASK)) {
+    GST_INFO("CameraId=%d, task of %s in the shared task pool.", camerasrc->device_id,
+        GST_MESSAGE_SRC_NAME(message));
+    gst_task_set_pool(GST_TASK(g_value_get_object(object)), pool);
+  }
+  gst_object_unref(pool);
+}
+
+/**
+ * The pad tasks post their stream status from the thread they run on when
+ * it enters and leaves the task, the thread scheduling is set there before
+ * the application sees the message and may override it. The task is moved
+ * to the shared task pool when it is created, once one instance created it
+ */
+static gboolean
+gst_camerasrc_post_message(GstElement *element, GstMessage *message)
+{
+  Gstcamerasrc *camerasrc = GST_CAMERASRC(element);
+
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS &&
+      GST_IS_PAD(GST_MESSAGE_SRC(message))) {
+    GstStreamStatusType type;
+    GstElement *owner;
+
+    gst_message_parse_stream_status(message, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_CREATE)
+      gst_camerasrc_set_task_pool(camerasrc, message);
+    else if (type == GST_STREAM_STATUS_TYPE_ENTER)
+      gst_camerasrc_sched_enter(camerasrc, GST_MESSAGE_SRC_NAME(message));
+    else if (type == GST_STREAM_STATUS_TYPE_LEAVE)
+      gst_camerasrc_sched_leave(camerasrc);
+  }
+
+  return GST_ELEMENT_CLASS(parent_class)->post_message(element, message);
+}
+
 /**
 * there're four states defined in Gstreamer: GST_STATE_NULL, GST_STATE_READY,
 * GST_STATE_PAUSED, GST_STATE_PLAYING, which can be referred to simply as NULL,
@@ -2566,7 +3496,7 @@ gst_camerasrc_fixate(GstCamBaseSrc * basesrc, GstCaps * caps)
 }
 
 static gboolean
-gst_camerasrc_query(GstCamBaseSrc * bsrc, GstQuery * query )
+gst_camerasrc_query(GstCamBaseSrc * bsrc, GstPad *pad, GstQuery * query )
 {
   PERF_CAMERA_ATRACE();
   Gstcamerasrc *camerasrc = GST_CAMERASRC(bsrc);
@@ -2575,11 +3505,22 @@ gst_camerasrc_query(GstCamBaseSrc * bsrc, GstQuery * query )
       gst_query_type_get_name (GST_QUERY_TYPE (query)));
 
   switch (GST_QUERY_TYPE (query)){
-    case GST_QUERY_LATENCY:
+    case GST_QUERY_LATENCY: {
+      GstClockTime min_latency, max_latency;
+
+      GST_OBJECT_LOCK(camerasrc);
+      min_latency = camerasrc->min_latency;
+      max_latency = camerasrc->max_latency;
+      GST_OBJECT_UNLOCK(camerasrc);
+
+      GST_INFO("CameraId=%d report latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT ".",
+        camerasrc->device_id, GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+      gst_query_set_latency(query, TRUE, min_latency, max_latency);
       res = TRUE;
       break;
+    }
     default:
-      res = GST_CAM_BASE_SRC_CLASS(parent_class)->query(bsrc,query);
+      res = GST_CAM_BASE_SRC_CLASS(parent_class)->query(bsrc, pad, query);
       break;
   }
   return res;
@@ -2694,24 +3635,63 @@ gst_camerasrc_decide_allocation(GstCamBaseSrc *bsrc,GstQuery *query, GstPad *pad
 }
 
 
+#if GST_CHECK_VERSION(1, 14, 0)
+/* The meta is kept by the pool with the buffer, so that it is updated
+ * rather than allocated for every frame */
+static void
+gst_camerasrc_set_capture_meta(GstStreamInfo *stream, GstBuffer *buf, GstClockTime timestamp)
+{
+  GstReferenceTimestampMeta *capture_meta = NULL;
+  gpointer state = NULL;
+  GstMeta *meta;
+
+  while ((meta = gst_buffer_iterate_meta_filtered(buf, &state,
+      GST_REFERENCE_TIMESTAMP_META_API_TYPE))) {
+    GstReferenceTimestampMeta *ts_meta = (GstReferenceTimestampMeta *)meta;
+    if (gst_structure_has_name(gst_caps_get_structure(ts_meta->reference, 0),
+          GST_CAMERASRC_CAPTURE_TIMESTAMP_CAPS)) {
+      capture_meta = ts_meta;
+      break;
+    }
+  }
+
+  if (!capture_meta) {
+    capture_meta = gst_buffer_add_reference_timestamp_meta(buf, stream->capture_caps,
+        timestamp, GST_CLOCK_TIME_NONE);
+    GST_META_FLAG_SET(capture_meta, GST_META_FLAG_POOLED);
+  } else if (capture_meta->reference != stream->capture_caps) {
+    gst_caps_replace(&capture_meta->reference, stream->capture_caps);
+  }
+
+  capture_meta->timestamp = timestamp;
+}
+#endif
+
 /* Gst Clock: |---------------|-----------------------|--------------|---....
  *     (starting_time:0) (base_time)            (get v4l2 ts) (get local ts)
- *                            |                                      |
- *                            |<--------gst buffer timestamp-------->|
+ *                            |                     |                |
+ *                            |<---- capture ------>|                |
+ *                            |<--------------- clock -------------->|
+ *
+ * The v4l2 ts is mapped to the clock by the clock_map of the stream,
+ * which is refined with the clock and the monotonic time sampled at every
+ * fill, and gives the capture latency. In capture mode it is the PTS.
+ * The object lock is only taken when the latency of the stream moved.
  */
 static GstFlowReturn
 gst_camerasrc_fill(GstCamPushSrc *src, GstPad *pad, GstBuffer *buf)
 {
   PERF_CAMERA_ATRACE();
   Gstcamerasrc *camerasrc = GST_CAMERASRC(src);
-  GST_INFO("CameraId=%d.", camerasrc->device_id);
   GstClock *clock;
   GstClockTime base_time, timestamp, duration;
+  GstCameraSyncGroup *sync = NULL;
+  int sync_member = -1;
   int stream_id = gst_camerasrc_get_stream_id_by_pad(camerasrc, pad);
-  if (stream_id < 0)
+  if (stream_id < 0) {
+    gst_camerasrc_trace_dump_log();
     return GST_FLOW_ERROR;
-
-  GstCamerasrcBufferPool *bpool = GST_CAMERASRC_BUFFER_POOL(camerasrc->streams[stream_id].pool);
+  }
 
   timestamp = GST_BUFFER_TIMESTAMP (buf);
 
@@ -2729,36 +3709,167 @@ gst_camerasrc_fill(GstCamPushSrc *src, GstPad *pad, GstBuffer *buf)
   clock = GST_ELEMENT_CLOCK(camerasrc);
 
   if (clock) {
+    GstClockTime now, capture_time = 0;
+    GstStreamInfo *stream = &camerasrc->streams[stream_id];
+    gboolean have_capture, latency_changed;
+    guint64 monotonic;
+
     base_time = GST_ELEMENT_CAST (camerasrc)->base_time;
-    /* gstbuf_timestamp is the accurate timestamp since the base_time */
-    camerasrc->streams[stream_id].gstbuf_timestamp = gst_clock_get_time(clock) - base_time;
+
+    now = gst_camerasrc_clock_map_sample(&stream->clock_map, clock, &monotonic);
+    have_capture = gst_camerasrc_clock_map_convert(&stream->clock_map, timestamp,
+      monotonic, &capture_time);
+    gst_camerasrc_clock_map_publish(&stream->clock_map, &stream->stats);
+
+    if (have_capture && now >= capture_time) {
+      /* follow rises quickly as a too low min latency makes frames late */
+      GstClockTime latency = now - capture_time;
+      gst_camerasrc_stats_latency(&stream->stats, latency);
+      if (stream->latency == 0)
+        stream->latency = latency;
+      else if (latency > stream->latency)
+        stream->latency += (latency - stream->latency) / 4;
+      else
+        stream->latency -= (stream->latency - latency) / 64;
+
+      GstClockTime late_latency = camerasrc->late_latency.load(std::memory_order_relaxed);
+      if (late_latency > 0 && latency > late_latency)
+        GST_CAMERASRC_STATS_ADD(stream->stats.late, 1);
+    }
+
+    if (g_atomic_int_get(&camerasrc->timestamp_mode) == GST_CAMERASRC_TIMESTAMP_MODE_CAPTURE &&
+        have_capture && capture_time >= base_time) {
+      /* gstbuf_timestamp is the capture time since the base_time */
+      stream->gstbuf_timestamp = capture_time - base_time;
+    } else {
+      if (g_atomic_int_get(&camerasrc->timestamp_mode) == GST_CAMERASRC_TIMESTAMP_MODE_CAPTURE)
+        GST_CAMERASRC_STATS_ADD(stream->stats.timestamp_fallbacks, 1);
+      stream->gstbuf_timestamp = now - base_time;
+    }
+
+    /* frame_duration and latency_reported are read by the other streams
+     * under the object lock */
+    latency_changed = FALSE;
+    if ((stream->frame_duration == 0 && duration > 0 && duration < GST_SECOND) ||
+        ABS(GST_CLOCK_DIFF(stream->latency_reported, stream->latency)) >
+          (GstClockTimeDiff)GST_CAMERASRC_LATENCY_THRESHOLD) {
+      GST_OBJECT_LOCK(camerasrc);
+      if (stream->frame_duration == 0 && duration > 0 && duration < GST_SECOND)
+        stream->frame_duration = duration;
+      stream->latency_reported = stream->latency;
+      latency_changed = gst_camerasrc_update_latency(camerasrc, TRUE);
+      GST_OBJECT_UNLOCK(camerasrc);
+    }
+
+    /* the sync group is joined and left while not streaming */
+    sync = camerasrc->sync;
+    sync_member = camerasrc->sync_member;
+
+    if (latency_changed)
+      gst_element_post_message(GST_ELEMENT_CAST(camerasrc),
+          gst_message_new_latency(GST_OBJECT_CAST(camerasrc)));
   } else {
     base_time = GST_CLOCK_TIME_NONE;
   }
 
+  /* frames captured together by the sync group share the PTS */
+  if (sync && base_time != GST_CLOCK_TIME_NONE)
+    camerasrc->streams[stream_id].gstbuf_timestamp = gst_camerasrc_sync_pair(camerasrc,
+        sync, sync_member, stream_id, timestamp, camerasrc->streams[stream_id].gstbuf_timestamp);
+
   GST_BUFFER_PTS(buf) = camerasrc->streams[stream_id].gstbuf_timestamp;
-  GST_BUFFER_OFFSET(buf) = bpool->acquire_buffer_index;
-  GST_BUFFER_OFFSET_END(buf) = bpool->acquire_buffer_index + 1;
+  /* offset is the sensor sequence so that gaps are visible downstream */
+  GST_BUFFER_OFFSET(buf) = camerasrc->streams[stream_id].sequence;
+  GST_BUFFER_OFFSET_END(buf) = camerasrc->streams[stream_id].sequence + 1;
   GST_BUFFER_DURATION(buf) = duration;
   camerasrc->streams[stream_id].time_start = camerasrc->streams[stream_id].time_end;
 
-  GST_INFO("CameraId=%d, StreamId=%d duration=%lu\n", camerasrc->device_id, stream_id, duration);
+#if GST_CHECK_VERSION(1, 14, 0)
+  /* the HAL capture time travels with the buffer so that the latency
+   * tracer can measure it at every pad downstream */
+  if (camerasrc->streams[stream_id].capture_caps)
+    gst_camerasrc_set_capture_meta(&camerasrc->streams[stream_id], buf, timestamp);
+#endif
+
+  /* the capture id pairs the frames of the pads downstream */
+  gst_camerasrc_pair_set_capture(camerasrc, stream_id, buf);
+
+  GST_CAMERASRC_LOG("fill pts=%ld, duration=%ld", (gint64)GST_BUFFER_PTS(buf), (gint64)duration);
+
+  /* statistics are posted periodically from main stream */
+  if (camerasrc->stats_interval && stream_id == GST_CAMERASRC_MAIN_STREAM_ID) {
+    guint64 now = gst_camerasrc_clock_monotonic_ns();
+    if (now - camerasrc->stats_last_post >= camerasrc->stats_interval * GST_MSECOND) {
+      camerasrc->stats_last_post = now;
+      gst_element_post_message(GST_ELEMENT_CAST(camerasrc),
+          gst_message_new_element(GST_OBJECT_CAST(camerasrc),
+            gst_camerasrc_get_stats(camerasrc)));
+    }
+  }
 
   return GST_FLOW_OK;
 }
 
+static gboolean
+gst_camerasrc_dump_trace(Gstcamerasrc *camerasrc, const gchar *path)
+{
+  if (!path)
+    return FALSE;
+
+  GST_INFO("CameraId=%d dump trace to %s.", camerasrc->device_id, path);
+
+  return gst_camerasrc_trace_dump(path);
+}
+
 static gboolean
 gst_camerasrc_unlock(GstCamBaseSrc *src)
 {
+  gst_camerasrc_config_set_flushing(GST_CAMERASRC(src), TRUE);
   return TRUE;
 }
 
 static gboolean
 gst_camerasrc_unlock_stop(GstCamBaseSrc *src)
 {
+  gst_camerasrc_config_set_flushing(GST_CAMERASRC(src), FALSE);
   return TRUE;
 }
 
+/**
+ * In multiplexed mode the streams are served in the order their next frame
+ * is predicted, the prediction being made by the same thread after dqbuf
+ */
+static GstClockTime
+gst_camerasrc_get_ready_time(GstCamBaseSrc *src, GstPad *pad)
+{
+  Gstcamerasrc *camerasrc = GST_CAMERASRC(src);
+  int stream_id = GST_CAMERASRC_PAD_STREAM_ID(pad);
+  guint64 next = camerasrc->streams[stream_id].dqbuf_next;
+
+  /* until the device is started the streams not done with their part of
+   * the startup go first, the others would wait for them */
+  if (G_UNLIKELY(g_atomic_int_get(&camerasrc->config_state) != GST_CAMERASRC_CONFIG_STARTED)) {
+    guint32 done;
+    GST_CAMSRC_LOCK(camerasrc);
+    done = camerasrc->config_started & (1u << stream_id);
+    GST_CAMSRC_UNLOCK(camerasrc);
+    return done ? G_MAXUINT64 - 1 : 0;
+  }
+
+  return next ? next : GST_CLOCK_TIME_NONE;
+}
+
+/* The frames are paired once pushed as is, after the base class may have
+ * copied them to set their flags */
+static void
+gst_camerasrc_pre_push(GstCamBaseSrc *src, GstPad *pad, GstBuffer *buf)
+{
+  Gstcamerasrc *camerasrc = GST_CAMERASRC(src);
+
+  if (camerasrc->pair_pad)
+    gst_camerasrc_pair_offer(camerasrc, GST_CAMERASRC_PAD_STREAM_ID(pad), buf);
+}
+
 /* ------3A interfaces implementations------ */
 
 /* Get customized effects
@@ -2987,6 +4098,9 @@ gst_camerasrc_set_scene_mode (GstCamerasrc3A *cam3a,
   camera_set_parameters(camerasrc->device_id, *(camerasrc->param));
   g_message("Interface Called: @%s, scene mode=%d.", __func__, (int)sceneMode);
 
+  camerasrc->man_ctl.scene_mode = (int)sceneMode;
+  gst_camerasrc_request_scene_switch(camerasrc);
+
   return TRUE;
 }
 
@@ -3730,6 +4844,9 @@ plugin_init (GstPlugin * Plugin)
 {
   PERF_CAMERA_ATRACE();
 
+  if (!gst_camerasrc_latency_tracer_register(Plugin))
+    return FALSE;
+
   return gst_element_register (Plugin, "icamerasrc", GST_RANK_NONE,
         GST_TYPE_CAMERASRC);
 }
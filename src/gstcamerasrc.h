@@ -47,7 +47,9 @@
 #define __GST_CAMERASRC_H__
 #include <sys/types.h>
 #include <map>
+#include <atomic>
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include "Parameters.h"
 #include <linux/videodev2.h>
 #include "gstcampushsrc.h"
@@ -71,12 +73,44 @@ using std::set;
 #define DEFAULT_PROP_BUFFERCOUNT 6
 #define MAX_PROP_BUFFERCOUNT 10
 #define MIN_PROP_BUFFERCOUNT 2
+/* Alignment keeping data written by different threads on different lines */
+#define GST_CAMERASRC_CACHE_LINE 64
+/* Must be a power of two larger than MAX_PROP_BUFFERCOUNT */
+#define GST_CAMERASRC_HAL_QUEUE_SIZE 16
+/* Wait of a scene switch for the streams in dqbuf once the device is
+ * stopped, in us */
+#define GST_CAMERASRC_DQBUF_IDLE_TIMEOUT (500 * G_TIME_SPAN_MILLISECOND)
+/* Latency histogram: us below 16 linear, then 8 buckets per power of two */
+#define GST_CAMERASRC_LATENCY_LINEAR 16
+#define GST_CAMERASRC_LATENCY_BUCKETS (GST_CAMERASRC_LATENCY_LINEAR + 28 * 8)
+/* Reported latency is updated when it moves more than this. While
+ * streaming, it's raised when it grows by more than 1/RISE of itself,
+ * lowered when it fell by more than 1/FALL, at most once per interval */
+#define GST_CAMERASRC_LATENCY_THRESHOLD GST_MSECOND
+#define GST_CAMERASRC_LATENCY_RISE 8
+#define GST_CAMERASRC_LATENCY_FALL 4
+#define GST_CAMERASRC_LATENCY_INTERVAL GST_SECOND
 #define DEFAULT_PROP_WDR_LEVEL 100
 #define DEFAULT_PROP_RUN_3A_CADENCE 1
 #define DEFAULT_PROP_EXPOSURE_TIME 0
 #define DEFAULT_PROP_GAIN 0.0
 #define DEFAULT_PROP_PRINT_FPS false
+#define DEFAULT_PROP_STATS_INTERVAL 0
+#define MAX_PROP_STATS_INTERVAL 3600000
 #define DEFAULT_PROP_PRINT_FIELD false
+#define DEFAULT_PROP_STARTUP_FRAME_BUDGET 30
+#define MAX_PROP_STARTUP_FRAME_BUDGET 1000
+#define DEFAULT_PROP_SCHED_PRIORITY 10
+#define MIN_PROP_SCHED_PRIORITY 1
+#define MAX_PROP_SCHED_PRIORITY 99
+#define DEFAULT_PROP_SCHED_NICE 0
+#define MIN_PROP_SCHED_NICE -20
+#define MAX_PROP_SCHED_NICE 19
+#define DEFAULT_PROP_TASK_POOL_SIZE 0
+#define MAX_PROP_TASK_POOL_SIZE 1024
+#define DEFAULT_PROP_SYNC_TOLERANCE 2000
+#define MAX_PROP_SYNC_TOLERANCE 100000
+#define DEFAULT_PROP_SYNC_GROUP_SIZE 0
 #define DEFAULT_PROP_INPUT_WIDTH 0
 #define DEFAULT_PROP_INPUT_HEIGHT 0
 #define MIN_PROP_INPUT_WIDTH 0
@@ -122,6 +156,12 @@ using std::set;
 #define DEFAULT_PROP_BUFFER_USAGE GST_CAMERASRC_BUFFER_USAGE_NONE
 /* Default value of enum type property 'fisheye-dewarping':off */
 #define DEFAULT_PROP_FISHEYE_DEWARPING_MODE GST_CAMERASRC_FISHEYE_DEWARPING_MODE_OFF
+/* Default value of enum type property 'startup-frames':push */
+#define DEFAULT_PROP_STARTUP_FRAMES_MODE GST_CAMERASRC_STARTUP_FRAMES_PUSH
+/* Default value of enum type property 'timestamp-mode':clock */
+#define DEFAULT_PROP_TIMESTAMP_MODE GST_CAMERASRC_TIMESTAMP_MODE_CLOCK
+/* Default value of enum type property 'sched-policy':other */
+#define DEFAULT_PROP_SCHED_POLICY GST_CAMERASRC_SCHED_POLICY_OTHER
 
 /* Default value of string type properties */
 #define DEFAULT_PROP_WP NULL
@@ -134,12 +174,18 @@ using std::set;
 #define DEFAULT_PROP_INPUT_FORMAT NULL
 #define DEFAULT_PROP_ISP_CONTROL NULL
 #define DEFAULT_PROP_LTM_TUNING_DATA NULL
-
+#define DEFAULT_PROP_3A_STATE_DIR NULL
+#define DEFAULT_PROP_METRICS_ENDPOINT NULL
+#define DEFAULT_PROP_TRACE_FILE NULL
+#define DEFAULT_PROP_CPU_AFFINITY NULL
+#define DEFAULT_PROP_SYNC_GROUP NULL
+#define DEFAULT_PROP_DECIMATION NULL
+
+/* The src pad is stream 0, request pads take the next id from 1 */
 enum
 {
   GST_CAMERASRC_MAIN_STREAM_ID = 0,
-  GST_CAMERASRC_VIDEO_STREAM_ID = 1,
-  GST_CAMERASRC_MAX_STREAM_NUM,
+  GST_CAMERASRC_MAX_STREAM_NUM = 8,
 };
 
 typedef enum
@@ -306,6 +352,36 @@ typedef enum
   GST_CAMERASRC_FISHEYE_DEWARPING_MODE_HITCHVIEW = 2,
 } GstCamerasrcFisheydDewarpingMode;
 
+typedef enum
+{
+  GST_CAMERASRC_STARTUP_FRAMES_PUSH = 0,
+  GST_CAMERASRC_STARTUP_FRAMES_DROP = 1,
+  GST_CAMERASRC_STARTUP_FRAMES_FLAG = 2,
+} GstCamerasrcStartupFramesMode;
+
+typedef enum
+{
+  GST_CAMERASRC_TIMESTAMP_MODE_CLOCK = 0,
+  GST_CAMERASRC_TIMESTAMP_MODE_CAPTURE = 1,
+} GstCamerasrcTimestampMode;
+
+typedef enum
+{
+  GST_CAMERASRC_SCHED_POLICY_OTHER = 0,
+  GST_CAMERASRC_SCHED_POLICY_FIFO = 1,
+  GST_CAMERASRC_SCHED_POLICY_RR = 2,
+} GstCamerasrcSchedPolicy;
+
+/* Startup of the device, each step is run by the stream completing it */
+typedef enum
+{
+  GST_CAMERASRC_CONFIG_IDLE = 0,
+  GST_CAMERASRC_CONFIG_COLLECTING = 1,
+  GST_CAMERASRC_CONFIG_CONFIGURED = 2,
+  GST_CAMERASRC_CONFIG_STARTED = 3,
+  GST_CAMERASRC_CONFIG_FAILED = 4,
+} GstCamerasrcConfigState;
+
 typedef enum
 {
   GST_CAMERASRC_STATUS_DEFAULT = 0,
@@ -329,21 +405,65 @@ typedef enum
 #define GST_CAMSRC_GET_LOCK(src) \
   (&GST_CAMERASRC_CAST(src)->lock)
 #define GST_CAMSRC_LOCK(src) \
-  g_mutex_lock(GST_CAMSRC_GET_LOCK(src))
+  GST_CAMERASRC_MUTEX_LOCK(GST_CAMSRC_GET_LOCK(src), &GST_CAMERASRC_CAST(src)->lock_stats)
 #define GST_CAMSRC_UNLOCK(src) \
-  g_mutex_unlock(GST_CAMSRC_GET_LOCK(src))
+  GST_CAMERASRC_MUTEX_UNLOCK(GST_CAMSRC_GET_LOCK(src), &GST_CAMERASRC_CAST(src)->lock_stats)
 #define GST_CAMSRC_GET_COND(src) \
   (&GST_CAMERASRC_CAST(src)->cond)
 #define GST_CAMSRC_WAIT(src) \
-  g_cond_wait(GST_CAMSRC_GET_COND(src), GST_CAMSRC_GET_LOCK(src))
+  GST_CAMERASRC_COND_WAIT(GST_CAMSRC_GET_COND(src), GST_CAMSRC_GET_LOCK(src), \
+    &GST_CAMERASRC_CAST(src)->lock_stats)
+#define GST_CAMSRC_WAIT_UNTIL(src, end_time) \
+  GST_CAMERASRC_COND_WAIT_UNTIL(GST_CAMSRC_GET_COND(src), GST_CAMSRC_GET_LOCK(src), \
+    &GST_CAMERASRC_CAST(src)->lock_stats, (end_time))
+#define GST_CAMSRC_QBUF_LOCK(src) \
+  GST_CAMERASRC_MUTEX_LOCK(&GST_CAMERASRC_CAST(src)->qbuf_mutex, \
+    &GST_CAMERASRC_CAST(src)->qbuf_lock_stats)
+#define GST_CAMSRC_QBUF_UNLOCK(src) \
+  GST_CAMERASRC_MUTEX_UNLOCK(&GST_CAMERASRC_CAST(src)->qbuf_mutex, \
+    &GST_CAMERASRC_CAST(src)->qbuf_lock_stats)
 #define GST_CAMSRC_SIGNAL(src) \
   g_cond_signal(GST_CAMSRC_GET_COND(src))
+#define GST_CAMSRC_BROADCAST(src) \
+  g_cond_broadcast(GST_CAMSRC_GET_COND(src))
+
+/* Stream id of a source pad, the index of its state in the base class so
+ * that the frame path needs no lookup */
+#define GST_CAMERASRC_PAD_STREAM_ID(pad) \
+  ((int) GST_CAM_BASE_SRC_PAD_INDEX(pad))
+
+/* Reference of the GstReferenceTimestampMeta carrying the HAL capture time
+ * in ns of CLOCK_MONOTONIC, with device-id and stream-id fields */
+#define GST_CAMERASRC_CAPTURE_TIMESTAMP_CAPS "timestamp/x-icamerasrc-capture"
+
+/* Whether a stream pushes the frame of the capture with HAL sequence seq,
+ * spreading the frames kept evenly over the captures. It depends on the
+ * sequence only so that the pads pairing frames agree on the captures */
+#define GST_CAMERASRC_STREAM_KEEPS(stream, seq) \
+  ((stream)->decimation_num >= (stream)->decimation_den || \
+   ((guint64)(seq) % (stream)->decimation_den) * (stream)->decimation_num % \
+     (stream)->decimation_den < (stream)->decimation_num)
+
+/* Captures whose frames can be pushed on the video pads while waiting for
+ * the other streams, the video pads run up to a frame apart */
+#define GST_CAMERASRC_PAIR_SETS 4
+/* Pair buffers not released downstream yet, each holds a buffer of the
+ * pool of every stream paired, no capture is paired beyond them */
+#define GST_CAMERASRC_PAIR_MAX_PENDING 2
+
+/* Set on frames captured before AE/AWB converged in 'startup-frames=flag' mode */
+#define GST_CAMERASRC_BUFFER_FLAG_UNCONVERGED (GST_VIDEO_BUFFER_FLAG_LAST << 0)
 
 typedef struct _Gstcamerasrc Gstcamerasrc;
 typedef struct _GstcamerasrcClass GstcamerasrcClass;
-typedef struct _GstFpsDebug GstFpsDebug;
+typedef struct _GstLatencyHistogram GstLatencyHistogram;
+typedef struct _GstStreamStats GstStreamStats;
 typedef struct _Gst3AManualControl Gst3AManualControl;
 typedef struct _GstStreamInfo GstStreamInfo;
+typedef struct _Gst3AState Gst3AState;
+typedef struct _GstClockMapping GstClockMapping;
+typedef struct _GstCameraSyncGroup GstCameraSyncGroup;
+typedef struct _GstCameraPairSet GstCameraPairSet;
 
 typedef struct
 {
@@ -351,18 +471,83 @@ typedef struct
   unsigned int size;
 } isp_control_header;
 
-/* Used to update fps*/
-struct _GstFpsDebug
-{
-  struct timeval dqbuf_start_tm_count,dqbuf_tm_start,qbuf_tm_end;
-  double buf_count;
-  double last_buf_count;
-  double max_fps;
-  double min_fps;
-  double av_fps;
-  double sum_time;
-  double tm_interval;
-  bool init_max_min_fps;
+/* Log-linear histogram of latencies: 1us buckets up to LATENCY_LINEAR us,
+ * then 8 buckets per power of two, updated with relaxed atomics */
+struct _GstLatencyHistogram
+{
+  std::atomic<guint64> buckets[GST_CAMERASRC_LATENCY_BUCKETS];
+  std::atomic<guint64> sum;
+  std::atomic<guint64> count;
+};
+
+/* Frames of one capture pushed on the video pads so far, the set is pushed
+ * on the pair pad once all the expected streams are members */
+struct _GstCameraPairSet
+{
+  guint64 capture_id;
+  /* masks of stream ids */
+  guint expected;
+  guint members;
+  GstBuffer *frames[GST_CAMERASRC_MAX_STREAM_NUM];
+};
+
+/* Runtime statistics of a stream, times are in ns of CLOCK_MONOTONIC.
+ * Updated with relaxed atomics from streaming and releasing threads
+ * so that they can be read at any time without taking a lock */
+struct _GstStreamStats
+{
+  /* frames dequeued, fps over the last interval and since counting began */
+  std::atomic<guint64> frames;
+  std::atomic<guint64> fps_start;
+  std::atomic<guint64> fps_window_start;
+  std::atomic<guint64> fps_window_frames;
+  std::atomic<double> fps;
+  std::atomic<double> max_fps;
+  std::atomic<double> min_fps;
+
+  std::atomic<guint64> dqbuf_wait;
+  std::atomic<guint64> dqbuf_wait_max;
+  std::atomic<guint64> deinterlace;
+
+  /* frames missing in the sequence, delivered again or pushed later
+   * than max latency */
+  std::atomic<guint64> dropped;
+  std::atomic<guint64> duplicated;
+  std::atomic<guint64> late;
+  /* frames missing in the sets of their capture for the pair pad */
+  std::atomic<guint64> unpaired;
+  /* frames given back to HAL at dqbuf by the stream decimation */
+  std::atomic<guint64> decimated;
+
+  /* capture to push time of the frames */
+  GstLatencyHistogram latency;
+
+  /* clock mapping of the stream, published at every fill, and frames
+   * whose capture time could not be mapped */
+  std::atomic<guint64> clock_samples;
+  std::atomic<double> clock_skew;
+  std::atomic<gint64> clock_offset;
+  std::atomic<double> clock_residual_var;
+  std::atomic<guint64> clock_residual_max;
+  std::atomic<guint64> timestamp_fallbacks;
+
+  /* time the streaming thread waited for a cpu between two frames */
+  GstLatencyHistogram sched_delay;
+
+  /* capture time distance to the first frame of the sync group set */
+  GstLatencyHistogram sync_skew;
+
+  /* Counters below are mostly updated by the threads releasing buffers */
+
+  /* buffers pushed and not released yet, time they were held for */
+  alignas(GST_CAMERASRC_CACHE_LINE) std::atomic<gint64> held;
+  std::atomic<guint64> hold;
+  std::atomic<guint64> releases;
+  std::atomic<guint64> qbuf;
+  std::atomic<guint64> qbufs;
+
+  /* buffers owned by HAL */
+  std::atomic<gint64> hal_queued;
 };
 
 struct _Gst3AManualControl
@@ -423,10 +608,112 @@ struct _Gst3AManualControl
 
 using namespace icamera;
 
-/* Describe info of each stream when constructing bufferpool */
+/* Mapping from HAL capture time (CLOCK_MONOTONIC) to the pipeline clock,
+ * both are sampled together at every fill and fitted by an exponentially
+ * weighted linear regression: clock = mean_y + skew * (mono - mean_x) */
+struct _GstClockMapping
+{
+  /* clock the samples were taken from, only compared and never reffed */
+  GstClock *clock;
+  guint64 samples;
+
+  gdouble mean_x;
+  gdouble mean_y;
+  gdouble cov_xx;
+  gdouble cov_xy;
+  gdouble skew;
+
+  /* deviation of new samples from the fit before it's updated */
+  gdouble residual_var;
+  guint64 residual_max;
+};
+
+/* Converged 3A state of the device, persisted across sessions */
+struct _Gst3AState
+{
+  /* last converged results read back from HAL */
+  gboolean valid;
+  int64_t exposure_time;
+  float gain;
+  camera_awb_gains_t awb_gains;
+
+  /* seeded values are kept until the first frame is dequeued */
+  gboolean seed_pending;
+
+  /* frames dequeued since start and frames taken by AE/AWB
+   * to converge, -1 means not converged yet */
+  int frame_count;
+  int converge_frames;
+};
+
+/* Describe info of each stream when constructing bufferpool.
+ * Fields are grouped by the thread writing them every frame, each group
+ * starts a cache line so that the src and video pad threads and the
+ * threads releasing buffers don't write the same lines. The streams
+ * are allocated aligned on a cache line, see gst_camerasrc_init */
 struct _GstStreamInfo
 {
-  GstBufferPool *pool;
+  /* Written by the streaming thread of the stream */
+
+  /* HAL sequence of the current frame and of the last one dequeued,
+   * -1 when none yet, the sequence restarts with reconfig_count */
+  alignas(GST_CAMERASRC_CACHE_LINE) gint64 sequence;
+  gint64 last_sequence;
+  gint reconfig_count;
+  gboolean discont;
+  /* previous sequence*/
+  int previous_sequence;
+
+  /* Calculate Gstbuffer timestamp*/
+  GstClockTime time_end;
+  GstClockTime time_start;
+  GstClockTime gstbuf_timestamp;
+
+  /* Capture to push time tracked at fill from the capture time mapped
+   * to the clock, the mapping is per stream so fill takes no lock */
+  GstClockTime latency;
+  GstClockMapping clock_map;
+
+  /* Latency and frame duration given to gst_camerasrc_update_latency,
+   * written with the object lock when the stream's moved. The frame
+   * duration is from caps or measured when caps have no framerate */
+  GstClockTime latency_reported;
+  GstClockTime frame_duration;
+
+  /* Frames held back or flagged while 3A converges */
+  guint startup_frame_count;
+  gboolean startup_done;
+
+  /* Predicted arrival of the next frame in multiplexed mode, 0 when
+   * unknown */
+  guint64 dqbuf_next;
+
+  /* Consumed by dqbuf, see hal_buffers. dqbuf_busy is set from before
+   * dqbuf until its buffer is popped, a scene switch waits for it to be
+   * cleared before the buffers HAL owns are requeued */
+  gint hal_head;
+  gint dqbuf_busy;
+
+  /* Written under qbuf_mutex by the threads releasing buffers */
+
+  /* Buffers released by downstream waiting to be queued to HAL together
+   * with the other streams, a fixed ring */
+  alignas(GST_CAMERASRC_CACHE_LINE) camera_buffer_t *buffer_queue[GST_CAMERASRC_HAL_QUEUE_SIZE];
+  guint queue_head;
+  guint queue_tail;
+
+  /* Buffers owned by HAL in queuing order, appended under qbuf_mutex
+   * and consumed by dqbuf, so they can be queued again after the device
+   * is restarted */
+  camera_buffer_t *hal_buffers[GST_CAMERASRC_HAL_QUEUE_SIZE];
+  gint hal_tail;
+
+  /* Fps and timings of stream, split by writing thread as well */
+  GstStreamStats stats;
+
+  /* Configuration, written at negotiation and start only */
+
+  alignas(GST_CAMERASRC_CACHE_LINE) GstBufferPool *pool;
 
   /* This is used for down stream plugin buffer pool, in
    * dma-import mode, icamerasrc will get the down stream
@@ -437,8 +724,6 @@ struct _GstStreamInfo
     * top stores odd lines, bottom stores even lines*/
   camera_buffer_t *top;
   camera_buffer_t *bottom;
-  /* previous sequence*/
-  int previous_sequence;
 
   /* Buffer config */
   guint bpl;
@@ -446,19 +731,13 @@ struct _GstStreamInfo
   const char *fmt_name;
   camera_info_t cam_info;
 
-  /* stream config flag */
-  gboolean stream_config_done;
-
-  /* buffers queue */
-  queue<camera_buffer_t*> *buffer_queue;
-
-  /* Calculate Gstbuffer timestamp*/
-  GstClockTime time_end;
-  GstClockTime time_start;
-  GstClockTime gstbuf_timestamp;
+  /* Reference of the capture timestamp meta, created at start */
+  GstCaps *capture_caps;
 
-  /* Fps of stream */
-  GstFpsDebug fps_debug;
+  /* decimation_num frames of every decimation_den captures are pushed,
+   * see GST_CAMERASRC_STREAM_KEEPS, the others go back to HAL at dqbuf */
+  guint decimation_num;
+  guint decimation_den;
 };
 
 struct _Gstcamerasrc
@@ -466,9 +745,9 @@ struct _Gstcamerasrc
   GstCamPushSrc element;
 
   /* Stream config */
-  map<std::string, int> stream_map;
   stream_config_t  stream_list;
-  GstStreamInfo streams[GST_CAMERASRC_MAX_STREAM_NUM];
+  /* GST_CAMERASRC_MAX_STREAM_NUM streams aligned on a cache line */
+  GstStreamInfo *streams;
   stream_t s[GST_CAMERASRC_MAX_STREAM_NUM];
   camera_buffer_t *buffer_list[GST_CAMERASRC_MAX_STREAM_NUM];
 
@@ -485,14 +764,38 @@ struct _Gstcamerasrc
   /* Used with GST_CAMSRC_LOCK and GST_CAMSRC_WAIT etc. */
   GMutex lock;
   GCond cond;
-
-  /* Protection for bufferpool activation */
-  gboolean start_config;
-  gboolean start_streams;
-  int stream_start_count;
-
-  /* Used for buffer queue action */
+  GstLockStats lock_stats;
+
+  /* Startup state machine, see gstcameraconfig.cpp. The masks of the
+   * streams with their caps set and their pool started are protected by
+   * GST_CAMSRC_LOCK, config_state is written with it and may be read
+   * without. Waits for a state end when flushing, or fail once nothing
+   * progressed until config_deadline */
+  gint config_state;
+  guint32 config_streams;
+  guint32 config_started;
+  gint64 config_deadline;
+  gboolean config_flushing;
+
+  /* Increased when a setting of the specialized frame path changes */
+  gint frame_path_serial;
+
+  /* Used for buffer queue action, with GST_CAMSRC_QBUF_LOCK. It is taken
+   * before GST_CAMSRC_LOCK when both are needed, never while holding it */
   GMutex qbuf_mutex;
+  GstLockStats qbuf_lock_stats;
+
+  /* Runtime scene mode switch, reconfig_count is increased each time
+   * the device is restarted so that streams failing in dqbuf meanwhile
+   * can retry. The device runs the operation mode of scene_mode_applied,
+   * written with GST_CAMSRC_LOCK, reconfiguring is read atomically by
+   * the streams before dqbuf */
+  gint scene_switch_pending;
+  int scene_mode_applied;
+  gboolean reconfiguring;
+  gint reconfig_count;
+  GstClockTime scene_switch_time;
+  GstClockTime scene_switch_last_ts;
 
   /* non-3A properties */
   int device_id;
@@ -514,6 +817,80 @@ struct _Gstcamerasrc
   /* 3A properties */
   Gst3AManualControl man_ctl;
 
+  /* 3A state persistence, results are read into result_param
+   * so that the user settings in param are not overwritten */
+  gchar *state_dir;
+  Gst3AState state_3a;
+  Parameters *result_param;
+
+  /* Unconverged startup frames handling */
+  int startup_frames_mode;
+  guint startup_frame_budget;
+  gint64 device_start_time;
+
+  /* Buffer timestamps, set with the object lock and read atomically by
+   * the streaming threads */
+  int timestamp_mode;
+
+  /* Period of stats messages in ms, 0 to disable, and last post time */
+  guint stats_interval;
+  guint64 stats_last_post;
+
+  /* Endpoint of the process wide metrics exporter */
+  gchar *metrics_endpoint;
+
+  /* Trace is written there at stop, the frame path is only recorded
+   * between start and stop of the instances writing one */
+  gchar *trace_file;
+  gboolean trace_recording;
+
+  /* Scheduling of the task threads, cpu_affinity is protected by
+   * the object lock */
+  int sched_policy;
+  int sched_priority;
+  int sched_nice;
+  gchar *cpu_affinity;
+
+  /* Threads of the task pool shared by all the instances, the first
+   * instance with a size creates it, 0 keeps the default pool */
+  guint task_pool_size;
+
+  /* Frames of the instances in the same sync group share their PTS when
+   * captured within sync_tolerance us, sync_group and sync are protected
+   * by the object lock and sync is set from start to stop */
+  gchar *sync_group;
+  guint sync_tolerance;
+  /* Members the start barrier waits for, required with sync_group */
+  guint sync_group_size;
+  GstCameraSyncGroup *sync;
+  int sync_member;
+
+  /* Request pad pushing the frames of the video pads from the same capture
+   * together, added and removed while stopped. The sets of the captures
+   * in flight are indexed by capture id under pair_lock, the rest is
+   * used with the STREAM_LOCK of pair_pad */
+  GstPad *pair_pad;
+  gulong pair_probe;
+  GMutex pair_lock;
+  GstCameraPairSet pair_sets[GST_CAMERASRC_PAIR_SETS];
+  /* pair buffers pushed and not released yet (atomic) */
+  gint pair_pending;
+  gboolean pair_events_sent;
+  gboolean pair_pushed;
+  guint64 pair_last_capture;
+
+  /* Decimation of each stream by stream id, the device runs at the
+   * highest framerate of the caps and the streams with a lower one are
+   * decimated to it, protected by the object lock */
+  gchar *decimation;
+
+  /* Latency answered to LATENCY query, protected by the object lock,
+   * max latency is read by the streaming threads to count late frames */
+  GstClockTime min_latency;
+  GstClockTime max_latency;
+  std::atomic<guint64> late_latency;
+  guint64 latency_update_time;
+
   /* log print level */
   int debugLevel;
 };
@@ -521,9 +898,16 @@ struct _Gstcamerasrc
 struct _GstcamerasrcClass
 {
   GstCamPushSrcClass parent_class;
+
+  /* action signals */
+  gboolean (*dump_trace) (Gstcamerasrc *camerasrc, const gchar *path);
 };
 
 GType gst_camerasrc_get_type (void);
+GstStructure *gst_camerasrc_get_stats (Gstcamerasrc *camerasrc);
+void gst_camerasrc_switch_scene_mode (Gstcamerasrc *camerasrc);
+gboolean gst_camerasrc_configure_device (Gstcamerasrc *camerasrc, int stream_id, guint32 streams);
+void gst_camerasrc_post_scene_switch (Gstcamerasrc *camerasrc, GstClockTime timestamp);
 
 G_END_DECLS
 
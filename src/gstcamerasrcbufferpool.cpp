@@ -59,12 +59,19 @@
 
 #include "ICamera.h"
 #include "ScopedAtrace.h"
+#include "gstcameratrace.h"
 
 #include "gstcameradeinterlace.h"
 #include "gstcamerasrcbufferpool.h"
 #include "gstcamerasrc.h"
+#include "gstcamera3astate.h"
+#include "gstcameraclock.h"
+#include "gstcamerastats.h"
+#include "gstcamerasched.h"
+#include "gstcameraconfig.h"
 #include <iostream>
 #include <time.h>
+#include <errno.h>
 #include <queue>
 #include "utils.h"
 
@@ -117,6 +124,7 @@ static GstFlowReturn gst_camerasrc_buffer_pool_acquire_buffer (GstBufferPool * b
     GstBufferPoolAcquireParams * params);
 static void gst_camerasrc_buffer_pool_free_buffer (GstBufferPool * bpool, GstBuffer * buffer);
 static void gst_camerasrc_free_weave_buffer (Gstcamerasrc *src, int stream_id);
+static void gst_camerasrc_queue_buffer (GstCamerasrcBufferPool *pool, camera_buffer_t *buffer);
 
 static void
 gst_camerasrc_buffer_pool_finalize (GObject * object)
@@ -178,7 +186,8 @@ gst_camerasrc_buffer_pool_new (Gstcamerasrc *camerasrc,
   gst_buffer_pool_set_config (GST_BUFFER_POOL_CAST (pool), s);
 
   /* init buffer queue */
-  camerasrc->streams[stream_id].buffer_queue = new queue<camera_buffer_t*>;
+  camerasrc->streams[stream_id].queue_head = 0;
+  camerasrc->streams[stream_id].queue_tail = 0;
 
   GST_INFO("CameraId=%d, StreamId=%d Buffer pool config: min buffers=%d, max buffers=%d, buffer bpl=%d, bpp=%d, size=%d",
                    camerasrc->device_id, stream_id, MIN_PROP_BUFFERCOUNT, MAX_PROP_BUFFERCOUNT,
@@ -230,17 +239,17 @@ gst_camerasrc_buffer_pool_set_config (GstBufferPool * bpool, GstStructure * conf
   return GST_BUFFER_POOL_CLASS (parent_class)->set_config (bpool, config);
 }
 
-static void
-gst_camerasrc_init_fps (Gstcamerasrc * src, int stream_id)
+/* the mmap and exported buffers come from camera_device_allocate_memory */
+static gboolean
+gst_camerasrc_buffer_pool_hal_allocates(Gstcamerasrc *camerasrc)
 {
-  src->streams[stream_id].fps_debug.buf_count = 0;
-  src->streams[stream_id].fps_debug.last_buf_count = 0;
-  src->streams[stream_id].fps_debug.sum_time = 0;
-  src->streams[stream_id].fps_debug.tm_interval = 0;
-  src->streams[stream_id].fps_debug.max_fps = 0;
-  src->streams[stream_id].fps_debug.min_fps = 0;
-  src->streams[stream_id].fps_debug.av_fps = 0;
-  src->streams[stream_id].fps_debug.init_max_min_fps = true;
+  switch (camerasrc->io_mode) {
+    case GST_CAMERASRC_IO_MODE_MMAP:
+    case GST_CAMERASRC_IO_MODE_DMA_EXPORT:
+      return TRUE;
+    default:
+      return FALSE;
+  }
 }
 
 static gboolean
@@ -250,11 +259,25 @@ gst_camerasrc_buffer_pool_start (GstBufferPool * bpool)
   GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL(bpool);
   Gstcamerasrc *camerasrc = pool->src;
   int stream_id = pool->stream_id;
-  int count = 0;
   GST_INFO("CameraId=%d, StreamId=%d.", camerasrc->device_id, pool->stream_id);
 
-  if (camerasrc->print_fps)
-    gst_camerasrc_init_fps(camerasrc, stream_id);
+  gst_camerasrc_stats_reset(&camerasrc->streams[stream_id].stats);
+
+  camerasrc->streams[stream_id].hal_head = 0;
+  camerasrc->streams[stream_id].hal_tail = 0;
+  camerasrc->streams[stream_id].last_sequence = -1;
+  camerasrc->streams[stream_id].dqbuf_next = 0;
+  pool->multiplex = gst_cam_base_src_get_multiplex(GST_CAM_BASE_SRC(camerasrc));
+  camerasrc->streams[stream_id].startup_frame_count = 0;
+  camerasrc->streams[stream_id].startup_done =
+    (camerasrc->startup_frames_mode == GST_CAMERASRC_STARTUP_FRAMES_PUSH);
+
+  gst_camerasrc_buffer_pool_select_path(pool);
+
+  /* HAL allocates the memory of the configured streams only */
+  if (gst_camerasrc_buffer_pool_hal_allocates(camerasrc) &&
+      gst_camerasrc_config_wait(camerasrc, stream_id, GST_CAMERASRC_CONFIG_CONFIGURED) != GST_FLOW_OK)
+    return FALSE;
 
   pool->buffers = g_new0 (GstBuffer *, pool->number_of_buffers);
   GST_INFO("CameraId=%d, StreamId=%d start pool %p, Thread ID=%ld, number of buffers in pool=%d.",
@@ -265,32 +288,11 @@ gst_camerasrc_buffer_pool_start (GstBufferPool * bpool)
     return FALSE;
   }
 
-  GST_CAMSRC_LOCK(camerasrc);
   GST_INFO("CameraId=%d, StreamId=%d pool is activated %p.",
     camerasrc->device_id, pool->stream_id, pool);
 
-  /* interface:camera_device_start() can only be called once, hence the last stream that
-   * calls this function should do that, otherwise device would start when other thread
-   * is not ready */
-  count = camerasrc->stream_start_count--;
-
-  /* when count drops to 1, means that this's the last thread that calls this function */
-  if (count == 1) {
-    camera_device_start(camerasrc->device_id);
-    GST_INFO("CameraId=%d StreamId=%d Stream count=%d, Bufferpool alloc done, ready to start streaming.",
-      camerasrc->device_id, stream_id, count);
-    camerasrc->start_streams = TRUE;
-    GST_CAMSRC_SIGNAL(camerasrc);
-  } else {
-    while(!camerasrc->start_streams) {
-      GST_INFO("CameraId=%d, StreamId=%d Stream count=%d, wait for stream start signal.",
-        camerasrc->device_id, stream_id, count);
-      GST_CAMSRC_WAIT(camerasrc);
-    }
-  }
-  GST_CAMSRC_UNLOCK(camerasrc);
-
-  return TRUE;
+  /* the stream completing the set starts the device, no stream waits */
+  return gst_camerasrc_config_start_stream(camerasrc, stream_id);
 }
 
 static int
@@ -629,6 +631,7 @@ gst_camerasrc_buffer_pool_alloc_buffer (GstBufferPool * bpool, GstBuffer ** buff
   }
 
   meta->index = pool->number_allocated;
+  meta->acquire_time = 0;
   pool->buffers[meta->index] = alloc_buffer;
   pool->number_allocated++;
 
@@ -650,119 +653,330 @@ gst_camerasrc_buffer_pool_alloc_buffer (GstBufferPool * bpool, GstBuffer ** buff
   }
 }
 
+static void
+gst_camerasrc_post_first_usable_frame(Gstcamerasrc *camerasrc,
+      guint skipped_frames, gboolean converged)
+{
+  GstClockTime elapsed =
+    (g_get_monotonic_time() - camerasrc->device_start_time) * GST_USECOND;
+
+  GST_INFO("CameraId=%d first usable frame after %" GST_TIME_FORMAT ", %u frames %s, 3A %s.",
+    camerasrc->device_id, GST_TIME_ARGS(elapsed), skipped_frames,
+    camerasrc->startup_frames_mode == GST_CAMERASRC_STARTUP_FRAMES_DROP ? "dropped" : "flagged",
+    converged ? "converged" : "frame budget expired");
+
+  gst_element_post_message(GST_ELEMENT_CAST(camerasrc),
+      gst_message_new_element(GST_OBJECT_CAST(camerasrc),
+        gst_structure_new("first-usable-frame",
+          "device-id", G_TYPE_INT, camerasrc->device_id,
+          "time", G_TYPE_UINT64, elapsed,
+          "frames", G_TYPE_UINT, skipped_frames,
+          "converged", G_TYPE_BOOLEAN, converged, NULL)));
+}
+
+static void
+gst_camerasrc_hal_queue_push(GstStreamInfo *stream, camera_buffer_t *buffer)
+{
+  guint tail = (guint) g_atomic_int_get(&stream->hal_tail);
+
+  stream->hal_buffers[tail % GST_CAMERASRC_HAL_QUEUE_SIZE] = buffer;
+  g_atomic_int_set(&stream->hal_tail, (gint)(tail + 1));
+  GST_CAMERASRC_STATS_ADD(stream->stats.hal_queued, 1);
+}
+
+/* A stream never has more buffers than the ring can hold, a full ring
+ * means a buffer is queued twice. qbuf_mutex must be held */
+static gboolean
+gst_camerasrc_buffer_queue_push(GstStreamInfo *stream, camera_buffer_t *buffer)
+{
+  if (stream->queue_tail - stream->queue_head >= GST_CAMERASRC_HAL_QUEUE_SIZE) {
+    GST_ERROR("buffer queue full, %d buffers are already waiting for qbuf",
+      GST_CAMERASRC_HAL_QUEUE_SIZE);
+    return FALSE;
+  }
+
+  stream->buffer_queue[stream->queue_tail % GST_CAMERASRC_HAL_QUEUE_SIZE] = buffer;
+  stream->queue_tail++;
+  return TRUE;
+}
+
 /**
-  *Use system time to update fps when dqbuf for every 2 seconds
-  */
-void gst_camerasrc_update_fps(Gstcamerasrc *camerasrc, int stream_id)
+ * Remove a dequeued buffer from the buffers HAL owns. HAL returns the
+ * buffers of a stream in queuing order, the entry is still matched so
+ * that a buffer is never requeued while the stream holds it
+ */
+static void
+gst_camerasrc_hal_queue_pop(GstStreamInfo *stream, camera_buffer_t *buffer)
 {
-  PERF_CAMERA_ATRACE();
-  camerasrc->streams[stream_id].fps_debug.buf_count++;
-
-  /* Don't start counting fps after first few buffers due to they're not stable */
-  if (camerasrc->streams[stream_id].fps_debug.buf_count == FPS_BUF_COUNT_START) {
-      gettimeofday(&camerasrc->streams[stream_id].fps_debug.dqbuf_start_tm_count,NULL);
-      camerasrc->streams[stream_id].fps_debug.dqbuf_tm_start = camerasrc->streams[stream_id].fps_debug.dqbuf_start_tm_count;
-      camerasrc->streams[stream_id].fps_debug.last_buf_count = camerasrc->streams[stream_id].fps_debug.buf_count;
-  } else if (camerasrc->streams[stream_id].fps_debug.buf_count > FPS_BUF_COUNT_START) {
-      gettimeofday(&camerasrc->streams[stream_id].fps_debug.qbuf_tm_end,NULL);
-      double duration = (camerasrc->streams[stream_id].fps_debug.qbuf_tm_end.tv_sec -
-                         camerasrc->streams[stream_id].fps_debug.dqbuf_tm_start.tv_sec)*1000000 +
-                         camerasrc->streams[stream_id].fps_debug.qbuf_tm_end.tv_usec -
-                         camerasrc->streams[stream_id].fps_debug.dqbuf_tm_start.tv_usec;
-      //calculate pipeline runtime
-      camerasrc->streams[stream_id].fps_debug.sum_time += duration;
-      camerasrc->streams[stream_id].fps_debug.tm_interval += duration;
-      camerasrc->streams[stream_id].fps_debug.dqbuf_tm_start = camerasrc->streams[stream_id].fps_debug.qbuf_tm_end;
-
-      if (camerasrc->streams[stream_id].fps_debug.tm_interval >= FPS_TIME_INTERVAL) {
-          double interval_fps = (camerasrc->streams[stream_id].fps_debug.buf_count -
-                             camerasrc->streams[stream_id].fps_debug.last_buf_count)/
-                             (camerasrc->streams[stream_id].fps_debug.tm_interval/1000000);
-          g_print("fps:%.4f   Camera name: %s Stream Id: %d\n",
-            interval_fps, camerasrc->streams[stream_id].cam_info.name, stream_id);
-
-          if (camerasrc->streams[stream_id].fps_debug.init_max_min_fps) {
-              camerasrc->streams[stream_id].fps_debug.max_fps = interval_fps;
-              camerasrc->streams[stream_id].fps_debug.min_fps = interval_fps;
-              camerasrc->streams[stream_id].fps_debug.init_max_min_fps = false;
-          }
-
-          if (interval_fps >= camerasrc->streams[stream_id].fps_debug.max_fps) {
-              camerasrc->streams[stream_id].fps_debug.max_fps = interval_fps;
-          } else if (interval_fps < camerasrc->streams[stream_id].fps_debug.min_fps) {
-              camerasrc->streams[stream_id].fps_debug.min_fps = interval_fps;
-          }
-
-          camerasrc->streams[stream_id].fps_debug.tm_interval = 0;
-          camerasrc->streams[stream_id].fps_debug.last_buf_count = camerasrc->streams[stream_id].fps_debug.buf_count;
-      }
+  guint head = (guint) g_atomic_int_get(&stream->hal_head);
+  guint tail = (guint) g_atomic_int_get(&stream->hal_tail);
+  guint pos;
+
+  for (pos = head; pos != tail; pos++) {
+    if (stream->hal_buffers[pos % GST_CAMERASRC_HAL_QUEUE_SIZE] == buffer)
+      break;
+  }
+  if (pos == tail) {
+    GST_WARNING("dequeued buffer %p is not owned by HAL", buffer);
+    return;
+  }
+
+  /* keep the order of the buffers queued before it */
+  for (; pos != head; pos--)
+    stream->hal_buffers[pos % GST_CAMERASRC_HAL_QUEUE_SIZE] =
+      stream->hal_buffers[(pos - 1) % GST_CAMERASRC_HAL_QUEUE_SIZE];
+
+  g_atomic_int_set(&stream->hal_head, (gint)(head + 1));
+  GST_CAMERASRC_STATS_ADD(stream->stats.hal_queued, -1);
+}
+
+/* dqbuf returning faster than this found the frame already there */
+#define DQBUF_READY_TIME (20 * GST_USECOND)
+
+/**
+ * Predict when the frame after the one dequeued between start and end
+ * arrives. When dqbuf blocked, the frame arrived at end. When it returned
+ * at once, more frames may be waiting in HAL, there is no prediction and
+ * the next dqbuf is done right away until one blocks again
+ */
+static void
+gst_camerasrc_dqbuf_predict(GstStreamInfo *stream, guint64 start, guint64 end)
+{
+  if (stream->frame_duration == 0 || end - start < DQBUF_READY_TIME) {
+    stream->dqbuf_next = 0;
+    return;
+  }
+
+  stream->dqbuf_next = end + stream->frame_duration;
+}
+
+static void
+gst_camerasrc_dqbuf_done(Gstcamerasrc *camerasrc, GstStreamInfo *stream)
+{
+  g_atomic_int_set(&stream->dqbuf_busy, FALSE);
+  if (G_UNLIKELY(g_atomic_int_get(&camerasrc->reconfiguring))) {
+    GST_CAMSRC_LOCK(camerasrc);
+    GST_CAMSRC_BROADCAST(camerasrc);
+    GST_CAMSRC_UNLOCK(camerasrc);
+  }
+}
+
+/* When the device is reconfigured by another thread, dqbuf may fail,
+ * wait until the device is restarted and tell if dqbuf can be retried */
+static gboolean
+gst_camerasrc_wait_reconfigure(Gstcamerasrc *camerasrc, gint reconfig_count)
+{
+  gboolean retry;
+
+  GST_CAMSRC_LOCK(camerasrc);
+  while (g_atomic_int_get(&camerasrc->reconfiguring))
+    GST_CAMSRC_WAIT(camerasrc);
+  retry = (g_atomic_int_get(&camerasrc->reconfig_count) != reconfig_count);
+  GST_CAMSRC_UNLOCK(camerasrc);
+
+  return retry;
+}
+
+/**
+ * Check if a frame is usable or captured while 3A is still converging,
+ * a stream stops checking once AE/AWB converged or its budget expired
+ */
+static gboolean
+gst_camerasrc_is_usable_frame(GstCamerasrcBufferPool *pool)
+{
+  Gstcamerasrc *camerasrc = pool->src;
+  GstStreamInfo *stream = &camerasrc->streams[pool->stream_id];
+  gboolean converged = g_atomic_int_get(&camerasrc->state_3a.converge_frames) >= 0;
+
+  if (!converged && stream->startup_frame_count < camerasrc->startup_frame_budget) {
+    stream->startup_frame_count++;
+    return FALSE;
   }
+
+  stream->startup_done = TRUE;
+  if (pool->stream_id == GST_CAMERASRC_MAIN_STREAM_ID)
+    gst_camerasrc_post_first_usable_frame(camerasrc, stream->startup_frame_count, converged);
+
+  return TRUE;
 }
 
 /**
- * Dequeue a buffer from a stream
+ * Account the frames HAL or ISP dropped from the gap to the previous
+ * sequence, the next pushed buffer is marked DISCONT. Frames delivered
+ * again are counted only.
  */
+static void
+gst_camerasrc_track_sequence(Gstcamerasrc *camerasrc, int stream_id,
+    gint64 sequence, gint reconfig_count)
+{
+  GstStreamInfo *stream = &camerasrc->streams[stream_id];
+  gint64 expected = stream->last_sequence + 1;
+
+  stream->sequence = sequence;
+
+  /* sequence starts again once the device is restarted */
+  if (stream->last_sequence < 0 || stream->reconfig_count != reconfig_count) {
+    stream->last_sequence = sequence;
+    stream->reconfig_count = reconfig_count;
+    stream->discont = TRUE;
+    return;
+  }
+
+  if (sequence < expected) {
+    GST_INFO("CameraId=%d, StreamId=%d duplicated sequence %ld, expected %ld.",
+      camerasrc->device_id, stream_id, sequence, expected);
+    GST_CAMERASRC_STATS_ADD(stream->stats.duplicated, 1);
+    return;
+  }
+
+  if (sequence > expected) {
+    GST_INFO("CameraId=%d, StreamId=%d %ld frames dropped before sequence %ld.",
+      camerasrc->device_id, stream_id, sequence - expected, sequence);
+    GST_CAMERASRC_STATS_ADD(stream->stats.dropped, sequence - expected);
+    stream->discont = TRUE;
+  }
+
+  stream->last_sequence = sequence;
+}
+
+/**
+ * Dequeue a buffer from a stream. The frame path is instantiated for
+ * each deinterlace method and with or without the debug prints, the
+ * variant is selected by gst_camerasrc_buffer_pool_select_path
+ */
+template <GstCamerasrcDeinterlaceMethod method, bool print>
 static GstFlowReturn
-gst_camerasrc_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** buffer,
-    GstBufferPoolAcquireParams * params)
+gst_camerasrc_acquire_frame (GstCamerasrcBufferPool *pool, GstBuffer ** buffer)
 {
   PERF_CAMERA_ATRACE();
-  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL(bpool);
   Gstcamerasrc *camerasrc = pool->src;
   int stream_id = pool->stream_id;
-  GST_INFO("CameraId=%d, StreamId=%d Thread ID=%ld  .", camerasrc->device_id, pool->stream_id, gettid());
+
+  GstStreamInfo *stream = &camerasrc->streams[stream_id];
+  gst_camerasrc_sched_sample(camerasrc, &stream->stats.sched_delay);
 
   GstBuffer *gbuffer = pool->buffers[pool->acquire_buffer_index%pool->number_allocated];
   GstCamerasrcMeta *meta = GST_CAMERASRC_META_GET(gbuffer);
   int sequence_diff = 0;
   gboolean do_weaving = true;
-  const char *buffer_field;
-
-  if (camerasrc->print_fps)
-      gst_camerasrc_update_fps(camerasrc, stream_id);
 
+dqbuf:
   /* in PLAYING->PAUSED and PAUSED->NULL state, no need to dqbuf */
   if (camerasrc->running != GST_CAMERASRC_STATUS_RUNNING) {
     GST_INFO("CameraId=%d, StreamId=%d stop dqbuf.", camerasrc->device_id, pool->stream_id);
     return GST_FLOW_EOS;
   }
 
+  /* scene mode switch is done by main stream between two frames */
+  if (stream_id == GST_CAMERASRC_MAIN_STREAM_ID &&
+      g_atomic_int_get(&camerasrc->scene_switch_pending))
+    gst_camerasrc_switch_scene_mode(camerasrc);
+
+  /* a restart requeues the buffers HAL owns, so a stream doesn't dqbuf
+   * while it's done and the restart waits for the dqbuf in progress */
+  g_atomic_int_set(&stream->dqbuf_busy, TRUE);
+  if (G_UNLIKELY(g_atomic_int_get(&camerasrc->reconfiguring))) {
+    gst_camerasrc_dqbuf_done(camerasrc, stream);
+    gst_camerasrc_wait_reconfigure(camerasrc, 0);
+    goto dqbuf;
+  }
+
+  gint reconfig_count = g_atomic_int_get(&camerasrc->reconfig_count);
+
+  guint64 dqbuf_start = gst_camerasrc_clock_monotonic_ns();
   int ret = camera_stream_dqbuf(camerasrc->device_id, stream_id, &meta->buffer);
+  if (ret == 0)
+    gst_camerasrc_hal_queue_pop(stream, meta->buffer);
+  gst_camerasrc_dqbuf_done(camerasrc, stream);
   if (ret != 0) {
+    if (gst_camerasrc_wait_reconfigure(camerasrc, reconfig_count)) {
+      GST_INFO("CameraId=%d, StreamId=%d dqbuf interrupted by reconfiguration.",
+        camerasrc->device_id, pool->stream_id);
+      goto dqbuf;
+    }
     GST_ERROR("CameraId=%d, StreamId=%d dqbuf failed ret %d.",
       camerasrc->device_id, pool->stream_id, ret);
+    gst_camerasrc_trace_dump_log();
     return GST_FLOW_ERROR;
   }
 
+  /* the kept frames depend on the sequence only, so the decimated
+   * streams push frames of the same captures */
+  gboolean skip = !GST_CAMERASRC_STREAM_KEEPS(stream, meta->buffer->sequence);
+
+  GstStreamStats *stats = &stream->stats;
+  guint64 dqbuf_end = gst_camerasrc_clock_monotonic_ns();
+  if (pool->multiplex && !skip)
+    gst_camerasrc_dqbuf_predict(stream, dqbuf_start, dqbuf_end);
+  GST_CAMERASRC_STATS_ADD(stats->dqbuf_wait, dqbuf_end - dqbuf_start);
+  gst_camerasrc_stats_max(&stats->dqbuf_wait_max, dqbuf_end - dqbuf_start);
+
+  gst_camerasrc_track_sequence(camerasrc, stream_id, meta->buffer->sequence, reconfig_count);
+  GST_CAMERASRC_TRACE_FRAME(camerasrc->device_id, stream_id, meta->buffer->sequence);
+
+  if (skip) {
+    /* give the frame back to HAL before it is wrapped or timestamped */
+    gst_camerasrc_queue_buffer(pool, meta->buffer);
+    GST_CAMERASRC_STATS_ADD(stats->decimated, 1);
+    goto dqbuf;
+  }
+
+  if (gst_camerasrc_stats_frame(stats, dqbuf_end) && print && camerasrc->print_fps)
+    g_print("fps:%.4f   Camera name: %s Stream Id: %d\n",
+      GST_CAMERASRC_STATS_GET(stats->fps), camerasrc->streams[stream_id].cam_info.name, stream_id);
+
   GstClockTime timestamp = meta->buffer->timestamp;
   camerasrc->streams[stream_id].time_end = meta->buffer->timestamp;
 
-  if (camerasrc->print_field)
+  /* 3A convergence and scene switch are tracked on main stream only */
+  if (stream_id == GST_CAMERASRC_MAIN_STREAM_ID) {
+    gst_camerasrc_3a_state_update(camerasrc);
+    if (camerasrc->scene_switch_last_ts)
+      gst_camerasrc_post_scene_switch(camerasrc, meta->buffer->timestamp);
+  }
+
+  if (!camerasrc->streams[stream_id].startup_done &&
+      !gst_camerasrc_is_usable_frame(pool)) {
+    if (camerasrc->startup_frames_mode == GST_CAMERASRC_STARTUP_FRAMES_DROP) {
+      /* give the frame back to HAL without pushing it */
+      gst_camerasrc_queue_buffer(pool, meta->buffer);
+      camerasrc->streams[stream_id].discont = TRUE;
+      goto dqbuf;
+    }
+    GST_BUFFER_FLAG_SET (gbuffer, GST_CAMERASRC_BUFFER_FLAG_UNCONVERGED);
+  }
+
+  if (camerasrc->streams[stream_id].discont) {
+    GST_BUFFER_FLAG_SET (gbuffer, GST_BUFFER_FLAG_DISCONT);
+    camerasrc->streams[stream_id].discont = FALSE;
+  }
+
+  if (print && camerasrc->print_field)
     g_print("buffer field: %d    Camera Id: %d    buffer sequence: %ld\n",
       meta->buffer->s.field, camerasrc->device_id, meta->buffer->sequence);
 
-  PRINT_FIELD(meta->buffer->s.field, buffer_field);
-  GST_INFO("CameraId=%d, StreamId=%d DQ buffer done, GstBuffer=%p, UserBuffer=%p, \
-    buffer index=%d, ts=%lu, buffer field=%s.",
-    camerasrc->device_id, pool->stream_id, gbuffer, meta->buffer,
-    meta->buffer->index, meta->buffer->timestamp, buffer_field);
+  GST_CAMERASRC_LOG("DQ buffer done, UserBuffer=0x%lx, buffer index=%ld, ts=%ld, buffer field=%ld",
+    (gint64)(gintptr)meta->buffer, (gint64)meta->buffer->index, (gint64)meta->buffer->timestamp,
+    (gint64)meta->buffer->s.field);
+
+  guint64 deinterlace_start = gst_camerasrc_clock_monotonic_ns();
 
   /* when sw_weaving is enabled, copy buffer data to both top and bottom
     * if it's the first buffer, or buffer sequence is inconsecutive */
-  if (camerasrc->deinterlace_method == GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE)
-  {
+  if (method == GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE) {
     sequence_diff = meta->buffer->sequence - camerasrc->streams[stream_id].previous_sequence;
     camerasrc->streams[stream_id].previous_sequence = meta->buffer->sequence;
-  }
-  if (camerasrc->first_frame || sequence_diff > 1) {
-    gst_camerasrc_copy_field (camerasrc,
-      meta->buffer,
-      camerasrc->streams[stream_id].top);
-    gst_camerasrc_copy_field(camerasrc,
-      meta->buffer,
-      camerasrc->streams[stream_id].bottom);
-
-    do_weaving = false;
+
+    if (camerasrc->first_frame || sequence_diff > 1) {
+      gst_camerasrc_copy_field(camerasrc, stream_id,
+        meta->buffer,
+        camerasrc->streams[stream_id].top);
+      gst_camerasrc_copy_field(camerasrc, stream_id,
+        meta->buffer,
+        camerasrc->streams[stream_id].bottom);
+
+      do_weaving = false;
+    }
   }
 
   switch(meta->buffer->s.field) {
@@ -771,8 +985,8 @@ gst_camerasrc_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** bu
     case V4L2_FIELD_TOP:
         GST_BUFFER_FLAG_SET (gbuffer, GST_VIDEO_BUFFER_FLAG_TFF);
 
-        if (do_weaving) {
-          gst_camerasrc_copy_field(camerasrc,
+        if (method == GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE && do_weaving) {
+          gst_camerasrc_copy_field(camerasrc, stream_id,
             meta->buffer,
             camerasrc->streams[stream_id].top);
         }
@@ -781,8 +995,8 @@ gst_camerasrc_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** bu
         GST_BUFFER_FLAG_UNSET (gbuffer, GST_VIDEO_BUFFER_FLAG_TFF);
         GST_BUFFER_FLAG_SET (gbuffer, GST_VIDEO_BUFFER_FLAG_INTERLACED);
 
-        if (do_weaving) {
-          gst_camerasrc_copy_field(camerasrc,
+        if (method == GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE && do_weaving) {
+          gst_camerasrc_copy_field(camerasrc, stream_id,
             meta->buffer,
             camerasrc->streams[stream_id].bottom);
         }
@@ -793,20 +1007,26 @@ gst_camerasrc_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** bu
         break;
   }
 
-  ret = gst_camerasrc_deinterlace_frame(camerasrc, meta->buffer);
+  if (method == GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_BOB)
+    ret = gst_camerasrc_deinterlace_sw_bob(camerasrc, stream_id, meta->buffer);
+  else if (method == GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE)
+    ret = gst_camerasrc_deinterlace_sw_weave(camerasrc, stream_id, meta->buffer);
   if (ret != 0) {
     GST_ERROR("CameraId=%d, StreamId=%d deinterlace frame failed.",
       camerasrc->device_id, pool->stream_id);
+    gst_camerasrc_trace_dump_log();
     return GST_FLOW_ERROR;
   }
+  meta->acquire_time = gst_camerasrc_clock_monotonic_ns();
+  GST_CAMERASRC_STATS_ADD(stats->deinterlace, meta->acquire_time - deinterlace_start);
+  GST_CAMERASRC_STATS_ADD(stats->held, 1);
 
   camerasrc->first_frame = false;
 
   GST_BUFFER_TIMESTAMP(gbuffer) = timestamp;
   *buffer = gbuffer;
   pool->acquire_buffer_index++;
-  GST_DEBUG("CameraId=%d, StreamId=%d acquire_buffer buffer %p.",
-    camerasrc->device_id, pool->stream_id, *buffer);
+  GST_CAMERASRC_LOG("acquire_buffer buffer 0x%lx", (gint64)(gintptr)*buffer);
   {
     PERF_CAMERA_ATRACE_PARAM1("sof.sequence", meta->buffer->sequence);
   }
@@ -829,76 +1049,213 @@ int gst_camerasrc_get_buffer_usage_shifting(int flag)
   return 0;
 }
 
+#define ACQUIRE_FUNCS(method) \
+  { gst_camerasrc_acquire_frame<method, false>, gst_camerasrc_acquire_frame<method, true> }
+
+/* indexed by deinterlace method, then by print-fps or print-field */
+static const GstCamerasrcAcquireFunc acquire_funcs[][2] = {
+  ACQUIRE_FUNCS(GST_CAMERASRC_DEINTERLACE_METHOD_NONE),
+  ACQUIRE_FUNCS(GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_BOB),
+  ACQUIRE_FUNCS(GST_CAMERASRC_DEINTERLACE_METHOD_SOFTWARE_WEAVE),
+  ACQUIRE_FUNCS(GST_CAMERASRC_DEINTERLACE_METHOD_HARDWARE_WEAVE),
+};
+
+/**
+ * Select the frame path matching the stream settings, at pool start and
+ * by the streaming thread once print-fps or print-field changed
+ */
+void
+gst_camerasrc_buffer_pool_select_path(GstCamerasrcBufferPool *pool)
+{
+  Gstcamerasrc *camerasrc = pool->src;
+  guint method = camerasrc->deinterlace_method;
+  gboolean print = camerasrc->print_fps || camerasrc->print_field;
+
+  if (method >= G_N_ELEMENTS(acquire_funcs))
+    method = GST_CAMERASRC_DEINTERLACE_METHOD_NONE;
+
+  pool->path_serial = g_atomic_int_get(&camerasrc->frame_path_serial);
+  pool->buffer_flags = gst_camerasrc_get_buffer_usage_shifting(camerasrc->buffer_usage);
+  pool->acquire = acquire_funcs[method][print ? 1 : 0];
+}
+
+static GstFlowReturn
+gst_camerasrc_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL_CAST(bpool);
+
+  /* streams done with their pool first wait for the others to start */
+  if (G_UNLIKELY(g_atomic_int_get(&pool->src->config_state) != GST_CAMERASRC_CONFIG_STARTED)) {
+    GstFlowReturn ret = gst_camerasrc_config_wait(pool->src, pool->stream_id,
+        GST_CAMERASRC_CONFIG_STARTED);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  if (G_UNLIKELY(pool->path_serial != g_atomic_int_get(&pool->src->frame_path_serial)))
+    gst_camerasrc_buffer_pool_select_path(pool);
+
+  return pool->acquire(pool, buffer);
+}
+
+/**
+ * Queue one buffer of each active stream to HAL at once, for as long as
+ * every stream has a buffer available. qbuf_mutex must be held.
+ */
+static int
+gst_camerasrc_qbuf_pending(Gstcamerasrc *camerasrc, int stream_id)
+{
+  int ret = 0;
+
+  while (true) {
+    /* check if there's available buffer in queue */
+    for (int i = 0; i < camerasrc->number_of_activepads; i++) {
+      if (camerasrc->streams[i].queue_head == camerasrc->streams[i].queue_tail) {
+        GST_CAMERASRC_LOG("StreamId=%ld doesn't have available buffer", (gint64)i);
+        return 0;
+      }
+    }
+
+    /* acquire the first buffer in each queue and save into buffer_list array */
+    for (int j = 0; j < camerasrc->number_of_activepads; j++) {
+      GstStreamInfo *stream = &camerasrc->streams[j];
+      camerasrc->buffer_list[j] = stream->buffer_queue[stream->queue_head % GST_CAMERASRC_HAL_QUEUE_SIZE];
+    }
+
+    /* queue buffers from buffer_list here */
+    guint64 qbuf_start = gst_camerasrc_clock_monotonic_ns();
+    ret = camera_stream_qbuf(camerasrc->device_id, camerasrc->buffer_list, camerasrc->number_of_activepads);
+    guint64 qbuf_time = gst_camerasrc_clock_monotonic_ns() - qbuf_start;
+    if (ret < 0) {
+      GST_ERROR("CameraId=%d, StreamId=%d failed to qbuf back to stream.",
+        camerasrc->device_id, stream_id);
+      gst_camerasrc_trace_dump_log();
+      return ret;
+    }
+    GST_CAMERASRC_LOG("Queue buffer succeed, %ld streams in %ld ns",
+      (gint64)camerasrc->number_of_activepads, (gint64)qbuf_time);
+
+    /* pop the buffer out of queue, HAL owns it now */
+    for (int k = 0; k < camerasrc->number_of_activepads; k++) {
+      GST_CAMERASRC_STATS_ADD(camerasrc->streams[k].stats.qbuf, qbuf_time);
+      GST_CAMERASRC_STATS_ADD(camerasrc->streams[k].stats.qbufs, 1);
+      gst_camerasrc_hal_queue_push(&camerasrc->streams[k], camerasrc->buffer_list[k]);
+      camerasrc->streams[k].queue_head++;
+    }
+  }
+}
+
 /**
- * Queue buffer(s) into stream(s)
+ * Queue buffer(s) into stream(s), a user buffer is saved until each
+ * active stream has one available, then they're queued to HAL together
  */
 static void
-gst_camerasrc_buffer_pool_release_buffer (GstBufferPool * bpool, GstBuffer * buffer)
+gst_camerasrc_queue_buffer (GstCamerasrcBufferPool *pool, camera_buffer_t *buffer)
 {
-  PERF_CAMERA_ATRACE();
-  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL (bpool);
   Gstcamerasrc *camerasrc = pool->src;
-  GstCamerasrcMeta *meta = GST_CAMERASRC_META_GET(buffer);
   int stream_id = pool->stream_id;
 
-  meta->buffer->flags |= gst_camerasrc_get_buffer_usage_shifting(camerasrc->buffer_usage);
+  buffer->flags |= pool->buffer_flags;
 
-  g_mutex_lock(&camerasrc->qbuf_mutex);
+  GST_CAMSRC_QBUF_LOCK(camerasrc);
   /* save buffer into queue */
-  camerasrc->streams[stream_id].buffer_queue->push(meta->buffer);
+  if (!gst_camerasrc_buffer_queue_push(&camerasrc->streams[stream_id], buffer)) {
+    GST_CAMSRC_QBUF_UNLOCK(camerasrc);
+    return;
+  }
 
-  GST_INFO("CameraId=%d, StreamId=%d Ready to queue buffer, \
-    number of buffer in queue=%ld, Buffer index=%d, Buffer flag=%d",
-    camerasrc->device_id, stream_id,
-    camerasrc->streams[stream_id].buffer_queue->size(),
-    meta->buffer->index, meta->buffer->flags);
+  GST_CAMERASRC_LOG("Ready to queue buffer, number of buffer in queue=%ld, "
+    "Buffer index=%ld, Buffer flag=%ld",
+    (gint64)(camerasrc->streams[stream_id].queue_tail - camerasrc->streams[stream_id].queue_head),
+    (gint64)buffer->index, (gint64)buffer->flags);
 
   /* in PLAYING->PAUSED and PAUSED->NULL state,
   * no need to check if queue has available buffer,
   * unlock qbuf_mutex immediately and quit function so pipeline can cease normally
   * this check is not needed before preallocate is done */
-  if (camerasrc->start_streams) {
+  if (g_atomic_int_get(&camerasrc->config_state) == GST_CAMERASRC_CONFIG_STARTED) {
     if (camerasrc->running != GST_CAMERASRC_STATUS_RUNNING) {
       GST_INFO("CameraId=%d, StreamId=%d is exiting.", camerasrc->device_id, pool->stream_id);
-      g_mutex_unlock(&camerasrc->qbuf_mutex);
+      GST_CAMSRC_QBUF_UNLOCK(camerasrc);
       return;
     }
   }
 
-  /* check if there's available buffer in queue */
+  gst_camerasrc_qbuf_pending(camerasrc, stream_id);
+  GST_CAMSRC_QBUF_UNLOCK(camerasrc);
+
+  {
+    PERF_CAMERA_ATRACE_PARAM1("sof.sequence", buffer->sequence);
+  }
+}
+
+/**
+ * Wait until the streams dequeuing a buffer have popped it, once the
+ * device is stopped and reconfiguring is set, so that the buffers left
+ * in hal_buffers are the ones HAL dropped. GST_CAMSRC_LOCK must be held.
+ */
+void
+gst_camerasrc_wait_dqbuf_idle(Gstcamerasrc *camerasrc, int stream_id)
+{
+  gint64 end_time = g_get_monotonic_time() + GST_CAMERASRC_DQBUF_IDLE_TIMEOUT;
+
   for (int i = 0; i < camerasrc->number_of_activepads; i++) {
-    if (camerasrc->streams[i].buffer_queue->empty()) {
-      GST_INFO("CameraId=%d, StreamId=%d the other queue doesn't have available buffer",
-        camerasrc->device_id, pool->stream_id);
-      g_mutex_unlock(&camerasrc->qbuf_mutex);
-      return;
+    if (i == stream_id)
+      continue;
+    while (g_atomic_int_get(&camerasrc->streams[i].dqbuf_busy)) {
+      if (!GST_CAMSRC_WAIT_UNTIL(camerasrc, end_time)) {
+        GST_WARNING("CameraId=%d, StreamId=%d still in dqbuf after device stop.",
+          camerasrc->device_id, i);
+        break;
+      }
     }
   }
+}
 
-  /* acquire the first buffer in each queue and save into buffer_list array */
-  for (int j = 0; j < camerasrc->number_of_activepads; j++) {
-    camerasrc->buffer_list[j] = camerasrc->streams[j].buffer_queue->front();
+/**
+ * Buffers owned by HAL are dropped when the device is stopped, move them
+ * back to the buffer queues and queue them again once it is restarted.
+ * qbuf_mutex must be held, and gst_camerasrc_wait_dqbuf_idle done.
+ */
+int
+gst_camerasrc_requeue_hal_buffers(Gstcamerasrc *camerasrc)
+{
+  for (int i = 0; i < camerasrc->number_of_activepads; i++) {
+    GstStreamInfo *stream = &camerasrc->streams[i];
+    guint head = (guint) g_atomic_int_get(&stream->hal_head);
+    guint tail = (guint) g_atomic_int_get(&stream->hal_tail);
+
+    for (; head != tail; head++) {
+      if (!gst_camerasrc_buffer_queue_push(stream, stream->hal_buffers[head % GST_CAMERASRC_HAL_QUEUE_SIZE])) {
+        g_atomic_int_set(&stream->hal_head, (gint) head);
+        return -1;
+      }
+      GST_CAMERASRC_STATS_ADD(stream->stats.hal_queued, -1);
+    }
+    g_atomic_int_set(&stream->hal_head, (gint) tail);
   }
 
-  /* queue buffers from buffer_list here */
-  int ret = camera_stream_qbuf(camerasrc->device_id, camerasrc->buffer_list, camerasrc->number_of_activepads);
-  if (ret < 0) {
-    GST_ERROR("CameraId=%d, StreamId=%d failed to qbuf back to stream.",
-      camerasrc->device_id, stream_id);
-    g_mutex_unlock(&camerasrc->qbuf_mutex);
-    return;
-  }
-  GST_INFO("CameraId=%d, StreamId=%d Queue buffer succeed", camerasrc->device_id, stream_id);
+  return gst_camerasrc_qbuf_pending(camerasrc, GST_CAMERASRC_MAIN_STREAM_ID);
+}
 
-  /* pop the buffer out of queue */
-  for (int k = 0; k < camerasrc->number_of_activepads; k++) {
-    camerasrc->streams[k].buffer_queue->pop();
+static void
+gst_camerasrc_buffer_pool_release_buffer (GstBufferPool * bpool, GstBuffer * buffer)
+{
+  PERF_CAMERA_ATRACE();
+  GstCamerasrcBufferPool *pool = GST_CAMERASRC_BUFFER_POOL (bpool);
+  GstCamerasrcMeta *meta = GST_CAMERASRC_META_GET(buffer);
+  GstStreamStats *stats = &pool->src->streams[pool->stream_id].stats;
+
+  GST_CAMERASRC_TRACE_FRAME(pool->src->device_id, pool->stream_id, meta->buffer->sequence);
+  if (meta->acquire_time) {
+    GST_CAMERASRC_STATS_ADD(stats->hold, gst_camerasrc_clock_monotonic_ns() - meta->acquire_time);
+    GST_CAMERASRC_STATS_ADD(stats->releases, 1);
+    GST_CAMERASRC_STATS_ADD(stats->held, -1);
+    meta->acquire_time = 0;
   }
-  g_mutex_unlock(&camerasrc->qbuf_mutex);
 
-  {
-    PERF_CAMERA_ATRACE_PARAM1("sof.sequence", meta->buffer->sequence);
-  }
+  gst_camerasrc_queue_buffer(pool, meta->buffer);
 }
 
 static void
@@ -954,30 +1311,30 @@ gst_camerasrc_buffer_pool_free_buffer (GstBufferPool * bpool, GstBuffer * buffer
 static void
 gst_camerasrc_print_framerate_analysis(Gstcamerasrc *camerasrc, int stream_id)
 {
-  double total_stream_buffers = camerasrc->streams[stream_id].fps_debug.buf_count-FPS_BUF_COUNT_START; //valid number of stream buffers
-  double  total_stream_duration = camerasrc->streams[stream_id].fps_debug.sum_time/1000000; //valid time of counting stream buffers
-  camerasrc->streams[stream_id].fps_debug.av_fps = total_stream_buffers/total_stream_duration;
+  GstStreamStats *stats = &camerasrc->streams[stream_id].stats;
+  guint64 frames = GST_CAMERASRC_STATS_GET(stats->frames);
+  double av_fps = gst_camerasrc_stats_average_fps(stats, gst_camerasrc_clock_monotonic_ns());
 
-  if (total_stream_duration < FPS_TIME_INTERVAL/1000000) {
+  if (GST_CAMERASRC_STATS_GET(stats->max_fps) == 0) {
      /* This case means that pipeline runtime is less than 2 seconds(we count fps every 2 seconds),
         * no updates from max_fps and min_fps, only average fps is available */
-     g_print("\nTotal frame is: %g Camera name:%s(Id:%d) Stream Id:%d\nAverage fps is:%.4f\n",
-                      camerasrc->streams[stream_id].fps_debug.buf_count,
+     g_print("\nTotal frame is: %lu Camera name:%s(Id:%d) Stream Id:%d\nAverage fps is:%.4f\n",
+                      frames,
                       camerasrc->streams[stream_id].cam_info.name,
                       camerasrc->device_id,
                       stream_id,
-                      camerasrc->streams[stream_id].fps_debug.av_fps);
+                      av_fps);
   } else {
      //This case means that pipeline runtime is longer than 2 seconds
-     g_print("\nTotal frame is:%g  Camera name:%s(Id:%d) Stream Id:%d\n",
-                      camerasrc->streams[stream_id].fps_debug.buf_count,
+     g_print("\nTotal frame is:%lu  Camera name:%s(Id:%d) Stream Id:%d\n",
+                      frames,
                       camerasrc->streams[stream_id].cam_info.name,
                       camerasrc->device_id,
                       stream_id);
      g_print("Max fps is:%.4f,Minimum fps is:%.4f,Average fps is:%.4f\n\n",
-                      camerasrc->streams[stream_id].fps_debug.max_fps,
-                      camerasrc->streams[stream_id].fps_debug.min_fps,
-                      camerasrc->streams[stream_id].fps_debug.av_fps);
+                      GST_CAMERASRC_STATS_GET(stats->max_fps),
+                      GST_CAMERASRC_STATS_GET(stats->min_fps),
+                      av_fps);
   }
 }
 
@@ -1023,8 +1380,8 @@ gst_camerasrc_buffer_pool_stop(GstBufferPool *bpool)
   else if (camerasrc->streams[stream_id].pool)
     gst_object_unref(camerasrc->streams[stream_id].pool);
 
-  delete camerasrc->streams[stream_id].buffer_queue;
-  camerasrc->streams[stream_id].buffer_queue = NULL;
+  camerasrc->streams[stream_id].queue_head = 0;
+  camerasrc->streams[stream_id].queue_tail = 0;
 
   return TRUE;
 }
@@ -63,8 +63,8 @@ GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
 #define GST_CAMERASRC_META_GET(buf) ((GstCamerasrcMeta *)gst_buffer_get_meta(buf,gst_camerasrc_meta_api_get_type()))
 #define GST_CAMERASRC_META_ADD(buf) ((GstCamerasrcMeta *)gst_buffer_add_meta(buf,gst_camerasrc_meta_get_info(),NULL))
 
-#define FPS_TIME_INTERVAL 2000000
-#define FPS_BUF_COUNT_START 10
+typedef GstFlowReturn (*GstCamerasrcAcquireFunc) (GstCamerasrcBufferPool *pool,
+    GstBuffer **buffer);
 
 struct _GstCamerasrcBufferPool
 {
@@ -83,6 +83,15 @@ struct _GstCamerasrcBufferPool
 
   int stream_id;
   gboolean alloc_done;
+  /* frame arrival is predicted for the multiplexed task of the element */
+  gboolean multiplex;
+
+  /* Frame path for the stream settings, selected again when
+   * path_serial is behind the element's */
+  GstCamerasrcAcquireFunc acquire;
+  gint path_serial;
+  /* Usage flags of the buffers queued to HAL */
+  int buffer_flags;
 };
 
 struct _GstCamerasrcBufferPoolClass
@@ -96,6 +105,9 @@ struct _GstCamerasrcMeta {
   int index;
   gpointer mem;
   camera_buffer_t *buffer;
+
+  /* monotonic time the buffer was handed downstream, 0 when in pool */
+  guint64 acquire_time;
 };
 
 GType gst_camerasrc_meta_api_get_type (void);
@@ -103,6 +115,9 @@ GType gst_camerasrc_buffer_pool_get_type(void);
 const GstMetaInfo * gst_camerasrc_meta_get_info (void);
 GstBufferPool *gst_camerasrc_buffer_pool_new(Gstcamerasrc *src,
           GstCaps *caps, int stream_id);
+void gst_camerasrc_wait_dqbuf_idle(Gstcamerasrc *src, int stream_id);
+int gst_camerasrc_requeue_hal_buffers(Gstcamerasrc *src);
+void gst_camerasrc_buffer_pool_select_path(GstCamerasrcBufferPool *pool);
 
 G_END_DECLS
 #endif
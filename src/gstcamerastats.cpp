@@ -0,0 +1,291 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraStats"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <math.h>
+
+#include "gstcamerasrc.h"
+#include "gstcamerastats.h"
+
+using std::memory_order_relaxed;
+
+void
+gst_camerasrc_stats_reset(GstStreamStats *stats)
+{
+  stats->frames.store(0, memory_order_relaxed);
+  stats->fps_start.store(0, memory_order_relaxed);
+  stats->fps_window_start.store(0, memory_order_relaxed);
+  stats->fps_window_frames.store(0, memory_order_relaxed);
+  stats->fps.store(0, memory_order_relaxed);
+  stats->max_fps.store(0, memory_order_relaxed);
+  stats->min_fps.store(0, memory_order_relaxed);
+  stats->dqbuf_wait.store(0, memory_order_relaxed);
+  stats->dqbuf_wait_max.store(0, memory_order_relaxed);
+  stats->deinterlace.store(0, memory_order_relaxed);
+  stats->qbuf.store(0, memory_order_relaxed);
+  stats->qbufs.store(0, memory_order_relaxed);
+  stats->held.store(0, memory_order_relaxed);
+  stats->hold.store(0, memory_order_relaxed);
+  stats->releases.store(0, memory_order_relaxed);
+  stats->hal_queued.store(0, memory_order_relaxed);
+  gst_camerasrc_histogram_reset(&stats->latency);
+  gst_camerasrc_histogram_reset(&stats->sched_delay);
+  gst_camerasrc_histogram_reset(&stats->sync_skew);
+  stats->dropped.store(0, memory_order_relaxed);
+  stats->duplicated.store(0, memory_order_relaxed);
+  stats->late.store(0, memory_order_relaxed);
+  stats->unpaired.store(0, memory_order_relaxed);
+  stats->decimated.store(0, memory_order_relaxed);
+  stats->clock_samples.store(0, memory_order_relaxed);
+  stats->clock_skew.store(1.0, memory_order_relaxed);
+  stats->clock_offset.store(0, memory_order_relaxed);
+  stats->clock_residual_var.store(0, memory_order_relaxed);
+  stats->clock_residual_max.store(0, memory_order_relaxed);
+  stats->timestamp_fallbacks.store(0, memory_order_relaxed);
+}
+
+void
+gst_camerasrc_stats_max(std::atomic<guint64> *counter, guint64 value)
+{
+  guint64 max = counter->load(memory_order_relaxed);
+
+  while (value > max && !counter->compare_exchange_weak(max, value, memory_order_relaxed))
+    ;
+}
+
+/**
+  * Count a dequeued frame, called by the stream thread only.
+  * Return TRUE when fps of a new interval is available.
+  */
+gboolean
+gst_camerasrc_stats_frame(GstStreamStats *stats, guint64 now)
+{
+  guint64 frames = GST_CAMERASRC_STATS_ADD(stats->frames, 1) + 1;
+  guint64 window_start = stats->fps_window_start.load(memory_order_relaxed);
+  guint64 window_frames;
+  double fps;
+
+  if (frames < FPS_BUF_COUNT_START)
+    return FALSE;
+
+  if (frames == FPS_BUF_COUNT_START) {
+    stats->fps_start.store(now, memory_order_relaxed);
+    stats->fps_window_start.store(now, memory_order_relaxed);
+    stats->fps_window_frames.store(frames, memory_order_relaxed);
+    return FALSE;
+  }
+
+  if (now - window_start < FPS_TIME_INTERVAL)
+    return FALSE;
+
+  window_frames = stats->fps_window_frames.load(memory_order_relaxed);
+  fps = (double)(frames - window_frames) * GST_SECOND / (now - window_start);
+  stats->fps.store(fps, memory_order_relaxed);
+
+  if (stats->max_fps.load(memory_order_relaxed) == 0) {
+    stats->max_fps.store(fps, memory_order_relaxed);
+    stats->min_fps.store(fps, memory_order_relaxed);
+  } else if (fps > stats->max_fps.load(memory_order_relaxed)) {
+    stats->max_fps.store(fps, memory_order_relaxed);
+  } else if (fps < stats->min_fps.load(memory_order_relaxed)) {
+    stats->min_fps.store(fps, memory_order_relaxed);
+  }
+
+  stats->fps_window_start.store(now, memory_order_relaxed);
+  stats->fps_window_frames.store(frames, memory_order_relaxed);
+
+  return TRUE;
+}
+
+static guint
+gst_camerasrc_histogram_bucket(guint64 us)
+{
+  guint exp, index;
+
+  if (us < GST_CAMERASRC_LATENCY_LINEAR)
+    return (guint)us;
+
+  exp = g_bit_storage(us) - 1;
+  index = GST_CAMERASRC_LATENCY_LINEAR + (exp - 4) * 8 + ((us >> (exp - 3)) & 7);
+
+  return MIN(index, GST_CAMERASRC_LATENCY_BUCKETS - 1);
+}
+
+/* Upper bound in ns of the latency of a bucket */
+static GstClockTime
+gst_camerasrc_histogram_bound(guint index)
+{
+  guint exp, sub;
+
+  if (index < GST_CAMERASRC_LATENCY_LINEAR)
+    return (index + 1) * GST_USECOND;
+
+  exp = 4 + (index - GST_CAMERASRC_LATENCY_LINEAR) / 8;
+  sub = (index - GST_CAMERASRC_LATENCY_LINEAR) % 8;
+
+  return ((guint64)(9 + sub) << (exp - 3)) * GST_USECOND;
+}
+
+void
+gst_camerasrc_histogram_reset(GstLatencyHistogram *histogram)
+{
+  for (int i = 0; i < GST_CAMERASRC_LATENCY_BUCKETS; i++)
+    histogram->buckets[i].store(0, memory_order_relaxed);
+  histogram->sum.store(0, memory_order_relaxed);
+  histogram->count.store(0, memory_order_relaxed);
+}
+
+void
+gst_camerasrc_histogram_record(GstLatencyHistogram *histogram, GstClockTime latency)
+{
+  guint index = gst_camerasrc_histogram_bucket(latency / GST_USECOND);
+
+  GST_CAMERASRC_STATS_ADD(histogram->buckets[index], 1);
+  GST_CAMERASRC_STATS_ADD(histogram->sum, latency);
+  GST_CAMERASRC_STATS_ADD(histogram->count, 1);
+}
+
+void
+gst_camerasrc_stats_latency(GstStreamStats *stats, GstClockTime latency)
+{
+  gst_camerasrc_histogram_record(&stats->latency, latency);
+}
+
+/**
+  * Latency below which the given fraction of the samples are, with the
+  * precision of the histogram buckets (1/8 of the power of two).
+  */
+GstClockTime
+gst_camerasrc_histogram_quantile(GstLatencyHistogram *histogram, double quantile)
+{
+  guint64 counts[GST_CAMERASRC_LATENCY_BUCKETS];
+  guint64 total = 0, rank, sum = 0;
+
+  /* buckets are read once so that the ranks are consistent */
+  for (int i = 0; i < GST_CAMERASRC_LATENCY_BUCKETS; i++) {
+    counts[i] = GST_CAMERASRC_STATS_GET(histogram->buckets[i]);
+    total += counts[i];
+  }
+  if (total == 0)
+    return 0;
+
+  rank = MIN((guint64)(quantile * total), total - 1);
+  for (int i = 0; i < GST_CAMERASRC_LATENCY_BUCKETS; i++) {
+    sum += counts[i];
+    if (sum > rank)
+      return gst_camerasrc_histogram_bound(i);
+  }
+
+  return gst_camerasrc_histogram_bound(GST_CAMERASRC_LATENCY_BUCKETS - 1);
+}
+
+double
+gst_camerasrc_stats_average_fps(GstStreamStats *stats, guint64 now)
+{
+  guint64 frames = GST_CAMERASRC_STATS_GET(stats->frames);
+  guint64 start = GST_CAMERASRC_STATS_GET(stats->fps_start);
+
+  if (frames <= FPS_BUF_COUNT_START || now <= start)
+    return 0;
+
+  return (double)(frames - FPS_BUF_COUNT_START) * GST_SECOND / (now - start);
+}
+
+static guint64
+gst_camerasrc_stats_average(guint64 total, guint64 count)
+{
+  return count ? total / count : 0;
+}
+
+/* Snapshot of the stream statistics, averages are per frame */
+GstStructure *
+gst_camerasrc_stats_to_structure(GstStreamStats *stats, int stream_id, guint64 now)
+{
+  guint64 frames = GST_CAMERASRC_STATS_GET(stats->frames);
+
+  return gst_structure_new("stream-stats",
+      "stream-id", G_TYPE_INT, stream_id,
+      "frames", G_TYPE_UINT64, frames,
+      "fps", G_TYPE_DOUBLE, GST_CAMERASRC_STATS_GET(stats->fps),
+      "fps-max", G_TYPE_DOUBLE, GST_CAMERASRC_STATS_GET(stats->max_fps),
+      "fps-min", G_TYPE_DOUBLE, GST_CAMERASRC_STATS_GET(stats->min_fps),
+      "fps-average", G_TYPE_DOUBLE, gst_camerasrc_stats_average_fps(stats, now),
+      "dqbuf-wait", G_TYPE_UINT64,
+        gst_camerasrc_stats_average(GST_CAMERASRC_STATS_GET(stats->dqbuf_wait), frames),
+      "dqbuf-wait-max", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->dqbuf_wait_max),
+      "deinterlace-time", G_TYPE_UINT64,
+        gst_camerasrc_stats_average(GST_CAMERASRC_STATS_GET(stats->deinterlace), frames),
+      "qbuf-time", G_TYPE_UINT64,
+        gst_camerasrc_stats_average(GST_CAMERASRC_STATS_GET(stats->qbuf),
+          GST_CAMERASRC_STATS_GET(stats->qbufs)),
+      "held-downstream", G_TYPE_INT64, GST_CAMERASRC_STATS_GET(stats->held),
+      "hold-time", G_TYPE_UINT64,
+        gst_camerasrc_stats_average(GST_CAMERASRC_STATS_GET(stats->hold),
+          GST_CAMERASRC_STATS_GET(stats->releases)),
+      "hal-queued", G_TYPE_INT64, GST_CAMERASRC_STATS_GET(stats->hal_queued),
+      "latency-p50", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->latency, 0.5),
+      "latency-p99", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->latency, 0.99),
+      "sched-delay-p50", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->sched_delay, 0.5),
+      "sched-delay-p99", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->sched_delay, 0.99),
+      "sched-delay-p999", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->sched_delay, 0.999),
+      "sync-skew-p50", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->sync_skew, 0.5),
+      "sync-skew-p99", G_TYPE_UINT64, gst_camerasrc_histogram_quantile(&stats->sync_skew, 0.99),
+      "dropped", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->dropped),
+      "duplicated", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->duplicated),
+      "late", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->late),
+      "unpaired", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->unpaired),
+      "decimated", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->decimated),
+      "clock-samples", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->clock_samples),
+      "clock-drift-ppm", G_TYPE_DOUBLE, (GST_CAMERASRC_STATS_GET(stats->clock_skew) - 1.0) * 1e6,
+      "clock-offset", G_TYPE_INT64, GST_CAMERASRC_STATS_GET(stats->clock_offset),
+      "clock-residual-rms", G_TYPE_UINT64,
+        (guint64)sqrt(GST_CAMERASRC_STATS_GET(stats->clock_residual_var)),
+      "clock-residual-max", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->clock_residual_max),
+      "timestamp-fallbacks", G_TYPE_UINT64, GST_CAMERASRC_STATS_GET(stats->timestamp_fallbacks),
+      NULL);
+}
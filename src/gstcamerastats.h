@@ -0,0 +1,70 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERASRC_STATS_H__
+#define __GST_CAMERASRC_STATS_H__
+
+#include <gst/gst.h>
+#include "gstcamerasrc.h"
+
+/* fps is updated every interval, the first buffers are not counted
+ * as they're not stable */
+#define FPS_TIME_INTERVAL (2 * GST_SECOND)
+#define FPS_BUF_COUNT_START 10
+
+#define GST_CAMERASRC_STATS_ADD(counter, value) \
+  (counter).fetch_add((value), std::memory_order_relaxed)
+#define GST_CAMERASRC_STATS_GET(counter) \
+  (counter).load(std::memory_order_relaxed)
+
+void gst_camerasrc_stats_reset(GstStreamStats *stats);
+gboolean gst_camerasrc_stats_frame(GstStreamStats *stats, guint64 now);
+void gst_camerasrc_stats_max(std::atomic<guint64> *counter, guint64 value);
+void gst_camerasrc_stats_latency(GstStreamStats *stats, GstClockTime latency);
+void gst_camerasrc_histogram_reset(GstLatencyHistogram *histogram);
+void gst_camerasrc_histogram_record(GstLatencyHistogram *histogram, GstClockTime latency);
+GstClockTime gst_camerasrc_histogram_quantile(GstLatencyHistogram *histogram, double quantile);
+double gst_camerasrc_stats_average_fps(GstStreamStats *stats, guint64 now);
+GstStructure *gst_camerasrc_stats_to_structure(GstStreamStats *stats, int stream_id, guint64 now);
+
+#endif /* __GST_CAMERASRC_STATS_H__ */
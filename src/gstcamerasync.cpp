@@ -0,0 +1,344 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraSync"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <time.h>
+
+#include "gstcamerasrc.h"
+#include "gstcameraclock.h"
+#include "gstcamerastats.h"
+#include "gstcamerasync.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+struct GstCameraSyncSet
+{
+  /* HAL capture time of the first frame, in ns of CLOCK_MONOTONIC */
+  guint64 capture;
+  GstClockTime pts;
+  guint32 members;
+  gboolean complete;
+};
+
+struct _GstCameraSyncGroup
+{
+  gchar *name;
+  /* members joined, protected by the registry lock for the count and by
+   * lock for the mask */
+  guint count;
+  guint32 members;
+
+  GMutex lock;
+  GstCameraSyncSet sets[GST_CAMERASRC_MAX_STREAM_NUM][GST_CAMERASRC_SYNC_SETS];
+  guint next[GST_CAMERASRC_MAX_STREAM_NUM];
+  guint64 complete;
+  guint64 incomplete;
+
+  /* start barrier, members arrived in the current generation and the
+   * device start times of the last one */
+  GCond barrier_cond;
+  guint barrier_arrived;
+  guint barrier_generation;
+  guint64 barrier_deadline;
+  guint64 start_min;
+  guint64 start_max;
+};
+
+static GMutex sync_lock;
+static GHashTable *sync_groups = NULL;
+
+void
+gst_camerasrc_sync_join(Gstcamerasrc *camerasrc)
+{
+  GstCameraSyncGroup *group;
+  gchar *name;
+  int member;
+
+  GST_OBJECT_LOCK(camerasrc);
+  name = g_strdup(camerasrc->sync_group);
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  if (!name || !*name) {
+    g_free(name);
+    return;
+  }
+
+  g_mutex_lock(&sync_lock);
+  if (!sync_groups)
+    sync_groups = g_hash_table_new(g_str_hash, g_str_equal);
+
+  group = (GstCameraSyncGroup *)g_hash_table_lookup(sync_groups, name);
+  if (!group) {
+    group = g_new0(GstCameraSyncGroup, 1);
+    group->name = name;
+    name = NULL;
+    g_mutex_init(&group->lock);
+    g_cond_init(&group->barrier_cond);
+    g_hash_table_insert(sync_groups, group->name, group);
+  }
+  g_free(name);
+
+  for (member = 0; member < GST_CAMERASRC_SYNC_MAX_MEMBERS; member++) {
+    if (!(group->members & (1u << member)))
+      break;
+  }
+  if (member == GST_CAMERASRC_SYNC_MAX_MEMBERS) {
+    GST_WARNING("CameraId=%d sync group %s is full, not synchronized.",
+        camerasrc->device_id, group->name);
+    g_mutex_unlock(&sync_lock);
+    return;
+  }
+
+  g_mutex_lock(&group->lock);
+  group->members |= 1u << member;
+  g_mutex_unlock(&group->lock);
+  group->count++;
+  GST_INFO("CameraId=%d joined sync group %s as member %d of %u.",
+      camerasrc->device_id, group->name, member, group->count);
+  g_mutex_unlock(&sync_lock);
+
+  GST_OBJECT_LOCK(camerasrc);
+  camerasrc->sync = group;
+  camerasrc->sync_member = member;
+  GST_OBJECT_UNLOCK(camerasrc);
+}
+
+void
+gst_camerasrc_sync_leave(Gstcamerasrc *camerasrc)
+{
+  GstCameraSyncGroup *group;
+  int member;
+
+  GST_OBJECT_LOCK(camerasrc);
+  group = camerasrc->sync;
+  member = camerasrc->sync_member;
+  camerasrc->sync = NULL;
+  camerasrc->sync_member = -1;
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  if (!group)
+    return;
+
+  g_mutex_lock(&sync_lock);
+  g_mutex_lock(&group->lock);
+  group->members &= ~(1u << member);
+  /* the sets do not wait for a member that left */
+  for (int i = 0; i < GST_CAMERASRC_MAX_STREAM_NUM; i++) {
+    for (int j = 0; j < GST_CAMERASRC_SYNC_SETS; j++)
+      group->sets[i][j].members &= ~(1u << member);
+  }
+  /* the members waiting at the barrier may not need this one anymore */
+  g_cond_broadcast(&group->barrier_cond);
+  g_mutex_unlock(&group->lock);
+
+  GST_INFO("CameraId=%d left sync group %s.", camerasrc->device_id, group->name);
+  if (--group->count == 0) {
+    g_hash_table_remove(sync_groups, group->name);
+    g_mutex_clear(&group->lock);
+    g_cond_clear(&group->barrier_cond);
+    g_free(group->name);
+    g_free(group);
+  }
+  g_mutex_unlock(&sync_lock);
+}
+
+/* with the lock of the group */
+static void
+gst_camerasrc_sync_release(GstCameraSyncGroup *group, guint64 deadline)
+{
+  group->barrier_deadline = deadline;
+  group->barrier_arrived = 0;
+  group->barrier_generation++;
+  group->start_min = G_MAXUINT64;
+  group->start_max = 0;
+  g_cond_broadcast(&group->barrier_cond);
+}
+
+/**
+ * Wait until sync-group-size members reached the barrier, then sleep until
+ * the start time chosen by the last one so that the members wake up
+ * together instead of one after the other from the condition. Gives up
+ * after GST_CAMERASRC_SYNC_START_TIMEOUT for the members that never come.
+ * The size is checked when the element starts, the members that joined
+ * so far can't tell how many are still to come.
+ */
+void
+gst_camerasrc_sync_barrier(Gstcamerasrc *camerasrc)
+{
+  GstCameraSyncGroup *group = camerasrc->sync;
+  gint64 end_time;
+  guint generation, expected;
+  guint64 deadline;
+
+  if (!group)
+    return;
+
+  GST_OBJECT_LOCK(camerasrc);
+  expected = MAX(camerasrc->sync_group_size, 1u);
+  GST_OBJECT_UNLOCK(camerasrc);
+
+  end_time = g_get_monotonic_time() + GST_CAMERASRC_SYNC_START_TIMEOUT / GST_USECOND;
+
+  g_mutex_lock(&group->lock);
+  generation = group->barrier_generation;
+  group->barrier_arrived++;
+  while (generation == group->barrier_generation) {
+    if (group->barrier_arrived >= expected) {
+      gst_camerasrc_sync_release(group,
+          gst_camerasrc_clock_monotonic_ns() + GST_CAMERASRC_SYNC_START_DELAY);
+      break;
+    }
+    GST_INFO("CameraId=%d, %u of %u members at the start barrier of %s.",
+        camerasrc->device_id, group->barrier_arrived, expected, group->name);
+    if (!g_cond_wait_until(&group->barrier_cond, &group->lock, end_time) &&
+        generation == group->barrier_generation) {
+      GST_WARNING("CameraId=%d start barrier of %s timed out with %u of %u members.",
+          camerasrc->device_id, group->name, group->barrier_arrived, expected);
+      gst_camerasrc_sync_release(group, gst_camerasrc_clock_monotonic_ns());
+    }
+  }
+  deadline = group->barrier_deadline;
+  g_mutex_unlock(&group->lock);
+
+  struct timespec wake;
+  wake.tv_sec = deadline / GST_SECOND;
+  wake.tv_nsec = deadline % GST_SECOND;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+    ;
+}
+
+/* Time the device of a member was started at after the barrier */
+void
+gst_camerasrc_sync_started(Gstcamerasrc *camerasrc, guint64 start)
+{
+  GstCameraSyncGroup *group = camerasrc->sync;
+
+  if (!group)
+    return;
+
+  g_mutex_lock(&group->lock);
+  group->start_min = MIN(group->start_min, start);
+  group->start_max = MAX(group->start_max, start);
+  g_mutex_unlock(&group->lock);
+}
+
+/**
+ * Give the PTS of a frame captured at capture: the PTS of the closest set
+ * within the tolerance the member is not part of yet, or pts as the first
+ * frame of a new set. Never waits for the other members, a frame missing
+ * on one of them only leaves its set incomplete. group and member are the
+ * sync and sync_member of camerasrc read with the object lock, the group
+ * stays valid until the instance leaves it at stop.
+ */
+GstClockTime
+gst_camerasrc_sync_pair(Gstcamerasrc *camerasrc, GstCameraSyncGroup *group, int member,
+    int stream_id, guint64 capture, GstClockTime pts)
+{
+  guint64 tolerance = (guint64)camerasrc->sync_tolerance * GST_USECOND;
+  guint32 bit = 1u << member;
+  GstCameraSyncSet *sets = group->sets[stream_id], *set = NULL;
+  guint64 skew = 0;
+  gboolean paired;
+
+  g_mutex_lock(&group->lock);
+  for (int i = 0; i < GST_CAMERASRC_SYNC_SETS; i++) {
+    guint64 diff = capture > sets[i].capture ?
+      capture - sets[i].capture : sets[i].capture - capture;
+    if (sets[i].members && !(sets[i].members & bit) && diff <= tolerance &&
+        (!set || diff < skew)) {
+      set = &sets[i];
+      skew = diff;
+    }
+  }
+
+  paired = set != NULL;
+  if (paired) {
+    set->members |= bit;
+    pts = set->pts;
+  } else {
+    set = &sets[group->next[stream_id]++ % GST_CAMERASRC_SYNC_SETS];
+    if (set->members && !set->complete)
+      group->incomplete++;
+    set->capture = capture;
+    set->pts = pts;
+    set->members = bit;
+    set->complete = FALSE;
+  }
+  if (!set->complete && (set->members & group->members) == group->members) {
+    set->complete = TRUE;
+    group->complete++;
+  }
+  g_mutex_unlock(&group->lock);
+
+  if (paired)
+    gst_camerasrc_histogram_record(&camerasrc->streams[stream_id].stats.sync_skew, skew);
+
+  return pts;
+}
+
+void
+gst_camerasrc_sync_fill_stats(Gstcamerasrc *camerasrc, GstStructure *stats)
+{
+  GstCameraSyncGroup *group = camerasrc->sync;
+
+  if (!group)
+    return;
+
+  g_mutex_lock(&group->lock);
+  gst_structure_set(stats,
+      "sync-group", G_TYPE_STRING, group->name,
+      "sync-members", G_TYPE_UINT, (guint)__builtin_popcount(group->members),
+      "sync-sets-complete", G_TYPE_UINT64, group->complete,
+      "sync-sets-incomplete", G_TYPE_UINT64, group->incomplete,
+      "sync-start-skew", G_TYPE_UINT64,
+        group->start_max > group->start_min ? group->start_max - group->start_min : (guint64)0,
+      NULL);
+  g_mutex_unlock(&group->lock);
+}
@@ -0,0 +1,75 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_CAMERASRC_SYNC_H__
+#define __GST_CAMERASRC_SYNC_H__
+
+#include <gst/gst.h>
+#include "gstcamerasrc.h"
+
+/* Sets of frames kept per stream while waiting for the other members,
+ * a set overwritten before every member joined it is incomplete */
+#define GST_CAMERASRC_SYNC_SETS 8
+#define GST_CAMERASRC_SYNC_MAX_MEMBERS 32
+/* Members wait this long for the others at the start barrier */
+#define GST_CAMERASRC_SYNC_START_TIMEOUT (2 * GST_SECOND)
+/* Time left after the barrier for every member to wake up before the
+ * common device start time */
+#define GST_CAMERASRC_SYNC_START_DELAY (500 * GST_USECOND)
+
+/* Instances with the same sync-group in the process form a group, frames
+ * of a stream captured within sync-tolerance by the members share the PTS
+ * of the first of them */
+void gst_camerasrc_sync_join(Gstcamerasrc *camerasrc);
+void gst_camerasrc_sync_leave(Gstcamerasrc *camerasrc);
+/* Start barrier, the devices of the members are started at the same time
+ * once all of them allocated their buffers */
+void gst_camerasrc_sync_barrier(Gstcamerasrc *camerasrc);
+void gst_camerasrc_sync_started(Gstcamerasrc *camerasrc, guint64 start);
+GstClockTime gst_camerasrc_sync_pair(Gstcamerasrc *camerasrc, GstCameraSyncGroup *group,
+    int member, int stream_id, guint64 capture, GstClockTime pts);
+/* with the object lock */
+void gst_camerasrc_sync_fill_stats(Gstcamerasrc *camerasrc, GstStructure *stats);
+
+#endif /* __GST_CAMERASRC_SYNC_H__ */
@@ -0,0 +1,195 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraTaskPool"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "gstcamerataskpool.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+typedef struct
+{
+  GstTaskPoolFunction func;
+  gpointer user_data;
+} GstCameraTaskPoolJob;
+
+G_DEFINE_TYPE (GstCameraTaskPool, gst_camera_task_pool, GST_TYPE_TASK_POOL);
+
+static GMutex shared_lock;
+static GstTaskPool *shared_pool = NULL;
+
+static void
+gst_camera_task_pool_run(gpointer data, gpointer user_data)
+{
+  GstCameraTaskPoolJob *job = (GstCameraTaskPoolJob *)data;
+  GstCameraTaskPool *pool = GST_CAMERA_TASK_POOL_CAST(user_data);
+
+  job->func(job->user_data);
+  g_atomic_int_add(&pool->pending, -1);
+  g_slice_free(GstCameraTaskPoolJob, job);
+}
+
+static void
+gst_camera_task_pool_prepare(GstTaskPool *bpool, GError **error)
+{
+  GstCameraTaskPool *pool = GST_CAMERA_TASK_POOL_CAST(bpool);
+
+  GST_OBJECT_LOCK(pool);
+  if (!pool->threads)
+    pool->threads = g_thread_pool_new(gst_camera_task_pool_run, pool,
+        (gint)pool->max_threads, FALSE, error);
+  GST_OBJECT_UNLOCK(pool);
+}
+
+static void
+gst_camera_task_pool_cleanup(GstTaskPool *bpool)
+{
+  GstCameraTaskPool *pool = GST_CAMERA_TASK_POOL_CAST(bpool);
+  GThreadPool *threads;
+
+  GST_OBJECT_LOCK(pool);
+  threads = pool->threads;
+  pool->threads = NULL;
+  GST_OBJECT_UNLOCK(pool);
+
+  /* the running tasks are joined by their owner before */
+  if (threads)
+    g_thread_pool_free(threads, FALSE, TRUE);
+}
+
+/**
+ * A task owns its thread until it is stopped, so a task pushed while
+ * max_threads tasks run would wait in the queue until one of them stops.
+ * It fails to start instead, the pad activating it fails and so does the
+ * state change of its pipeline, the threads of the process stay bounded.
+ */
+static gpointer
+gst_camera_task_pool_push(GstTaskPool *bpool, GstTaskPoolFunction func,
+    gpointer user_data, GError **error)
+{
+  GstCameraTaskPool *pool = GST_CAMERA_TASK_POOL_CAST(bpool);
+  GstCameraTaskPoolJob *job;
+
+  GST_OBJECT_LOCK(pool);
+  if (!pool->threads) {
+    GST_OBJECT_UNLOCK(pool);
+    g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+        "task pool not prepared");
+    return NULL;
+  }
+
+  /* pending only grows with the object lock held */
+  if ((guint)g_atomic_int_get(&pool->pending) >= pool->max_threads) {
+    GST_OBJECT_UNLOCK(pool);
+    GST_ERROR("all %u threads of the shared task pool are busy", pool->max_threads);
+    g_set_error(error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NO_SPACE_LEFT,
+        "all %u threads of the shared task pool are busy", pool->max_threads);
+    return NULL;
+  }
+
+  job = g_slice_new(GstCameraTaskPoolJob);
+  job->func = func;
+  job->user_data = user_data;
+
+  g_atomic_int_add(&pool->pending, 1);
+  if (!g_thread_pool_push(pool->threads, job, error)) {
+    g_atomic_int_add(&pool->pending, -1);
+    g_slice_free(GstCameraTaskPoolJob, job);
+  }
+  GST_OBJECT_UNLOCK(pool);
+
+  /* nothing to join, the task waits for its function to return itself */
+  return NULL;
+}
+
+static void
+gst_camera_task_pool_class_init(GstCameraTaskPoolClass *klass)
+{
+  GstTaskPoolClass *pool_class = GST_TASK_POOL_CLASS(klass);
+
+  pool_class->prepare = gst_camera_task_pool_prepare;
+  pool_class->cleanup = gst_camera_task_pool_cleanup;
+  pool_class->push = gst_camera_task_pool_push;
+}
+
+static void
+gst_camera_task_pool_init(GstCameraTaskPool *pool)
+{
+  pool->threads = NULL;
+  pool->max_threads = 1;
+  pool->pending = 0;
+}
+
+GstTaskPool *
+gst_camera_task_pool_get_shared(guint max_threads)
+{
+  GstTaskPool *pool = NULL;
+
+  g_mutex_lock(&shared_lock);
+  if (!shared_pool && max_threads > 0) {
+    GError *error = NULL;
+    GstTaskPool *created = (GstTaskPool *)g_object_new(GST_TYPE_CAMERA_TASK_POOL, NULL);
+
+    GST_CAMERA_TASK_POOL_CAST(created)->max_threads = max_threads;
+    gst_task_pool_prepare(created, &error);
+    if (error) {
+      GST_ERROR("failed to create the shared task pool: %s", error->message);
+      g_error_free(error);
+      gst_object_unref(created);
+    } else {
+      GST_INFO("shared task pool of %u threads", max_threads);
+      /* kept for the lifetime of the process */
+      shared_pool = created;
+    }
+  }
+  if (shared_pool)
+    pool = (GstTaskPool *)gst_object_ref(shared_pool);
+  g_mutex_unlock(&shared_lock);
+
+  return pool;
+}
@@ -0,0 +1,93 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __GST_CAMERA_TASK_POOL_H__
+#define __GST_CAMERA_TASK_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CAMERA_TASK_POOL      (gst_camera_task_pool_get_type())
+#define GST_CAMERA_TASK_POOL(obj)      (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_CAMERA_TASK_POOL, GstCameraTaskPool))
+#define GST_IS_CAMERA_TASK_POOL(obj)   (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_CAMERA_TASK_POOL))
+#define GST_CAMERA_TASK_POOL_CAST(obj) ((GstCameraTaskPool *)(obj))
+
+/* Environment variable giving the size of the shared task pool, it is used
+ * when no instance sets the task-pool-size property */
+#define GST_CAMERA_TASK_POOL_ENV "ICAMERASRC_TASK_POOL_SIZE"
+
+typedef struct _GstCameraTaskPool GstCameraTaskPool;
+typedef struct _GstCameraTaskPoolClass GstCameraTaskPoolClass;
+
+/* Task pool shared by the streaming tasks of all the instances of the
+ * process. At most max_threads tasks run in its threads at once, idle
+ * threads are kept to run the next task instead of creating a new one.
+ * A task pushed while all of them are busy fails to start, a task never
+ * waits for another one to stop */
+struct _GstCameraTaskPool
+{
+  GstTaskPool parent;
+
+  GThreadPool *threads;
+  guint max_threads;
+  /* tasks pushed and not finished yet (atomic) */
+  gint pending;
+};
+
+struct _GstCameraTaskPoolClass
+{
+  GstTaskPoolClass parent_class;
+};
+
+GType gst_camera_task_pool_get_type(void);
+
+/* Returns a new reference to the shared pool, created and prepared with
+ * max_threads by the first call, or NULL when max_threads is 0 and no
+ * pool exists */
+GstTaskPool *gst_camera_task_pool_get_shared(guint max_threads);
+
+G_END_DECLS
+
+#endif /* __GST_CAMERA_TASK_POOL_H__ */
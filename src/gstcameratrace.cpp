@@ -0,0 +1,428 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define LOG_TAG "GstCameraTrace"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "gstcameratrace.h"
+#include "utils.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_camerasrc_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_debug
+
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::atomic_thread_fence;
+
+/* Scopes have a duration, log events have a format as name and are
+ * formatted with their arguments at dump */
+typedef struct
+{
+  const char *name;
+  guint64 start;
+  guint64 duration;
+  gint64 args[GST_CAMERASRC_LOG_ARGS];
+  gint64 sequence;
+  long tid;
+  int device_id;
+  int stream_id;
+  gboolean log;
+} GstCameraTraceEvent;
+
+/* The sequence of a slot is odd while its event is written and even once
+ * published, 2 * (index + 1) for the event of ring index index */
+typedef struct
+{
+  std::atomic<guint64> seq;
+  GstCameraTraceEvent event;
+} GstCameraTraceSlot;
+
+/* Written by its thread only, the dump copies an event only if its slot
+ * sequence is the same before and after */
+typedef struct
+{
+  GstCameraTraceSlot slots[GST_CAMERASRC_TRACE_RING_SIZE];
+  std::atomic<guint64> head;
+  long tid;
+  int device_id;
+  int stream_id;
+  gint64 sequence;
+} GstCameraTraceRing;
+
+static GMutex trace_lock;
+static GList *trace_rings = NULL;
+
+/* Frees the ring of a thread when it exits, its events are lost */
+class GstCameraTraceThread
+{
+public:
+  GstCameraTraceRing *ring = NULL;
+  ~GstCameraTraceThread() {
+    if (!ring)
+      return;
+    g_mutex_lock(&trace_lock);
+    trace_rings = g_list_remove(trace_rings, ring);
+    g_mutex_unlock(&trace_lock);
+    delete ring;
+  }
+};
+
+/* trace_lock protects the list of rings, it's only taken the first time
+ * a thread records an event, when it exits and when dumping. Nothing is
+ * recorded, and no ring allocated, while no instance writes a trace */
+static std::atomic<int> trace_users(0);
+static thread_local GstCameraTraceThread trace_thread;
+
+static GstCameraTraceRing *
+gst_camerasrc_trace_ring(void)
+{
+  GstCameraTraceRing *ring = trace_thread.ring;
+
+  if (G_LIKELY(ring))
+    return ring;
+
+  ring = new GstCameraTraceRing();
+  g_mutex_lock(&trace_lock);
+  trace_rings = g_list_append(trace_rings, ring);
+  g_mutex_unlock(&trace_lock);
+
+  ring->tid = gettid();
+  ring->device_id = -1;
+  ring->stream_id = -1;
+  ring->sequence = -1;
+  trace_thread.ring = ring;
+
+  return ring;
+}
+
+static inline gboolean
+gst_camerasrc_trace_recording(void)
+{
+  return trace_users.load(memory_order_relaxed) > 0;
+}
+
+/* Record the events of the threads from now, until as many stop */
+void
+gst_camerasrc_trace_start(void)
+{
+  trace_users.fetch_add(1, memory_order_relaxed);
+}
+
+void
+gst_camerasrc_trace_stop(void)
+{
+  trace_users.fetch_sub(1, memory_order_relaxed);
+}
+
+static guint64
+gst_camerasrc_trace_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+static GstCameraTraceEvent *
+gst_camerasrc_trace_event(GstCameraTraceRing *ring, const char *name)
+{
+  guint64 head = ring->head.load(memory_order_relaxed);
+  GstCameraTraceSlot *slot = &ring->slots[head % GST_CAMERASRC_TRACE_RING_SIZE];
+  GstCameraTraceEvent *event = &slot->event;
+
+  slot->seq.store(2 * head + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  event->name = name;
+  event->sequence = ring->sequence;
+  event->tid = ring->tid;
+  event->device_id = ring->device_id;
+  event->stream_id = ring->stream_id;
+
+  return event;
+}
+
+static void
+gst_camerasrc_trace_publish(GstCameraTraceRing *ring)
+{
+  guint64 head = ring->head.load(memory_order_relaxed);
+
+  ring->slots[head % GST_CAMERASRC_TRACE_RING_SIZE].seq.store(2 * (head + 1), memory_order_release);
+  ring->head.store(head + 1, memory_order_release);
+}
+
+#ifdef ENABLE_TRACE_EXPORT
+
+guint64
+gst_camerasrc_trace_begin(void)
+{
+  return G_LIKELY(!gst_camerasrc_trace_recording()) ? 0 : gst_camerasrc_trace_now();
+}
+
+void
+gst_camerasrc_trace_end(const char *name, guint64 start, gint64 arg)
+{
+  /* start is 0 for the scopes begun before recording */
+  if (G_LIKELY(!gst_camerasrc_trace_recording()) || start == 0)
+    return;
+
+  GstCameraTraceRing *ring = gst_camerasrc_trace_ring();
+  GstCameraTraceEvent *event = gst_camerasrc_trace_event(ring, name);
+
+  event->start = start;
+  event->duration = gst_camerasrc_trace_now() - start;
+  event->args[0] = arg;
+  event->log = FALSE;
+
+  gst_camerasrc_trace_publish(ring);
+}
+
+#endif /* ENABLE_TRACE_EXPORT */
+
+void
+gst_camerasrc_trace_log(const char *format, ...)
+{
+  if (G_LIKELY(!gst_camerasrc_trace_recording()))
+    return;
+
+  GstCameraTraceRing *ring = gst_camerasrc_trace_ring();
+  GstCameraTraceEvent *event = gst_camerasrc_trace_event(ring, format);
+  guint n = 0;
+  va_list args;
+
+  event->start = gst_camerasrc_trace_now();
+  event->duration = 0;
+
+  /* one gint64 argument per conversion, the format is checked by the compiler */
+  va_start(args, format);
+  for (const char *c = strchr(format, '%'); c && c[1] != '\0'; c = strchr(c + 2, '%')) {
+    if (c[1] != '%' && n < GST_CAMERASRC_LOG_ARGS)
+      event->args[n++] = va_arg(args, gint64);
+  }
+  va_end(args);
+  for (; n < GST_CAMERASRC_LOG_ARGS; n++)
+    event->args[n] = 0;
+  event->log = TRUE;
+
+  gst_camerasrc_trace_publish(ring);
+}
+
+void
+gst_camerasrc_trace_frame(int device_id, int stream_id, gint64 sequence)
+{
+  if (G_LIKELY(!gst_camerasrc_trace_recording()))
+    return;
+
+  GstCameraTraceRing *ring = gst_camerasrc_trace_ring();
+
+  ring->device_id = device_id;
+  ring->stream_id = stream_id;
+  ring->sequence = sequence;
+}
+
+/**
+ * Copy the events of a ring in order, the ones overwritten while copied
+ * and the one being written are dropped. Return the number of events
+ * copied, trace_lock must be held so that the ring is not freed.
+ */
+static guint64
+gst_camerasrc_trace_copy(GstCameraTraceRing *ring, GstCameraTraceEvent *events)
+{
+  guint64 head = ring->head.load(memory_order_acquire);
+  guint64 begin = head > GST_CAMERASRC_TRACE_RING_SIZE ? head - GST_CAMERASRC_TRACE_RING_SIZE : 0;
+  guint64 count = 0;
+
+  for (guint64 i = begin; i < head; i++) {
+    GstCameraTraceSlot *slot = &ring->slots[i % GST_CAMERASRC_TRACE_RING_SIZE];
+    guint64 seq = slot->seq.load(memory_order_acquire);
+
+    if (seq != 2 * (i + 1))
+      continue;
+    events[count] = slot->event;
+    atomic_thread_fence(memory_order_acquire);
+    if (slot->seq.load(memory_order_relaxed) == seq)
+      count++;
+  }
+
+  return count;
+}
+
+static void
+gst_camerasrc_trace_format(GstCameraTraceEvent *event, gchar *message, gsize size)
+{
+  /* formats were checked against gint64 arguments by gst_camerasrc_trace_log() */
+  g_snprintf(message, size, event->name,
+      event->args[0], event->args[1], event->args[2], event->args[3]);
+}
+
+/* Write a JSON string, quotes included */
+static void
+gst_camerasrc_trace_write_string(FILE *file, const char *str)
+{
+  fputc('"', file);
+  for (const char *c = str; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fprintf(file, "\\%c", *c);
+    else if ((guchar)*c < 0x20)
+      fprintf(file, "\\u%04x", (guchar)*c);
+    else
+      fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+static void
+gst_camerasrc_trace_dump_ring(FILE *file, GstCameraTraceRing *ring, GstCameraTraceEvent *events,
+    gboolean *first)
+{
+  guint64 count = gst_camerasrc_trace_copy(ring, events);
+  gchar message[256];
+
+  for (guint64 i = 0; i < count; i++) {
+    GstCameraTraceEvent *event = &events[i];
+
+    if (event->log) {
+      gst_camerasrc_trace_format(event, message, sizeof(message));
+      fprintf(file, "%s\n{\"name\":\"log\",\"cat\":\"icamerasrc\",\"ph\":\"i\",\"s\":\"t\","
+        "\"ts\":%.3f,\"pid\":%d,\"tid\":%ld,"
+        "\"args\":{\"camera\":%d,\"stream\":%d,\"sequence\":%ld,\"message\":",
+        *first ? "" : ",", (double)event->start / GST_USECOND,
+        getpid(), event->tid, event->device_id, event->stream_id, event->sequence);
+      gst_camerasrc_trace_write_string(file, message);
+      fprintf(file, "}}");
+    } else {
+      fprintf(file, "%s\n{\"name\":", *first ? "" : ",");
+      gst_camerasrc_trace_write_string(file, event->name);
+      fprintf(file, ",\"cat\":\"icamerasrc\",\"ph\":\"X\","
+        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,"
+        "\"args\":{\"camera\":%d,\"stream\":%d,\"sequence\":%ld,\"value\":%ld}}",
+        (double)event->start / GST_USECOND, (double)event->duration / GST_USECOND,
+        getpid(), event->tid, event->device_id, event->stream_id, event->sequence,
+        event->args[0]);
+    }
+    *first = FALSE;
+  }
+}
+
+/**
+ * Write the events of all threads in Chrome trace event format, which
+ * chrome://tracing and ui.perfetto.dev load. Log events are instant
+ * events, scopes are only recorded with --enable-trace-export.
+ */
+gboolean
+gst_camerasrc_trace_dump(const gchar *path)
+{
+  gboolean first = TRUE;
+  GstCameraTraceEvent *events;
+  FILE *file = fopen(path, "w");
+
+  if (!file) {
+    GST_ERROR("failed to open trace file %s.", path);
+    return FALSE;
+  }
+
+  events = g_new(GstCameraTraceEvent, GST_CAMERASRC_TRACE_RING_SIZE);
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  g_mutex_lock(&trace_lock);
+  for (GList *l = trace_rings; l; l = l->next)
+    gst_camerasrc_trace_dump_ring(file, (GstCameraTraceRing *)l->data, events, &first);
+  g_mutex_unlock(&trace_lock);
+  fprintf(file, "\n]}\n");
+  g_free(events);
+
+  if (fclose(file) != 0) {
+    GST_ERROR("failed to write trace file %s.", path);
+    return FALSE;
+  }
+
+  GST_INFO("trace written to %s.", path);
+  return TRUE;
+}
+
+/* Write the last log events of every thread to the debug log, on error */
+void
+gst_camerasrc_trace_dump_log(void)
+{
+  GstCameraTraceEvent *events;
+  gchar message[256];
+
+  g_mutex_lock(&trace_lock);
+  if (!trace_rings) {
+    g_mutex_unlock(&trace_lock);
+    return;
+  }
+  events = g_new(GstCameraTraceEvent, GST_CAMERASRC_TRACE_RING_SIZE);
+  for (GList *l = trace_rings; l; l = l->next) {
+    guint64 count = gst_camerasrc_trace_copy((GstCameraTraceRing *)l->data, events);
+    guint64 logs = 0, i;
+
+    /* find where the last log events begin */
+    for (i = count; i > 0 && logs < GST_CAMERASRC_LOG_DUMP_EVENTS; i--)
+      if (events[i - 1].log)
+        logs++;
+
+    for (; i < count; i++) {
+      GstCameraTraceEvent *event = &events[i];
+      if (!event->log)
+        continue;
+
+      gst_camerasrc_trace_format(event, message, sizeof(message));
+      GST_ERROR("[%lu.%09lu] tid=%ld CameraId=%d, StreamId=%d, sequence=%ld: %s",
+        event->start / GST_SECOND, event->start % GST_SECOND, event->tid,
+        event->device_id, event->stream_id, event->sequence, message);
+    }
+  }
+  g_mutex_unlock(&trace_lock);
+  g_free(events);
+}
@@ -0,0 +1,113 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERASRC_TRACE_H__
+#define __GST_CAMERASRC_TRACE_H__
+
+#include <gst/gst.h>
+
+/* Events kept per thread, the oldest ones are overwritten */
+#define GST_CAMERASRC_TRACE_RING_SIZE 4096
+/* Default of the 'trace-file' property */
+#define GST_CAMERASRC_TRACE_ENV "ICAMERASRC_TRACE_FILE"
+/* Arguments of a log event, formatted only when the ring is dumped */
+#define GST_CAMERASRC_LOG_ARGS 4
+/* Last log events of each thread written to the debug log on error */
+#define GST_CAMERASRC_LOG_DUMP_EVENTS 64
+
+void gst_camerasrc_trace_start(void);
+void gst_camerasrc_trace_stop(void);
+gboolean gst_camerasrc_trace_dump(const gchar *path);
+void gst_camerasrc_trace_dump_log(void);
+void gst_camerasrc_trace_frame(int device_id, int stream_id, gint64 sequence);
+void gst_camerasrc_trace_log(const char *format, ...) G_GNUC_PRINTF(1, 2);
+
+/* Camera, stream and frame the following events of the thread belong to */
+#define GST_CAMERASRC_TRACE_FRAME(device_id, stream_id, sequence) \
+  gst_camerasrc_trace_frame(device_id, stream_id, sequence)
+
+/* Frame path logging into the thread ring, recorded between trace_start
+ * and trace_stop only, by the instances writing a trace. The format must be
+ * a literal with at most GST_CAMERASRC_LOG_ARGS %ld or %lx conversions,
+ * the arguments are gint64, pointers are cast to gint64 */
+#define GST_CAMERASRC_LOG(format, ...) \
+  gst_camerasrc_trace_log(format, ##__VA_ARGS__)
+
+#ifdef ENABLE_TRACE_EXPORT
+
+guint64 gst_camerasrc_trace_begin(void);
+void gst_camerasrc_trace_end(const char *name, guint64 start, gint64 arg);
+
+/* Records the duration of the enclosing scope */
+class GstCameraTraceScope
+{
+public:
+  GstCameraTraceScope(const char *name, gint64 arg = -1)
+    : mName(name), mArg(arg), mStart(gst_camerasrc_trace_begin()) {}
+  ~GstCameraTraceScope() { gst_camerasrc_trace_end(mName, mStart, mArg); }
+
+private:
+  const char *mName;
+  gint64 mArg;
+  guint64 mStart;
+};
+
+/* Scopes of ScopedAtrace.h are recorded instead, so this header must
+ * be included after it */
+#undef PERF_CAMERA_ATRACE
+#undef PERF_CAMERA_ATRACE_PARAM1
+#define PERF_CAMERA_ATRACE() \
+  GstCameraTraceScope camerasrc_trace_scope(__func__)
+#define PERF_CAMERA_ATRACE_PARAM1(note, value) \
+  GstCameraTraceScope camerasrc_trace_scope(note, (gint64)(value))
+
+#define GST_CAMERASRC_TRACE_SCOPE(name) \
+  GstCameraTraceScope camerasrc_trace_scope(name)
+
+#else
+
+#define GST_CAMERASRC_TRACE_SCOPE(name)
+
+#endif /* ENABLE_TRACE_EXPORT */
+
+#endif /* __GST_CAMERASRC_TRACE_H__ */
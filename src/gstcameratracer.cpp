@@ -0,0 +1,447 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* the tracer registration API is still flagged unstable by GStreamer */
+#define GST_USE_UNSTABLE_API
+
+#define LOG_TAG "GstCameraTracer"
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "gstcamerasrc.h"
+#include "gstcameraclock.h"
+#include "gstcamerastats.h"
+#include "gstcameratracer.h"
+
+#if !defined(GST_DISABLE_GST_TRACER_HOOKS) && GST_CHECK_VERSION(1, 14, 0)
+
+GST_DEBUG_CATEGORY_STATIC(gst_camerasrc_tracer_debug);
+#define GST_CAT_DEFAULT gst_camerasrc_tracer_debug
+
+/**
+  * Glass to sink latency of the icamerasrc frames.
+  *
+  * icamerasrc attaches the HAL capture time as a reference timestamp meta,
+  * every push of such a buffer records now - capture time into a histogram
+  * per stream and per pushing pad, so that the time spent by the frames up
+  * to each element and to the sinks can be told apart. Percentiles are
+  * logged as "icamerasrc-latency" records at EOS, when the tracer is
+  * destroyed and when its "report" action signal is emitted.
+  */
+#define GST_TYPE_CAMERASRC_LATENCY_TRACER (gst_camerasrc_latency_tracer_get_type())
+#define GST_CAMERASRC_LATENCY_TRACER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_CAMERASRC_LATENCY_TRACER, GstCamerasrcLatencyTracer))
+
+typedef struct _GstCamerasrcLatencyTracer GstCamerasrcLatencyTracer;
+typedef struct _GstCamerasrcLatencyTracerClass GstCamerasrcLatencyTracerClass;
+typedef struct _GstLatencyStage GstLatencyStage;
+typedef struct _GstLatencyPadStages GstLatencyPadStages;
+
+/* Latency of the frames of a stream when pushed from a pad */
+struct _GstLatencyStage
+{
+  gint device_id;
+  gint stream_id;
+  gchar *pad;
+  gboolean sink;
+  GstLatencyHistogram histogram;
+};
+
+/* Stages already found for a pad, kept in its qdata so that a push only
+ * takes the tracer lock the first time a stream goes through the pad.
+ * Entries are published by their stage and never change once set */
+#define GST_CAMERASRC_TRACER_PAD_STAGES 8
+
+struct _GstLatencyPadStages
+{
+  GstCamerasrcLatencyTracer *tracer;
+  struct {
+    gint device_id;
+    gint stream_id;
+    std::atomic<GstLatencyStage *> stage;
+  } entries[GST_CAMERASRC_TRACER_PAD_STAGES];
+  std::atomic<guint> count;
+};
+
+struct _GstCamerasrcLatencyTracer
+{
+  GstTracer parent;
+
+  GstCaps *reference;
+
+  /* stages are added under the lock and only freed with the tracer,
+   * histograms are updated outside of it, with the stages cached in the
+   * pads' qdata */
+  GMutex lock;
+  GHashTable *stages;
+  GPtrArray *order;
+};
+
+struct _GstCamerasrcLatencyTracerClass
+{
+  GstTracerClass parent_class;
+
+  GstStructure *(*report)(GstCamerasrcLatencyTracer *tracer);
+};
+
+static GstTracerRecord *tr_latency;
+static GQuark tracer_pad_stages_quark;
+
+G_DEFINE_TYPE(GstCamerasrcLatencyTracer, gst_camerasrc_latency_tracer, GST_TYPE_TRACER);
+
+static const double tracer_quantiles[] = { 0.5, 0.9, 0.99, 1.0 };
+static const char *tracer_quantile_names[] = { "p50", "p90", "p99", "max" };
+
+static GstLatencyStage *
+gst_camerasrc_latency_tracer_stage(GstCamerasrcLatencyTracer *self, GstPad *pad,
+    gint device_id, gint stream_id)
+{
+  GstLatencyStage *stage;
+  GstObject *parent = GST_OBJECT_PARENT(pad);
+  gchar name[192], key[224];
+
+  g_snprintf(name, sizeof(name), "%s.%s", parent ? GST_OBJECT_NAME(parent) : "",
+      GST_OBJECT_NAME(pad));
+  g_snprintf(key, sizeof(key), "%d/%d/%s", device_id, stream_id, name);
+
+  g_mutex_lock(&self->lock);
+  stage = (GstLatencyStage *)g_hash_table_lookup(self->stages, key);
+  if (!stage) {
+    GstPad *peer = gst_pad_get_peer(pad);
+    GstElement *element = peer ? gst_pad_get_parent_element(peer) : NULL;
+
+    stage = new GstLatencyStage();
+    stage->device_id = device_id;
+    stage->stream_id = stream_id;
+    stage->pad = g_strdup(name);
+    stage->sink = element && GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK);
+    g_hash_table_insert(self->stages, g_strdup(key), stage);
+    g_ptr_array_add(self->order, stage);
+    GST_DEBUG("new stage %s, sink=%d", key, stage->sink);
+
+    if (element)
+      gst_object_unref(element);
+    if (peer)
+      gst_object_unref(peer);
+  }
+  g_mutex_unlock(&self->lock);
+
+  return stage;
+}
+
+static void
+gst_camerasrc_latency_tracer_pad_stages_free(gpointer data)
+{
+  delete (GstLatencyPadStages *)data;
+}
+
+/* Stage of a stream pushed from a pad, lock free once it was found */
+static GstLatencyStage *
+gst_camerasrc_latency_tracer_pad_stage(GstCamerasrcLatencyTracer *self, GstPad *pad,
+    gint device_id, gint stream_id)
+{
+  GstLatencyPadStages *stages =
+    (GstLatencyPadStages *)g_object_get_qdata(G_OBJECT(pad), tracer_pad_stages_quark);
+  GstLatencyStage *stage;
+  guint count, i;
+
+  if (!stages) {
+    stages = new GstLatencyPadStages();
+    stages->tracer = self;
+    if (!g_object_replace_qdata(G_OBJECT(pad), tracer_pad_stages_quark, NULL, stages,
+          gst_camerasrc_latency_tracer_pad_stages_free, NULL)) {
+      delete stages;
+      stages = (GstLatencyPadStages *)g_object_get_qdata(G_OBJECT(pad), tracer_pad_stages_quark);
+    }
+  }
+  /* the stages of another tracer instance are not mixed with these */
+  if (stages->tracer != self)
+    return gst_camerasrc_latency_tracer_stage(self, pad, device_id, stream_id);
+
+  count = MIN(stages->count.load(std::memory_order_acquire), (guint)GST_CAMERASRC_TRACER_PAD_STAGES);
+  for (i = 0; i < count; i++) {
+    stage = stages->entries[i].stage.load(std::memory_order_acquire);
+    if (stage && stages->entries[i].device_id == device_id &&
+        stages->entries[i].stream_id == stream_id)
+      return stage;
+  }
+
+  stage = gst_camerasrc_latency_tracer_stage(self, pad, device_id, stream_id);
+  i = stages->count.fetch_add(1, std::memory_order_relaxed);
+  if (i < GST_CAMERASRC_TRACER_PAD_STAGES) {
+    stages->entries[i].device_id = device_id;
+    stages->entries[i].stream_id = stream_id;
+    stages->entries[i].stage.store(stage, std::memory_order_release);
+  }
+
+  return stage;
+}
+
+static gboolean
+gst_camerasrc_latency_tracer_buffer(GstBuffer **buffer, guint idx, gpointer user_data)
+{
+  GstPad *pad = (GstPad *)((gpointer *)user_data)[0];
+  GstCamerasrcLatencyTracer *self = (GstCamerasrcLatencyTracer *)((gpointer *)user_data)[1];
+  GstReferenceTimestampMeta *meta;
+  const GstStructure *s;
+  gint device_id = -1, stream_id = -1;
+  guint64 now;
+
+  meta = gst_buffer_get_reference_timestamp_meta(*buffer, self->reference);
+  if (!meta)
+    return TRUE;
+
+  now = gst_camerasrc_clock_monotonic_ns();
+  if (now < meta->timestamp)
+    return TRUE;
+
+  s = gst_caps_get_structure(meta->reference, 0);
+  gst_structure_get_int(s, "device-id", &device_id);
+  gst_structure_get_int(s, "stream-id", &stream_id);
+
+  gst_camerasrc_histogram_record(
+      &gst_camerasrc_latency_tracer_pad_stage(self, pad, device_id, stream_id)->histogram,
+      now - meta->timestamp);
+
+  return TRUE;
+}
+
+static void
+gst_camerasrc_latency_tracer_push_pre(GObject *self, GstClockTime ts, GstPad *pad,
+    GstBuffer *buffer)
+{
+  gpointer data[2] = { pad, self };
+
+  gst_camerasrc_latency_tracer_buffer(&buffer, 0, data);
+}
+
+static void
+gst_camerasrc_latency_tracer_push_list_pre(GObject *self, GstClockTime ts, GstPad *pad,
+    GstBufferList *list)
+{
+  gpointer data[2] = { pad, self };
+
+  gst_buffer_list_foreach(list, gst_camerasrc_latency_tracer_buffer, data);
+}
+
+static GstStructure *
+gst_camerasrc_latency_tracer_report(GstCamerasrcLatencyTracer *self)
+{
+  GstStructure *report = gst_structure_new_empty("icamerasrc-latency");
+
+  g_mutex_lock(&self->lock);
+  for (guint i = 0; i < self->order->len; i++) {
+    GstLatencyStage *stage = (GstLatencyStage *)g_ptr_array_index(self->order, i);
+    guint64 values[G_N_ELEMENTS(tracer_quantiles)];
+    guint64 count = GST_CAMERASRC_STATS_GET(stage->histogram.count);
+    GstStructure *s;
+    gchar *name;
+
+    for (guint q = 0; q < G_N_ELEMENTS(tracer_quantiles); q++)
+      values[q] = gst_camerasrc_histogram_quantile(&stage->histogram, tracer_quantiles[q]);
+
+    gst_tracer_record_log(tr_latency, stage->device_id, stage->stream_id, stage->pad,
+        stage->sink, count, values[0], values[1], values[2], values[3]);
+
+    s = gst_structure_new("stage",
+        "device-id", G_TYPE_INT, stage->device_id,
+        "stream-id", G_TYPE_INT, stage->stream_id,
+        "pad", G_TYPE_STRING, stage->pad,
+        "sink", G_TYPE_BOOLEAN, stage->sink,
+        "count", G_TYPE_UINT64, count, NULL);
+    for (guint q = 0; q < G_N_ELEMENTS(tracer_quantiles); q++)
+      gst_structure_set(s, tracer_quantile_names[q], G_TYPE_UINT64, values[q], NULL);
+
+    name = g_strdup_printf("stage-%u", i);
+    gst_structure_set(report, name, GST_TYPE_STRUCTURE, s, NULL);
+    g_free(name);
+    gst_structure_free(s);
+  }
+  g_mutex_unlock(&self->lock);
+
+  return report;
+}
+
+static void
+gst_camerasrc_latency_tracer_push_event_pre(GObject *self, GstClockTime ts, GstPad *pad,
+    GstEvent *event)
+{
+  GstPad *peer;
+  GstElement *element;
+
+  if (GST_EVENT_TYPE(event) != GST_EVENT_EOS)
+    return;
+
+  /* report once the frames made it to a sink */
+  peer = gst_pad_get_peer(pad);
+  if (!peer)
+    return;
+
+  element = gst_pad_get_parent_element(peer);
+  if (element && GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK))
+    gst_structure_free(gst_camerasrc_latency_tracer_report(GST_CAMERASRC_LATENCY_TRACER(self)));
+
+  if (element)
+    gst_object_unref(element);
+  gst_object_unref(peer);
+}
+
+static void
+gst_camerasrc_latency_tracer_stage_free(gpointer data)
+{
+  GstLatencyStage *stage = (GstLatencyStage *)data;
+
+  g_free(stage->pad);
+  delete stage;
+}
+
+static void
+gst_camerasrc_latency_tracer_finalize(GObject *object)
+{
+  GstCamerasrcLatencyTracer *self = GST_CAMERASRC_LATENCY_TRACER(object);
+
+  gst_structure_free(gst_camerasrc_latency_tracer_report(self));
+
+  g_ptr_array_free(self->order, TRUE);
+  g_hash_table_destroy(self->stages);
+  gst_caps_unref(self->reference);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(gst_camerasrc_latency_tracer_parent_class)->finalize(object);
+}
+
+static GstStructure *
+gst_camerasrc_latency_tracer_field(GType type, const gchar *description)
+{
+  return gst_structure_new("value",
+      "type", G_TYPE_GTYPE, type,
+      "description", G_TYPE_STRING, description,
+      "flags", GST_TYPE_TRACER_VALUE_FLAGS, GST_TRACER_VALUE_FLAGS_AGGREGATED,
+      NULL);
+}
+
+static void
+gst_camerasrc_latency_tracer_class_init(GstCamerasrcLatencyTracerClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->finalize = gst_camerasrc_latency_tracer_finalize;
+  klass->report = gst_camerasrc_latency_tracer_report;
+
+  /**
+    * GstCamerasrcLatencyTracer::report:
+    *
+    * Log the latency percentiles and return them as a structure with a
+    * "stage-%u" sub-structure per stream and pushing pad, in ns.
+    */
+  g_signal_new("report", G_TYPE_FROM_CLASS(klass),
+      (GSignalFlags)(G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+      G_STRUCT_OFFSET(GstCamerasrcLatencyTracerClass, report), NULL, NULL, NULL,
+      GST_TYPE_STRUCTURE, 0);
+
+  tracer_pad_stages_quark = g_quark_from_static_string("icamerasrc-latency-stages");
+
+  tr_latency = gst_tracer_record_new("icamerasrc-latency.class",
+      "device-id", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_INT, "camera device id"),
+      "stream-id", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_INT, "icamerasrc stream id"),
+      "pad", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_STRING, "pad pushing the frames"),
+      "sink", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_BOOLEAN, "whether the peer is a sink"),
+      "count", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_UINT64, "frames pushed"),
+      "p50", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_UINT64, "median latency since capture in ns"),
+      "p90", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_UINT64, "90th percentile in ns"),
+      "p99", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_UINT64, "99th percentile in ns"),
+      "max", GST_TYPE_STRUCTURE,
+        gst_camerasrc_latency_tracer_field(G_TYPE_UINT64, "maximum latency in ns"),
+      NULL);
+  GST_OBJECT_FLAG_SET(tr_latency, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_camerasrc_latency_tracer_init(GstCamerasrcLatencyTracer *self)
+{
+  GstTracer *tracer = GST_TRACER(self);
+
+  g_mutex_init(&self->lock);
+  self->reference = gst_caps_new_empty_simple(GST_CAMERASRC_CAPTURE_TIMESTAMP_CAPS);
+  self->stages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      gst_camerasrc_latency_tracer_stage_free);
+  self->order = g_ptr_array_new();
+
+  gst_tracing_register_hook(tracer, "pad-push-pre",
+      G_CALLBACK(gst_camerasrc_latency_tracer_push_pre));
+  gst_tracing_register_hook(tracer, "pad-push-list-pre",
+      G_CALLBACK(gst_camerasrc_latency_tracer_push_list_pre));
+  gst_tracing_register_hook(tracer, "pad-push-event-pre",
+      G_CALLBACK(gst_camerasrc_latency_tracer_push_event_pre));
+}
+
+gboolean
+gst_camerasrc_latency_tracer_register(GstPlugin *plugin)
+{
+  GST_DEBUG_CATEGORY_INIT(gst_camerasrc_tracer_debug, GST_CAMERASRC_LATENCY_TRACER_NAME, 0,
+      "icamerasrc glass to sink latency tracer");
+
+  return gst_tracer_register(plugin, GST_CAMERASRC_LATENCY_TRACER_NAME,
+      GST_TYPE_CAMERASRC_LATENCY_TRACER);
+}
+
+#else
+
+/* GStreamer built without tracer hooks or without reference timestamps */
+gboolean
+gst_camerasrc_latency_tracer_register(GstPlugin *plugin)
+{
+  return TRUE;
+}
+
+#endif
@@ -60,7 +60,7 @@ GST_DEBUG_CATEGORY_STATIC (gst_cam_push_src_debug);
 #define gst_cam_push_src_parent_class parent_class
 G_DEFINE_TYPE_WITH_CODE (GstCamPushSrc, gst_cam_push_src, GST_TYPE_CAM_BASE_SRC, _do_init);
 
-static gboolean gst_cam_push_src_query (GstCamBaseSrc * src, GstQuery * query);
+static gboolean gst_cam_push_src_query (GstCamBaseSrc * src, GstPad * pad, GstQuery * query);
 static GstFlowReturn gst_cam_push_src_create (GstCamBaseSrc * bsrc, GstPad *pad, guint64 offset,
     guint length, GstBuffer ** ret);
 static GstFlowReturn gst_cam_push_src_alloc (GstCamBaseSrc * bsrc, GstPad *pad, guint64 offset,
@@ -83,7 +83,7 @@ static void
 gst_cam_push_src_init (GstCamPushSrc * pushsrc) {}
 
 static gboolean
-gst_cam_push_src_query (GstCamBaseSrc * src, GstQuery * query)
+gst_cam_push_src_query (GstCamBaseSrc * src, GstPad * pad, GstQuery * query)
 {
   gboolean ret;
 
@@ -100,7 +100,7 @@ gst_cam_push_src_query (GstCamBaseSrc * src, GstQuery * query)
       break;
     }
     default:
-      ret = GST_CAM_BASE_SRC_CLASS (parent_class)->query (src, query);
+      ret = GST_CAM_BASE_SRC_CLASS (parent_class)->query (src, pad, query);
       break;
   }
   return ret;
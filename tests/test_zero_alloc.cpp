@@ -0,0 +1,217 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Checks that the streaming thread of icamerasrc doesn't allocate once
+ * it's warmed up. malloc and friends are wrapped to count the calls made
+ * by the thread pushing on the src pad between two buffers of the steady
+ * state, fakesink releases the buffers on that thread too. The HAL and
+ * the other threads are not counted.
+ *
+ * It runs against the real HAL, so it only checks something on a machine
+ * with a camera, it's skipped (exit code 77) when none can be started.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <atomic>
+
+#include <gst/gst.h>
+
+/* buffers pushed before counting, the pools and rings are filled and the
+ * 3A convergence window (GST_CAMERASRC_3A_CONVERGE_MAX_FRAMES) is over */
+#define WARMUP_BUFFERS 200
+#define COUNTED_BUFFERS 300
+#define TEST_SKIP 77
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+static __thread gboolean counting;
+static std::atomic<guint64> allocations(0);
+
+static inline void
+count_allocation(void)
+{
+  if (G_UNLIKELY(counting))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *
+malloc(size_t size)
+{
+  count_allocation();
+  return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(size_t nmemb, size_t size)
+{
+  count_allocation();
+  return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *
+realloc(void *ptr, size_t size)
+{
+  count_allocation();
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void *
+memalign(size_t alignment, size_t size)
+{
+  count_allocation();
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" void *
+aligned_alloc(size_t alignment, size_t size)
+{
+  count_allocation();
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" int
+posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  count_allocation();
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+
+static guint64 buffers;
+
+/* runs on the streaming thread before each push */
+static GstPadProbeReturn
+buffer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GMainLoop *loop = (GMainLoop *) user_data;
+
+  buffers++;
+  if (buffers == WARMUP_BUFFERS) {
+    counting = TRUE;
+  } else if (buffers == WARMUP_BUFFERS + COUNTED_BUFFERS) {
+    counting = FALSE;
+    g_main_loop_quit(loop);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+bus_watch(GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  GMainLoop *loop = (GMainLoop *) user_data;
+
+  if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+    g_main_loop_quit(loop);
+
+  return TRUE;
+}
+
+int
+main(int argc, char *argv[])
+{
+  GstElement *pipeline, *src;
+  GstPad *pad;
+  GstBus *bus;
+  GMainLoop *loop;
+  GError *error = NULL;
+  guint watch;
+  int ret;
+
+  gst_init(&argc, &argv);
+
+  /* no stats messages and clock timestamps, whose latency is the frame
+   * duration, so no message is posted from the streaming thread */
+  pipeline = gst_parse_launch("icamerasrc name=src stats-interval=0 timestamp-mode=clock "
+      "startup-frames=push ! fakesink sync=false enable-last-sample=false", &error);
+  if (!pipeline) {
+    g_printerr("icamerasrc not available: %s\n", error->message);
+    g_error_free(error);
+    return TEST_SKIP;
+  }
+
+  loop = g_main_loop_new(NULL, FALSE);
+  src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  pad = gst_element_get_static_pad(src, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, buffer_probe, loop, NULL);
+  bus = gst_element_get_bus(pipeline);
+  watch = gst_bus_add_watch(bus, bus_watch, loop);
+
+  if (gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE)
+    g_main_loop_run(loop);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+
+  if (buffers < WARMUP_BUFFERS) {
+    g_printerr("no camera streaming, %" G_GUINT64_FORMAT " buffers\n", buffers);
+    ret = TEST_SKIP;
+  } else if (buffers < WARMUP_BUFFERS + COUNTED_BUFFERS) {
+    g_printerr("stream stopped after %" G_GUINT64_FORMAT " buffers\n", buffers);
+    ret = EXIT_FAILURE;
+  } else {
+    guint64 count = allocations.load();
+
+    g_print("%" G_GUINT64_FORMAT " allocations in %d buffers\n", count, COUNTED_BUFFERS);
+    ret = count == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  g_source_remove(watch);
+  gst_object_unref(bus);
+  gst_object_unref(pad);
+  gst_object_unref(src);
+  gst_object_unref(pipeline);
+  g_main_loop_unref(loop);
+
+  return ret;
+}